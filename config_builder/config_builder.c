@@ -29,8 +29,11 @@ int main(int argc, const char *argv[]) {
     digests_t *digest_ctx;
     const char* fasta_file;
     faidx_t *fai;
+    seq_reader_t *reader;
     int nseq, i, buflen, aliases;
     seq_iterator_t* siterator;
+    tark_arena_t* arena;
+    tark_allocator_t arena_alloc;
     const char* seqname;
     char seq[BUFSIZE];
 
@@ -130,8 +133,21 @@ int main(int argc, const char *argv[]) {
       return -1;
     }
 
+    /* Read the bases directly if we can, NULL just means we
+       go through faidx */
+    reader = seq_reader_open(fasta_file);
+
     printf("<SeqFile \"%s\">\n", fasta_file);
 
+    /* Each iterator is allocated from an arena that's reset
+       for the next sequence, rather than malloc'ed and freed */
+    arena = tark_arena_create(0);
+    if(arena == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return -1;
+    }
+    arena_alloc = tark_arena_allocator(arena);
+
     /* Number of sequences in the file */
     nseq = faidx_nseq((faidx_t*)fai);
 
@@ -143,7 +159,7 @@ int main(int argc, const char *argv[]) {
 
       /* Use our iterator functionality to get chunks of sequence
          and run them through the openssl digest create routines */
-      siterator = tark_fetch_iterator(fai, seqname, NULL, 0);
+      siterator = tark_fetch_iterator_handle_alloc(fai, reader, i, NULL, 0, &arena_alloc);
 
       /* Initialize all the digest contexts for ones we've been asked
          to create */
@@ -176,12 +192,16 @@ int main(int argc, const char *argv[]) {
 	printf("  Alias %s %s\n", seqname, seqname);
       }
 
-      /* Free the iterator */
-      tark_free_iterator(siterator);
+      /* Throw away the iterator */
+      tark_arena_reset(arena);
     }
 
     printf("</SeqFile>\n");
 
+    tark_arena_destroy(arena);
+    seq_reader_close(reader);
+    fai_destroy(fai);
+
     apr_terminate();
     return 0;
 }
@@ -31,8 +31,15 @@
 #include <apr_strings.h>
 #include <openssl/md5.h>
 #include "htslib/faidx.h"
+#include "seq_reader.h"
+#include "seq_block_cache.h"
 
-#define FM_FAIDX 1
+#define FM_FAIDX 1 /* Anything faidx can read, through htslib */
+#define FM_BGZF 2  /* bgzip fasta with its .fai and .gzi, read by our own
+		      reader without htslib */
+#define FM_ZSTD 3  /* Seekable zstd fasta with its .fai, read by our own
+		      reader */
+#define FM_2BIT 4  /* UCSC .2bit, read by our own reader */
 
 /* For sanity, don't let them go beyond unless
    they really know what they're doing and recompile */
@@ -46,10 +53,16 @@ typedef struct _seq_file_t {
   APR_RING_ENTRY(_seq_file_t) link; /* Ring entry for APR Ring macros*/
 
   const char* path;                 /* Path and filename of sequences */
-  int type;                         /* Type of file, only FAIDX implemented currently */
+  int type;                         /* Type of file, FM_FAIDX, FM_BGZF, FM_ZSTD
+				       or FM_2BIT */
   apr_hash_t* sequences;            /* Hash of all sequences in the sequence file */
-  void* file_ptr;                   /* Ptr to the file handle, a faidx_t for FAIDX type.
+  void* file_ptr;                   /* Ptr to the file handle, a faidx_t for FAIDX type,
+				       the seq_reader_t for the other types.
 				       NULL if the file or connection is closed. */
+  seq_reader_t* reader;             /* Direct reader for plain, compressed or .2bit files, NULL if
+				       the file is closed or can't be read directly */
+  int genetic_code;                 /* NCBI genetic code to translate with when the
+				       request doesn't give one */
 } seq_file_t;
 
 /* APR ring container type */
@@ -63,6 +76,8 @@ typedef struct {
   files_mgr_ring_t* cache; /* Ring buffer of cached open files */
   apr_hash_t* seqfiles;    /* Hash of seqfiles, keyed on the MD5 of the full filename
 			      for FAIDX type */
+  seq_block_cache_t* blocks; /* Decompressed blocks of the open compressed files,
+				NULL if we couldn't make one */
   apr_pool_t *mp;          /* Memory pool for our use, created as a sub-pool of
 			      the pool passed in at init unless that pool was NULL */
 } files_mgr_t;
@@ -77,9 +92,16 @@ alias_obj* _files_mgr_create_alias(files_mgr_t* fm, sequence_obj* seq);
 int files_mgr_add_alias(files_mgr_t* fm, const unsigned char* seqfile_md5, char* seqname, char* alias);
 int _files_mgr_init_seqfile(files_mgr_t* fm, seq_file_t *seqfile);
 int _files_mgr_init_faidx_file(files_mgr_t* fm, seq_file_t *seqfile);
+int _files_mgr_init_reader_file(files_mgr_t* fm, seq_file_t *seqfile);
+int files_mgr_file_type(const char* path);
+faidx_t* files_mgr_faidx(seq_file_t *seqfile);
 int files_mgr_open_file(files_mgr_t* fm, seq_file_t *seqfile);
+int64_t files_mgr_seq_len(seq_file_t *seqfile, sequence_obj *seq);
 int files_mgr_seqfile_usable(seq_file_t *seqfile);
 int files_mgr_resize_cache(files_mgr_t* fm, int new_cache_size);
+int files_mgr_resize_block_cache(files_mgr_t* fm, size_t new_budget);
+int files_mgr_share_blocks(files_mgr_t* fm, void* base, size_t size);
+apr_status_t _files_mgr_cleanup_blocks(void* files_mgr);
 int _files_mgr_insert_cache(files_mgr_t* fm, seq_file_t *seqfile);
 int _files_mgr_remove_from_cache(files_mgr_t* fm, seq_file_t *seqfile);
 int files_mgr_close_file(files_mgr_t* fm, seq_file_t *seqfile);
@@ -22,47 +22,134 @@
 #define __HTSLIB_FETCHER_H__
 
 #include "htslib/faidx.h"
+#include "seq_reader.h"
+#include "seq_kernels.h"
+#include "tark_alloc.h"
 
 #include <stdio.h>
+#include <stdint.h>
+
+/* Most segments a location string can have */
+#ifndef TARK_MAX_LOCATIONS
+#define TARK_MAX_LOCATIONS 100000
+#endif
+
+#define TARK_NO_EXTENT 0xFFFFFFFF
+
+/* Bases gathered at a time for translating, a whole number of codons */
+#ifndef TARK_TRANSLATE_SCRATCH
+#define TARK_TRANSLATE_SCRATCH (3 * 16384)
+#endif
+
+/* Positions and lengths in bp are 64 bit throughout, some plant and
+   amphibian chromosomes are longer than an unsigned int can count */
 
 typedef struct seq_location {
+  uint64_t start;
+  uint64_t end;
+  uint64_t length;
+  uint64_t offset; // bp in all the segments before this one
+  unsigned int extent; // Which read extent the segment is in, TARK_NO_EXTENT
+                       // if it's read on its own
+} seq_location_t;
+
+/* A stretch of the sequence covering several segments that's read
+   in one go, see _tark_iterator_plan_reads */
+typedef struct seq_extent {
+  uint64_t start;
+  uint64_t end;
+} seq_extent_t;
+
+/* An open reading frame found by tark_find_orfs. start and end are
+   the half open range of the bases scanned it covers, start codon
+   to stop codon, counted on the forward strand whichever strand
+   the ORF is on */
+typedef struct seq_orf {
   unsigned int start;
   unsigned int end;
-  unsigned int length;
-} seq_location_t;
+  int frame;           // 1 to 3 on the forward strand, -1 to -3 on the reverse
+  unsigned int length; // Amino acids, not counting the stop
+  const char* protein; // The amino acids, in the frames passed to tark_find_orfs
+} seq_orf_t;
+
+/* A run of bases in place in a mapped file, see tark_iterator_fetch_spans */
+typedef struct tark_span {
+  const char* base;
+  size_t len;
+} tark_span_t;
+
+struct seq_iterator;
+
+/* A fetch function specialised for one strand, translate and line
+   wrapping combination, see tark_iterator_specialize */
+typedef char* (*tark_fetcher_t)(struct seq_iterator* siterator, int *seq_len, char* seq_ptr);
 
 typedef struct seq_iterator {
   faidx_t* fai;
+  seq_reader_t* reader; // Direct reader for the file, NULL to go through faidx
+  int seq_id; // Id of the sequence in the reader
+  uint64_t ref_length; // Length of the whole reference sequence
   char* checksum;
   char* seq_name;
   char* location_str;
-  unsigned int seq_length;
-  unsigned int seq_iterated; // Overall how far along are we
+  uint64_t seq_length;
+  uint64_t seq_iterated; // Overall how far along are we
   unsigned int line_length; // How long a line to print before wrapping
+  int cr_written; // The CR at the end of the line we're at has been sent
+  int transform; // SEQ_XFORM_UPPER or SEQ_XFORM_LOWER to fold case,
+                 // SEQ_XFORM_HARDMASK to turn soft masked bases to N
   int strand;
   int translate;
+  int frames; // 6 to translate in all six reading frames at once
+  const char* code; // Codon table to translate with, from seq_genetic_code,
+                    // NULL for the standard code
+  tark_fetcher_t fetcher; // Fetch function for the above, NULL until picked
   seq_location_t* locations;
+  unsigned int nlocations; // How many segments in locations
   unsigned int segment_ptr; // Which segment are we on
-  unsigned int segment_bp_ptr; // Where are we in that segment, relative numbers
+  uint64_t segment_bp_ptr; // Where are we in that segment, relative numbers,
+                               // on the reverse strand how much of it is left
+  seq_extent_t* extents; // Extents segments are coalesced in to for reading
+  unsigned int nextents;
+  unsigned int extent_ptr; // The extent last read ahead
+  char* scratch; // TARK_TRANSLATE_SCRATCH bytes for the bases being translated,
+                 // allocated on the first translated fetch if NULL
+  tark_allocator_t alloc; // Where the iterator and everything it holds came
+                          // from, all zero for malloc
 } seq_iterator_t;
 
 seq_iterator_t* tark_fetch_iterator(faidx_t* fai, const char *seq_name, const char *locs, int ensembl_coords);
-int tark_iterator_translated_length(seq_iterator_t* siterator, int* remaining, int* unpadded_remaining);
+seq_iterator_t* tark_fetch_iterator_handle(faidx_t* fai, seq_reader_t* reader, int seq_id, const char *locs, int ensembl_coords);
+seq_iterator_t* tark_fetch_iterator_handle_alloc(faidx_t* fai, seq_reader_t* reader, int seq_id, const char *locs, int ensembl_coords, const tark_allocator_t* alloc);
+int _tark_iterator_parse_locations(seq_iterator_t* siterator, const char *locs, int ensembl_coords);
+int64_t tark_iterator_translated_length(seq_iterator_t* siterator, int64_t* remaining, int64_t* unpadded_remaining);
 char* tark_fetch_seq(faidx_t* fai, const char *str, int *seq_len);
+int64_t tark_fetch_seq_into(seq_reader_t* reader, int seq_id, uint64_t beg, uint64_t end, char* dest);
 char* tark_iterator_fetch_translated_seq(seq_iterator_t* siterator, int *seq_len, char* seq_ptr);
 char* tark_iterator_fetch_seq(seq_iterator_t* siterator, int *seq_len, char* seq_ptr);
-char* _tark_iterator_fetch_seq(seq_iterator_t* siterator, int *seq_len, char* seq_ptr, int do_line_length);
+char* tark_iterator_fetch(seq_iterator_t* siterator, int *seq_len, char* seq_ptr);
+int tark_iterator_spannable(seq_iterator_t* siterator, uint64_t min_run);
+int tark_iterator_fetch_spans(seq_iterator_t* siterator, tark_span_t* spans, int max_spans, uint64_t max_bp);
+void tark_iterator_specialize(seq_iterator_t* siterator);
 void tark_iterator_set_line_length(seq_iterator_t* siterator, unsigned int length);
-int tark_iterator_adjusted_seq_len(int window, int bp_remaining, int bp_iterated, int line_length, int* bytes_to_cr);
-int tark_iterator_seek(seq_iterator_t* siterator, unsigned int bp);
+int tark_iterator_set_reader(seq_iterator_t* siterator, seq_reader_t* reader);
+int _tark_iterator_plan_reads(seq_iterator_t* siterator);
+void tark_iterator_set_transform(seq_iterator_t* siterator, int transform);
+int tark_iterator_set_genetic_code(seq_iterator_t* siterator, int id);
+int tark_iterator_adjusted_seq_len(seq_iterator_t* siterator, int window, int64_t bp_remaining, uint64_t bp_iterated, int* bytes_to_cr);
+int tark_iterator_seek(seq_iterator_t* siterator, uint64_t bp);
 int tark_iterator_locations_count(seq_iterator_t* siterator);
-int tark_iterator_remaining(seq_iterator_t* siterator, int translated);
+int64_t tark_iterator_remaining(seq_iterator_t* siterator, int translated);
 void tark_free_iterator(seq_iterator_t* siterator);
 char* tark_translate_seq(faidx_t* fai, const char *str, int *seq_len);
 char* tark_translate_seqs(char **str, int seq_len, int nseqs, int strand);
+void tark_translate_frames(const char* seq, int len, const char* code, char* rc, char** frames, int* lens);
+int tark_find_orfs(const char* seq, int len, const char* code, unsigned int min_length, char* rc, char** frames, seq_orf_t** orfs, const tark_allocator_t* alloc);
 char* tark_revcomp_seq(char *seq);
+char* tark_revcomp_seq_len(char *seq, int len);
 char* tark_rev_seq(char* seq);
 char** tark_fetch_seqs(faidx_t* fai, const char *str, int *seq_len, int *nseqs, int *strand);
 int memcpy_with_cr(void* dest, void* src, int len, int line_len, int *bytes_to_cr);
+int tark_copy_transform(void* dest, const char* src, int len, int transform, int line_len, int *bytes_to_cr);
 
 #endif
@@ -34,9 +34,11 @@
 #include <apr_strings.h>
 #include <apr_hash.h>
 #include <apr_escape.h>
+#include <apr_shm.h>
 #include <ap_mpm.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 
 //static const int MAX_SIZE = 16384;
 //static const int MAX_FASTA_LINE_LENGTH = 60;
@@ -56,6 +58,9 @@ typedef struct {
   int labels_endpoints;     /* Boolean flag on if labels based endpoints are
 			       enabled. eg /sequence/md5/<hash>/ */
   int cachesize;            /* The cachesize for number of file handles to keep open */
+  apr_size_t shared_blockcache; /* Bytes of shared memory for decompressed blocks,
+				   0 for none */
+  apr_shm_t* shm;           /* and the shared memory, made in post_config */
 } mod_Faidx_svr_cfg;
 
 static int Faidx_handler(request_rec* r);
@@ -66,19 +71,24 @@ static void mod_Faidx_hooks(apr_pool_t* pool);
 
 static void* mod_Faidx_svr_conf(apr_pool_t* pool, server_rec* s);
 void print_fasta(request_rec* r, char* header, char* seq, int seq_len);
-int Faidx_create_header(char* buf, int format, char* set, char* seq_name, char* location, int seq_count);
+int Faidx_create_header(char* buf, int format, char* set, char* seq_name, char* location, int seq_count, int frame);
+int Faidx_send_frames(request_rec* r, seq_iterator_t* siterator, int format, char* h_buf, unsigned int* seq_count, int* buf_remaining, char** buf_ptr);
 int Faidx_append_or_send(request_rec* r, char* send_ptr, int send_length, int* buf_remaining, char** buf_ptr, int flush);
+apr_status_t Faidx_send_spans(request_rec* r, seq_iterator_t* siterator, int* buf_remaining, char** buf_ptr);
 int Faidx_create_footer(char* buf, int format);
 int Faidx_create_end(char* buf, int format);
 const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_hash_t *formdata, seq_iterator_t** sit);
-seq_iterator_t* iterator_pool_copy(request_rec* r, seq_iterator_t* siterator);
+void* pool_allocate(void* pool, size_t size);
 int metadata_handler(request_rec* r, const char* checksum, checksum_obj* checksum_holder);
 int info_handler(request_rec* r);
+int orfs_handler(request_rec* r, seq_iterator_t* siterator, int accept, apr_hash_t* formdata);
 
 static const char* seqfile_section(cmd_parms * cmd, void * _cfg, const char * arg);
 checksum_obj* parse_seq_token(cmd_parms * cmd, char** seqname, char** seq_checksum,  char* args);
 char* parse_alias_token(cmd_parms * cmd, char** seqname, char** alias,  char* args);
 static const char* modFaidx_init_cachesize(cmd_parms* cmd, void* cfg, const char* cachesize);
+static const char* modFaidx_init_blockcache(cmd_parms* cmd, void* cfg, const char* blockcache);
+static const char* modFaidx_init_sharedblockcache(cmd_parms* cmd, void* cfg, const char* blockcache);
 
 static apr_hash_t *parse_form_from_string(request_rec *r, char *args);
 static apr_hash_t* parse_form_from_GET(request_rec *r);
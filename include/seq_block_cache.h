@@ -0,0 +1,75 @@
+/* Decompressed block cache
+
+ An LRU cache of decompressed BGZF blocks shared by the readers
+ of a process, so requests for neighbouring ranges of a bgzip
+ file don't inflate the same block again. Blocks it doesn't hold
+ can be looked for in a cache shared with the other processes.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef __MOD_FAIDX_SEQ_BLOCK_CACHE_H__
+#define __MOD_FAIDX_SEQ_BLOCK_CACHE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "seq_shared_cache.h"
+
+/* Largest block we'll be asked to hold, a BGZF block never
+   decompresses to more than this */
+#define SEQ_BLOCK_MAX 65536
+
+/* Hash buckets the cache starts with, doubled as it fills */
+#define SEQ_BLOCK_BUCKETS 64
+
+/* One decompressed block, the data follows the header in the
+   same allocation */
+typedef struct seq_block {
+  struct seq_block* prev;   /* LRU list, most recently used first */
+  struct seq_block* next;
+  struct seq_block* chain;  /* Next block in the same hash bucket */
+  uint64_t file_id;         /* File the block came from */
+  uint64_t offset;          /* Compressed offset of the block in the file */
+  size_t len;               /* Bytes of decompressed data */
+  char* data;
+} seq_block_t;
+
+typedef struct seq_block_cache {
+  size_t budget;            /* Most bytes of data to hold, 0 to hold nothing */
+  size_t used;              /* Bytes of data held */
+  uint64_t nblocks;         /* Blocks held */
+  seq_block_t* head;        /* Most recently used */
+  seq_block_t* tail;        /* Least recently used, the next to go */
+  seq_block_t** buckets;    /* Hash of (file_id, offset) */
+  uint64_t nbuckets;        /* Always a power of two */
+  seq_shared_cache_t* shared; /* Where to look next, NULL if we're on our own */
+  char* bounce;             /* SEQ_BLOCK_MAX bytes to copy shared blocks in
+			       to when we can't hold them, made when needed */
+  uint64_t hits;            /* Lookups that found their block */
+  uint64_t misses;          /* and those that didn't */
+  uint64_t evictions;       /* Blocks dropped to stay within budget */
+} seq_block_cache_t;
+
+seq_block_cache_t* seq_block_cache_create(size_t budget);
+void seq_block_cache_destroy(seq_block_cache_t* cache);
+void seq_block_cache_resize(seq_block_cache_t* cache, size_t budget);
+void seq_block_cache_share(seq_block_cache_t* cache, seq_shared_cache_t* shared);
+const char* seq_block_cache_get(seq_block_cache_t* cache, uint64_t file_id, uint64_t offset, size_t* len);
+const char* seq_block_cache_put(seq_block_cache_t* cache, uint64_t file_id, uint64_t offset, const char* data, size_t len);
+void seq_block_cache_drop(seq_block_cache_t* cache, uint64_t file_id);
+const char* _seq_block_cache_store(seq_block_cache_t* cache, uint64_t file_id, uint64_t offset, const char* data, size_t len);
+void _seq_block_cache_unlink(seq_block_cache_t* cache, seq_block_t* block);
+int _seq_block_cache_grow(seq_block_cache_t* cache);
+
+#endif
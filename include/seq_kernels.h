@@ -0,0 +1,83 @@
+/* Sequence kernels
+
+ Tight loops over buffers of bases, reverse complementing and
+ the like, with SIMD versions for each x86 instruction set and
+ plain C versions, the best the CPU runs is picked at run time.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef __MOD_FAIDX_SEQ_KERNELS_H__
+#define __MOD_FAIDX_SEQ_KERNELS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Complement of every byte. IUPAC codes are complemented
+   (A<->T, C<->G, R<->Y, K<->M, B<->V, D<->H, U->A, and S, W, N
+   themselves), case is kept, anything else maps to itself. */
+extern const unsigned char seq_complement[256];
+
+/* Transforms for seq_transform, REVCOMP can be combined with
+   one of UPPER or LOWER and with HARDMASK, which is done before
+   the case is folded */
+#define SEQ_XFORM_REVCOMP  0x1 /* Reverse complement */
+#define SEQ_XFORM_UPPER    0x2 /* Upper case letters */
+#define SEQ_XFORM_LOWER    0x4 /* Lower case letters */
+#define SEQ_XFORM_HARDMASK 0x8 /* Lower case (soft masked) letters become N */
+
+/* Codes of bases for translation, A 0, C 1, G 2, T/U 3 and 0x54
+   for anything else, and the code of each base's complement */
+extern const unsigned char seq_codon_base[256];
+extern const unsigned char seq_codon_base_comp[256];
+
+/* Amino acid for each packed codon index, see SEQ_CODON_INDEX,
+   in the standard genetic code. seq_genetic_code gives the table
+   for any NCBI genetic code (transl_table) id. */
+extern const char* const seq_codon_table;
+
+#define SEQ_GENETIC_CODE_STANDARD 1
+
+/* Pack three bases, through one of the base code tables, in to a
+   seq_codon_table index. Bit 6 is set if any base is ambiguous. */
+#define SEQ_CODON_INDEX(codes, a, b, c)			\
+  ( ( ((codes)[(unsigned char)(a)] << 4) |		\
+      ((codes)[(unsigned char)(b)] << 2) |		\
+      (codes)[(unsigned char)(c)] ) & 0x7F )
+
+/* Levels of kernels, each needs the instruction set named */
+#define SEQ_KERNELS_SCALAR 0 /* Plain C */
+#define SEQ_KERNELS_SSE41  1 /* SSE4.1 */
+#define SEQ_KERNELS_AVX2   2 /* AVX2 */
+#define SEQ_KERNELS_AVX512 3 /* AVX-512BW */
+
+int seq_kernels_init();
+int seq_kernels_detect();
+int seq_kernels_use(int level);
+const char* seq_kernels_impl();
+void seq_revcomp(char* dest, const char* src, size_t len);
+void seq_revcomp_inplace(char* seq, size_t len);
+void _seq_revcomp_scalar(char* dest, const char* src, size_t len);
+void _seq_revcomp_inplace_scalar(char* seq, size_t len);
+void seq_transform(char* dest, const char* src, size_t len, int flags);
+void _seq_transform_scalar(char* dest, const char* src, size_t len, int flags);
+const char* seq_genetic_code(int id);
+const char* seq_genetic_code_name(int id);
+size_t seq_translate(char* dest, const char* src, size_t len);
+size_t seq_translate_code(char* dest, const char* src, size_t len, const char* code);
+size_t _seq_translate_scalar(char* dest, const char* src, size_t len, const char* code);
+void seq_unpack_2bit(char* dest, const unsigned char* packed, uint64_t first, size_t len);
+void _seq_unpack_2bit_scalar(char* dest, const unsigned char* src, size_t nbytes);
+
+#endif
@@ -0,0 +1,135 @@
+/* Direct sequence reader
+
+ Reads bases straight out of indexed fasta files using the
+ offsets in the .fai index, bypassing the faidx_fetch_seq
+ path and its per call allocations.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef __MOD_FAIDX_SEQ_READER_H__
+#define __MOD_FAIDX_SEQ_READER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "seq_block_cache.h"
+
+#define SEQ_READER_MMAP 1 /* Uncompressed fasta, mapped in to memory */
+#define SEQ_READER_BGZF 2 /* bgzip compressed fasta with a .gzi index, its
+			     blocks read and inflated by the reader */
+#define SEQ_READER_ZSTD 3 /* Seekable zstd compressed fasta, its frames found
+			     through the seek table at the end of the file */
+#define SEQ_READER_2BIT 4 /* UCSC .2bit, mapped in to memory and unpacked
+			     as it's read */
+
+/* Largest frame of a zstd file we'll decompress, a seek table
+   saying otherwise is refused */
+#define SEQ_READER_FRAME_MAX 8388608
+
+/* Size of the reader's own buffer, used to hand back runs of
+   bases from compressed files */
+#define SEQ_READER_SCRATCH 65536
+
+/* One line of the .fai index, or one sequence of a .2bit file's
+   own index */
+typedef struct seq_reader_entry {
+  char* name;          /* Sequence name, eg 1, chrX */
+  uint64_t length;     /* Number of bases in the sequence */
+  uint64_t offset;     /* Byte offset of the first base in the file,
+			  for .2bit of the packed DNA */
+  uint64_t line_bases; /* Bases on each full line */
+  uint64_t line_width; /* Bytes on each full line, including the EOL.
+			  A .2bit sequence is one line with no EOL */
+  uint64_t n_offset;   /* For .2bit where the starts of the sequence's
+			  N blocks are, their sizes follow */
+  uint64_t mask_offset; /* and the same for its lower case blocks */
+  uint32_t n_count;    /* Number of each */
+  uint32_t mask_count;
+} seq_reader_entry_t;
+
+typedef struct seq_reader {
+  int type;                  /* How we get at the bases, SEQ_READER_MMAP
+				SEQ_READER_BGZF or SEQ_READER_ZSTD */
+  int nseqs;                 /* Number of sequences in the index */
+  seq_reader_entry_t* seqs;  /* Index entries in file order, the position
+				in this array is the sequence id */
+  int* sorted;               /* Sequence ids sorted by name, for lookups */
+  char* map;                 /* The mapped file for SEQ_READER_MMAP and
+				SEQ_READER_2BIT */
+  size_t map_size;           /* Size of the mapping */
+  int fd;                    /* The open file for a compressed type, -1 if none */
+  uint64_t file_size;        /* and its size, for the length of the last block */
+  char* scratch;             /* Buffer for runs from compressed files,
+				SEQ_READER_SCRATCH bytes */
+  int scratch_id;            /* Sequence, first base and number of bases */
+  uint64_t scratch_beg;      /* held in scratch, scratch_len 0 if none */
+  uint64_t scratch_len;
+  uint64_t reads;            /* Physical reads so far, decompressions in to
+				scratch or prefetches of the mapping */
+  uint64_t* gzi;             /* Compressed and uncompressed offset of each
+				block, in pairs, the first block included.
+				For zstd the frames, from the seek table,
+				and a last pair for where they end */
+  uint64_t ngzi;             /* Number of blocks in gzi */
+  seq_block_cache_t* blocks; /* Cache of decompressed blocks shared with other
+				readers, NULL if we're on our own */
+  uint64_t file_id;          /* The file's identity in the block caches, from
+				its device, inode, size and mtime so other
+				processes agree on it and a replaced file
+				doesn't match */
+  char* block;               /* The block we last inflated, block_max bytes */
+  size_t block_len;          /* Bytes of it */
+  uint64_t block_coff;       /* and its compressed offset, UINT64_MAX if none */
+  size_t block_max;          /* Largest block of the file, SEQ_BLOCK_MAX for
+				bgzip, the largest frame for zstd */
+  unsigned char* cblock;     /* A compressed block as read, cblock_max bytes */
+  size_t cblock_max;
+  void* inflater;            /* libdeflate's decompressor, a zlib stream or
+				a zstd context */
+  uint64_t inflates;         /* Blocks inflated or frames decompressed */
+  int swap;                  /* A .2bit file of the other endianness */
+} seq_reader_t;
+
+seq_reader_t* seq_reader_open(const char* path);
+void seq_reader_close(seq_reader_t* reader);
+int seq_reader_nseq(seq_reader_t* reader);
+const char* seq_reader_iseq(seq_reader_t* reader, int seq_id);
+int seq_reader_seq_id(seq_reader_t* reader, const char* name);
+uint64_t seq_reader_seq_len(seq_reader_t* reader, int seq_id);
+const char* seq_reader_run(seq_reader_t* reader, int seq_id, uint64_t pos, uint64_t len, uint64_t* run_len);
+const char* seq_reader_run_back(seq_reader_t* reader, int seq_id, uint64_t end, uint64_t len, uint64_t* run_len);
+int64_t seq_reader_fetch(seq_reader_t* reader, int seq_id, uint64_t beg, uint64_t len, char* dest);
+int seq_reader_prefetch(seq_reader_t* reader, int seq_id, uint64_t beg, uint64_t len);
+int seq_reader_set_block_cache(seq_reader_t* reader, seq_block_cache_t* cache);
+int _seq_reader_load_index(seq_reader_t* reader, const char* path);
+int _seq_reader_sort_names(seq_reader_t* reader);
+int _seq_reader_map_file(seq_reader_t* reader, const char* path);
+int _seq_reader_open_fd(seq_reader_t* reader, const char* path);
+int _seq_reader_open_bgzf(seq_reader_t* reader, const char* path);
+int _seq_reader_bgzf_header(const unsigned char* header);
+int _seq_reader_load_gzi(seq_reader_t* reader, const char* path);
+int _seq_reader_open_zstd(seq_reader_t* reader);
+int _seq_reader_load_seek_table(seq_reader_t* reader);
+int64_t _seq_reader_block_fetch(seq_reader_t* reader, seq_reader_entry_t* seq, uint64_t beg, uint64_t len, char* dest);
+const char* _seq_reader_block(seq_reader_t* reader, uint64_t raw_pos, uint64_t* avail);
+int _seq_reader_inflate(seq_reader_t* reader, uint64_t block);
+int _seq_reader_unzstd(seq_reader_t* reader, uint64_t frame);
+int _seq_reader_open_2bit(seq_reader_t* reader, const char* path);
+int _seq_reader_load_2bit_index(seq_reader_t* reader, uint32_t version, uint32_t nseqs);
+uint32_t _seq_reader_2bit_u32(seq_reader_t* reader, uint64_t offset);
+int64_t _seq_reader_2bit_fetch(seq_reader_t* reader, seq_reader_entry_t* seq, uint64_t beg, uint64_t len, char* dest);
+void _seq_reader_2bit_blocks(seq_reader_t* reader, uint64_t offset, uint32_t count, uint64_t beg, uint64_t len, char* dest, int mask);
+int _seq_reader_fill_scratch(seq_reader_t* reader, int seq_id, uint64_t beg, uint64_t len);
+
+#endif
@@ -0,0 +1,77 @@
+/* Shared decompressed block cache
+
+ A cache of decompressed BGZF blocks in a region of shared memory
+ set up before Apache forks its children, so a block one child
+ decompresses can be used by the others, and survives children
+ being recycled.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef __MOD_FAIDX_SEQ_SHARED_CACHE_H__
+#define __MOD_FAIDX_SEQ_SHARED_CACHE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Blocks in each set, a block can only be held in the set its
+   key hashes to, the least recently used going to make room */
+#define SEQ_SHARED_WAYS 8
+
+/* Marks a region as set up by seq_shared_cache_init */
+#define SEQ_SHARED_MAGIC 0x6661696478626c6bULL
+
+/* Where one block is held, its data is in the region's data area */
+typedef struct seq_shared_slot {
+  uint64_t file_id;    /* File the block came from */
+  uint64_t offset;     /* Compressed offset of the block in the file */
+  uint64_t stamp;      /* Region clock when last used, for LRU */
+  uint32_t len;        /* Bytes of data, 0 if the slot is empty */
+  uint32_t pad;
+} seq_shared_slot_t;
+
+/* A set of slots and the sequence lock guarding them. The lock is
+   odd while a child is writing to the set. Readers never wait, if
+   it's odd or changes while they copy a block out they count a
+   miss, and writers that find it odd don't store their block. So
+   a child dying mid write costs that set, never a hang. */
+typedef struct seq_shared_set {
+  uint32_t seq;
+  uint32_t pad;
+  seq_shared_slot_t slots[SEQ_SHARED_WAYS];
+} seq_shared_set_t;
+
+/* The header at the start of the region, the sets and then the
+   data follow it. Offsets rather than pointers, in case the
+   region isn't mapped at the same address everywhere. */
+typedef struct seq_shared_cache {
+  uint64_t magic;
+  uint64_t nsets;
+  uint64_t sets_off;    /* Byte offset of the sets from the header */
+  uint64_t data_off;    /* Byte offset of the data, SEQ_BLOCK_MAX a slot */
+  uint64_t clock;       /* Bumped on every hit and store */
+  uint64_t hits;        /* Lookups that copied their block out */
+  uint64_t misses;      /* Lookups that didn't */
+  uint64_t stores;      /* Blocks stored */
+  uint64_t evictions;   /* Blocks overwritten to make room */
+  uint64_t busy;        /* Stores skipped as another child was writing */
+} seq_shared_cache_t;
+
+seq_shared_cache_t* seq_shared_cache_init(void* base, size_t size);
+int64_t seq_shared_cache_get(seq_shared_cache_t* cache, uint64_t file_id, uint64_t offset, char* dest, size_t max);
+int seq_shared_cache_put(seq_shared_cache_t* cache, uint64_t file_id, uint64_t offset, const char* data, size_t len);
+seq_shared_set_t* _seq_shared_cache_set(seq_shared_cache_t* cache, uint64_t file_id, uint64_t offset);
+char* _seq_shared_cache_data(seq_shared_cache_t* cache, seq_shared_set_t* set, int way);
+
+#endif
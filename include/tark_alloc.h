@@ -0,0 +1,68 @@
+/* Allocator hooks
+
+ Where librefseq gets the memory for an iterator, its locations
+ and buffers. The caller can hand in an APR pool, an arena or
+ anything else that can allocate, or nothing at all to use
+ malloc and free.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef __MOD_FAIDX_TARK_ALLOC_H__
+#define __MOD_FAIDX_TARK_ALLOC_H__
+
+#include <stddef.h>
+
+/* alloc returns size bytes, aligned for any type, or NULL. free
+   may be NULL when everything is released along with ctx in one
+   go, as with an APR pool or an arena. An allocator with a NULL
+   alloc is malloc and free. */
+typedef struct tark_allocator {
+  void* (*alloc)(void* ctx, size_t size);
+  void (*free)(void* ctx, void* ptr);
+  void* ctx;
+} tark_allocator_t;
+
+/* Size of an arena's blocks unless it's told otherwise, anything
+   bigger than a block gets a block of its own */
+#define TARK_ARENA_BLOCK 65536
+
+/* Allocations in an arena are rounded up to this */
+#define TARK_ARENA_ALIGN 16
+
+typedef struct tark_arena_block {
+  struct tark_arena_block* next;
+  size_t size;       /* Bytes in data */
+  size_t used;       /* Bytes of data handed out */
+  char* data;
+} tark_arena_block_t;
+
+/* A bump allocator, memory is handed out from the front of the
+   current block and only given back when the arena is reset or
+   destroyed */
+typedef struct tark_arena {
+  tark_arena_block_t* blocks;  /* The current block first */
+  size_t block_size;
+} tark_arena_t;
+
+void* tark_alloc(const tark_allocator_t* alloc, size_t size);
+void tark_free(const tark_allocator_t* alloc, void* ptr);
+
+tark_arena_t* tark_arena_create(size_t block_size);
+void* tark_arena_alloc(void* ctx, size_t size);
+void tark_arena_reset(tark_arena_t* arena);
+void tark_arena_destroy(tark_arena_t* arena);
+tark_allocator_t tark_arena_allocator(tark_arena_t* arena);
+
+#endif
@@ -28,17 +28,37 @@
 #define DEFAULT_FILES_CACHE_SIZE 100
 #endif
 
+#ifndef DEFAULT_SHARED_BLOCK_CACHE_SIZE
+#define DEFAULT_SHARED_BLOCK_CACHE_SIZE 67108864 /* Bytes of shared memory for
+						    decompressed BGZF blocks
+						    all the processes use, 64MB */
+#endif
+
+#ifndef DEFAULT_BLOCK_CACHE_SIZE
+#define DEFAULT_BLOCK_CACHE_SIZE 16777216 /* Bytes of decompressed BGZF blocks
+					     each process keeps, 16MB */
+#endif
+
 #define MAX_SIZE 16384
 #define MAX_FASTA_LINE_LENGTH 60
 #define CHUNK_SIZE 1048576 /* Chunk size, 1MB */
 #define MAX_SEQUENCES 25 /* Maximum number of sequences a user is allowed to request, not implemented */
 #define MAX_HEADER 120 /* Maximum size of a header chunk, including NUL */
+#define MAX_FRAMES_LENGTH 16777216 /* Longest sequence we'll translate in six frames
+				      or scan for ORFs, it's held in memory four
+				      times over */
+#define MIN_SPAN_LENGTH 1024 /* Shortest line in a file we send in place, as buckets
+				pointing in to the mapping, rather than copying */
+#define MAX_SPANS 256 /* Buckets in each brigade we pass when sending in place */
 
 #define SEQ_ENDPOINT_DIRECTIVE "sequence_base_uri"
 #define SEQFILE_CACHESIZE_DIRECTIVE "sequence_cachesize"
+#define BLOCK_CACHESIZE_DIRECTIVE "sequence_blockcache"
+#define SHARED_BLOCK_CACHESIZE_DIRECTIVE "sequence_sharedblockcache"
 #define LABELS_ENDPOINT_DIRECTIVE "sequence_enable_labels"
 #define SEQ_DIRECTIVE "seq"
 #define ALIAS_DIRECTIVE "alias"
+#define GENETIC_CODE_DIRECTIVE "geneticcode"
 
 #define BEGIN_SEQFILE "<SeqFile"
 #define END_SEQFILE "</SeqFile>"
@@ -52,10 +72,15 @@
 #define METADATA_VERB 1
 #define CHECKSUM_VERB 2
 #define INFO_VERB 3
+#define ORFS_VERB 4
+
+#define DEFAULT_ORF_MIN_LENGTH 100 /* Shortest ORF to report, in amino acids */
 
 /* Representation of a sequence in a sequence file */
 typedef struct {
   const char* name;                    /* The sequence name within the file, eg 1, chrX */
+  int seq_id;                          /* Position of the sequence in the file's index,
+					  used to fetch without looking up the name */
   apr_array_header_t* aliases;         /* Array holding all the aliases for this sequence */
 } sequence_obj;
 
@@ -19,6 +19,10 @@
 */
 
 #include "files_manager.h"
+#include "seq_kernels.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 /*
  Initialize the files manager, return a pointer to a files
@@ -52,6 +56,14 @@ files_mgr_t* init_files_mgr(apr_pool_t *parent_pool) {
 
   fm->cache_size = DEFAULT_FILES_CACHE_SIZE;
 
+  /* Shared by the readers of every bgzip file we open, each
+     process gets its own as it fills after the fork. Without
+     one the readers decompress blocks every time. */
+  fm->blocks = seq_block_cache_create(DEFAULT_BLOCK_CACHE_SIZE);
+  if(fm->blocks != NULL) {
+    apr_pool_cleanup_register(mp, fm, _files_mgr_cleanup_blocks, apr_pool_cleanup_null);
+  }
+
   return fm;
 }
 
@@ -137,6 +149,7 @@ const unsigned char* files_mgr_add_seqfile(files_mgr_t* fm, char* path, int type
   seqfile->path = (const char*)apr_pstrdup(mp, path);
   seqfile->sequences = apr_hash_make(mp); /* Make the hash to store sequence objects */
   seqfile->type = type;
+  seqfile->genetic_code = SEQ_GENETIC_CODE_STANDARD;
 
   rv = _files_mgr_init_seqfile(fm, seqfile);
   if(rv != APR_SUCCESS) {
@@ -261,6 +274,8 @@ int _files_mgr_init_seqfile(files_mgr_t* fm, seq_file_t *seqfile) {
 
   if(seqfile->type == FM_FAIDX) {
     rv = _files_mgr_init_faidx_file(fm, seqfile);
+  } else if(seqfile->type == FM_BGZF || seqfile->type == FM_ZSTD || seqfile->type == FM_2BIT) {
+    rv = _files_mgr_init_reader_file(fm, seqfile);
   } else {
     return APR_EINCOMPLETE; /* Unknown file type */
   }
@@ -293,6 +308,38 @@ int _files_mgr_init_faidx_file(files_mgr_t* fm, seq_file_t *seqfile) {
     /* Get the sequence name from faidx and put a copy in the sequence object */
     seq->name = (const char*)apr_pstrdup(mp,
 					 faidx_iseq((faidx_t*)seqfile->file_ptr, i));
+    seq->seq_id = i;
+
+    apr_hash_set(seqfile->sequences,
+		 seq->name,
+		 APR_HASH_KEY_STRING,
+		 seq);
+  }
+
+  return APR_SUCCESS;
+}
+
+/* Handler to initialize a BGZF, ZSTD or 2BIT type file, the
+   sequences come from our reader's copy of the .fai, or the
+   .2bit file's own index
+ */
+int _files_mgr_init_reader_file(files_mgr_t* fm, seq_file_t *seqfile) {
+  apr_pool_t *mp;
+  int rv, nseq, i;
+  sequence_obj *seq;
+
+  mp = fm->mp;
+
+  rv = files_mgr_open_file(fm, seqfile);
+  if(rv != APR_SUCCESS) {
+    return APR_EINCOMPLETE; /* We weren't able to open the file */
+  }
+
+  nseq = seq_reader_nseq(seqfile->reader);
+  for(i = 0; i < nseq; ++i) {
+    seq = (sequence_obj*)apr_pcalloc(mp, sizeof(sequence_obj));
+    seq->name = (const char*)apr_pstrdup(mp, seq_reader_iseq(seqfile->reader, i));
+    seq->seq_id = i;
 
     apr_hash_set(seqfile->sequences,
 		 seq->name,
@@ -303,6 +350,80 @@ int _files_mgr_init_faidx_file(files_mgr_t* fm, seq_file_t *seqfile) {
   return APR_SUCCESS;
 }
 
+/* Which type a file should be opened as. bgzip files with their
+   .fai and .gzi beside them are read without htslib, as are zstd
+   files with their .fai and .2bit files, which htslib can't read
+   at all. Anything else goes through faidx, which can build a
+   missing .fai.
+ */
+
+int files_mgr_file_type(const char* path) {
+  char* index_path;
+  size_t len;
+  int type = FM_FAIDX;
+
+  len = strlen(path);
+  if(len >= 5 && !strcmp(path + len - 5, ".2bit")) {
+    return FM_2BIT;
+  }
+
+  if(!(len >= 3 && !strcmp(path + len - 3, ".gz")) &&
+     !(len >= 4 && !strcmp(path + len - 4, ".zst"))) {
+    return FM_FAIDX;
+  }
+
+  index_path = malloc(len + 5);
+  if(index_path == NULL) {
+    return FM_FAIDX;
+  }
+
+  sprintf(index_path, "%s.fai", path);
+  if(access(index_path, R_OK) == 0) {
+    if(path[len - 1] == 't') {
+      type = FM_ZSTD;
+    } else {
+      sprintf(index_path, "%s.gzi", path);
+      if(access(index_path, R_OK) == 0) {
+	type = FM_BGZF;
+      }
+    }
+  }
+
+  free(index_path);
+
+  return type;
+}
+
+/* The faidx_t of a FAIDX type file, NULL if it's closed or
+   another type, for the callers falling back to faidx.
+ */
+
+faidx_t* files_mgr_faidx(seq_file_t *seqfile) {
+  if(seqfile->type == FM_FAIDX) {
+    return (faidx_t*)seqfile->file_ptr;
+  }
+
+  return NULL;
+}
+
+/* Length of a sequence in a seqfile, the file must be open.
+   Goes through the direct reader by id if we have one, only
+   falling back to a lookup by name in faidx if we don't.
+
+   Returns -1 if the sequence isn't found.
+ */
+
+int64_t files_mgr_seq_len(seq_file_t *seqfile, sequence_obj *seq) {
+  if(seqfile->reader != NULL) {
+    return (int64_t)seq_reader_seq_len(seqfile->reader, seq->seq_id);
+  }
+
+  if(seqfile->type == FM_FAIDX && seqfile->file_ptr != NULL) {
+    return faidx_seq_len((faidx_t*)seqfile->file_ptr, seq->name);
+  }
+
+  return -1;
+}
 
 /* Attempt to open a seqfile
  */
@@ -324,9 +445,39 @@ int files_mgr_open_file(files_mgr_t* fm, seq_file_t *seqfile) {
     /* Stash away the fai object */
     seqfile->file_ptr = (void*)fai;
 
+    /* Open a direct reader too so fetches can skip
+       faidx_fetch_seq. NULL is fine, we fall back to faidx
+       for files it can't handle (eg. plain gzip). */
+    seqfile->reader = seq_reader_open(seqfile->path);
+    if(seqfile->reader != NULL && fm->blocks != NULL) {
+      seq_reader_set_block_cache(seqfile->reader, fm->blocks);
+    }
+
     /* Put the seqfile in the cache */
     _files_mgr_insert_cache(fm, seqfile);
 
+  } else if(seqfile->type == FM_BGZF || seqfile->type == FM_ZSTD || seqfile->type == FM_2BIT) {
+    seqfile->reader = seq_reader_open(seqfile->path);
+    if(seqfile->reader == NULL) {
+      return APR_EGENERAL;
+    }
+
+    if(seqfile->reader->type != (seqfile->type == FM_BGZF ? SEQ_READER_BGZF :
+				 seqfile->type == FM_ZSTD ? SEQ_READER_ZSTD : SEQ_READER_2BIT)) {
+      seq_reader_close(seqfile->reader);
+      seqfile->reader = NULL;
+      return APR_EGENERAL; /* Not what we were told it was */
+    }
+
+    if(fm->blocks != NULL) {
+      seq_reader_set_block_cache(seqfile->reader, fm->blocks);
+    }
+
+    /* The reader is the file handle */
+    seqfile->file_ptr = (void*)seqfile->reader;
+
+    _files_mgr_insert_cache(fm, seqfile);
+
   } else {
     /* It wasn't a type we know */
     return APR_EGENERAL;
@@ -377,6 +528,63 @@ int files_mgr_resize_cache(files_mgr_t* fm, int new_cache_size) {
 
 }
 
+/* Change the byte budget of the decompressed block cache,
+   dropping the least recently used blocks if it's shrinking.
+   0 turns it off.
+
+   Returns APR_SUCCESS, or APR_EGENERAL if we have no cache.
+*/
+
+int files_mgr_resize_block_cache(files_mgr_t* fm, size_t new_budget) {
+  if(fm->blocks == NULL) {
+    return APR_EGENERAL;
+  }
+
+  seq_block_cache_resize(fm->blocks, new_budget);
+
+  return APR_SUCCESS;
+}
+
+/* Share decompressed blocks with the other processes through
+   size bytes of shared memory at base, set up here so it must be
+   called before the children are forked. The memory must outlive
+   the files manager.
+
+   Returns APR_SUCCESS, or APR_EGENERAL if we have no block cache
+   or the memory is too small to be any use.
+*/
+
+int files_mgr_share_blocks(files_mgr_t* fm, void* base, size_t size) {
+  seq_shared_cache_t* shared;
+
+  if(fm->blocks == NULL) {
+    return APR_EGENERAL;
+  }
+
+  shared = seq_shared_cache_init(base, size);
+  if(shared == NULL) {
+    return APR_EGENERAL;
+  }
+
+  seq_block_cache_share(fm->blocks, shared);
+
+  return APR_SUCCESS;
+}
+
+/* Pool cleanup for the block cache, the readers drop their
+   blocks as they're closed so they have to go first */
+
+apr_status_t _files_mgr_cleanup_blocks(void* files_mgr) {
+  files_mgr_t* fm = files_mgr;
+
+  files_mgr_close_all(fm);
+
+  seq_block_cache_destroy(fm->blocks);
+  fm->blocks = NULL;
+
+  return APR_SUCCESS;
+}
+
 /* Touch/add an item to the cache. If the seqfile is already in
    the cache it will now be at the start. If it's not and the cache
    is full, remove the oldest item and add this seqfile to the front.
@@ -448,6 +656,14 @@ int files_mgr_close_file(files_mgr_t* fm, seq_file_t *seqfile) {
     fai_destroy((faidx_t*)seqfile->file_ptr);
     seqfile->file_ptr = NULL;
 
+    seq_reader_close(seqfile->reader);
+    seqfile->reader = NULL;
+
+  } else if(seqfile->type == FM_BGZF || seqfile->type == FM_ZSTD || seqfile->type == FM_2BIT) {
+    seq_reader_close(seqfile->reader);
+    seqfile->reader = NULL;
+    seqfile->file_ptr = NULL;
+
   } else {
 
     /* We weren't able to close anything */
@@ -0,0 +1,141 @@
+/* Genetic code table generator
+
+ Reads the NCBI genetic codes in genetic_codes.txt and writes
+ seq_genetic_codes.h, a 128 byte codon table for each code laid
+ out for SEQ_CODON_INDEX, so translating with any of them is the
+ same single lookup as with the standard code. Run at build time,
+ see src/Makefile.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CODE 255
+#define LINE_LEN 1024
+
+/* Position of each of our base codes, A 0, C 1, G 2 and T 3,
+   in NCBI's T, C, A, G order */
+static const int ncbi_order[4] = { 2, 1, 3, 0 };
+
+typedef struct {
+  char* name;
+  char aa[65];
+} genetic_code_t;
+
+int main(int argc, const char* argv[]) {
+  genetic_code_t* codes[MAX_CODE + 1] = { NULL };
+  char line[LINE_LEN];
+  char* id_str;
+  char* name;
+  char* aa;
+  char* end;
+  FILE* in;
+  long id;
+  int max_id = 0;
+  int line_no = 0;
+  int i, j;
+
+  if(argc != 2) {
+    fprintf(stderr, "Usage: %s genetic_codes.txt > seq_genetic_codes.h\n", argv[0]);
+    return 1;
+  }
+
+  in = fopen(argv[1], "r");
+  if(in == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  while(fgets(line, LINE_LEN, in) != NULL) {
+    line_no++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if(line[0] == '#' || line[0] == '\0') {
+      continue;
+    }
+
+    id_str = strtok(line, "\t");
+    name = strtok(NULL, "\t");
+    aa = strtok(NULL, "\t");
+
+    if(id_str == NULL || name == NULL || aa == NULL) {
+      fprintf(stderr, "%s:%d: expected id, name and amino acids\n", argv[1], line_no);
+      return 1;
+    }
+
+    id = strtol(id_str, &end, 10);
+    if(*end != '\0' || id < 1 || id > MAX_CODE || codes[id] != NULL) {
+      fprintf(stderr, "%s:%d: bad or repeated id %s\n", argv[1], line_no, id_str);
+      return 1;
+    }
+
+    if(strlen(aa) != 64 || strspn(aa, "ABCDEFGHIJKLMNOPQRSTUVWXYZ*") != 64) {
+      fprintf(stderr, "%s:%d: expected 64 amino acids\n", argv[1], line_no);
+      return 1;
+    }
+
+    codes[id] = malloc(sizeof(genetic_code_t));
+    codes[id]->name = strdup(name);
+    strcpy(codes[id]->aa, aa);
+
+    if(id > max_id) {
+      max_id = id;
+    }
+  }
+
+  fclose(in);
+
+  if(codes[1] == NULL) {
+    fprintf(stderr, "%s: the standard code, 1, is missing\n", argv[1]);
+    return 1;
+  }
+
+  printf("/* Generated from genetic_codes.txt by gen_genetic_codes, don't edit */\n\n");
+  printf("#define SEQ_GENETIC_CODE_MAX %d\n\n", max_id);
+
+  /* Ids without a code are left empty, the first byte is NUL */
+  printf("static const char seq_genetic_code_tables[SEQ_GENETIC_CODE_MAX + 1][128] = {\n");
+  for(id = 0; id <= max_id; id++) {
+    if(codes[id] == NULL) {
+      printf("  /* %ld */ \"\",\n", id);
+      continue;
+    }
+
+    printf("  /* %ld %s */\n  \"", id, codes[id]->name);
+    for(i = 0; i < 64; i++) {
+      printf("%c", codes[id]->aa[ncbi_order[i >> 4] * 16 + ncbi_order[(i >> 2) & 3] * 4 + ncbi_order[i & 3]]);
+    }
+    printf("\"\n  \"");
+    for(j = 0; j < 64; j++) {
+      printf("X");
+    }
+    printf("\",\n");
+  }
+  printf("};\n\n");
+
+  printf("static const char* const seq_genetic_code_names[SEQ_GENETIC_CODE_MAX + 1] = {\n");
+  for(id = 0; id <= max_id; id++) {
+    if(codes[id] == NULL) {
+      printf("  NULL,\n");
+    } else {
+      printf("  \"%s\",\n", codes[id]->name);
+    }
+  }
+  printf("};\n");
+
+  return 0;
+}
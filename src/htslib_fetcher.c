@@ -23,86 +23,17 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 #include "htslib_fetcher.h"
 #include <stdio.h>
 
-const char* codons[5][5] = {
- //   AA        AC        AG        AT        AX
- //   00        01        02        03        04
-  { (char []){"KNKNX"}, (char []){"TTTTX"}, (char []){"RSRSX"}, (char []){"IIMIX"}, (char []){"XXXXX"} },
- //   CA         CC         CG         CT         CX
- //   10         11         12         13         14
-  { (char []){"QHQHX"}, (char []){"PPPPX"}, (char []){"RRRRX"}, (char []){"LLLLX"}, (char []){"XXXXX"} },
- //  GA          GC         GG         GT         GX
- //  20          21         22         23         24
-  { (char []){"EDEDX"}, (char []){"AAAAX"}, (char []){"GGGGX"}, (char []){"VVVVX"}, (char []){"XXXXX"} },
- //  TA          TC         TG         TT         TX
- //  30          31         32         33         34
-  { (char []){"*Y*YX"}, (char []){"SSSSX"}, (char []){"*CWCX"}, (char []){"LFLFX"}, (char []){"XXXXX"} },
- //   XA         XC         XG         XT         XX
- //   40         41         42         43         44
-  { (char []){"XXXXX"}, (char []){"XXXXX"}, (char []){"XXXXX"}, (char []){"XXXXX"}, (char []){"XXXXX"} }
-};
-
-const char* revcom = "TGCAN";
-
-/* table to convert character of base to translation array element value */
-static int trnconv[] =
-{
-    /* characters less than 64 */
-     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /*' '  !   "   #   $   %   &   '   (   )   *   +   ,   -   .   / */
-     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* 0   1   2   3   4   5   6   7   8   9   :   ;   <   =   >   ? */
-     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* @   A   B   C   D   E   F   G   H   I   J   K   L   M   N   O */
-     4,  0,  4,  1,  4,  4,  4,  2,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* P   Q   R   S   T   U   V   W   X   Y   Z   [   \   ]   ^   _ */
-     4,  4,  4,  4,  3,  3,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* `   a   b   c   d   e   f   g   h   i   j   k   l   m   n   o */
-     4,  0,  4,  1,  4,  4,  4,  2,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* p   q   r   s   t   u   v   w   x   y   z   {   |   }   ~   del */
-     4,  4,  4,  4,  3,  3,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4
-};
-
-
-/*
- ** table to convert character of COMPLEMENT of base to translation array
- ** element value
- */
-
-static int trncomp[] =
-{
-    /* characters less than 64 */
-     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /*' '  !   "   #   $   %   &   '   (   )   *   +   ,   -   .   / */
-     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* 0   1   2   3   4   5   6   7   8   9   :   ;   <   =   >   ? */
-     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* @   A   B   C   D   E   F   G   H   I   J   K   L   M   N   O*/
-     4,  3,  4,  2,  4,  4,  4,  1,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* P   Q   R   S   T   U   V   W   X   Y   Z   [   \   ]   ^   _ */
-     4,  4,  4,  4,  0,  0,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* `   a   b   c   d   e   f   g   h   i   j   k   l   m   n   o */
-     4,  3,  4,  2,  4,  4,  4,  1,  4,  4,  4,  4,  4,  4,  4,  4,
-
-  /* p   q   r   s   t   u   v   w   x   y   z   {   |   }   ~   del */
-     4,  4,  4,  4,  0,  0,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4
-};
-
+/* The fetch bodies are written once and inlined in to a variant for
+   each combination of their constant arguments */
+#if defined(__GNUC__)
+#define TARK_INLINE inline __attribute__((always_inline))
+#else
+#define TARK_INLINE inline
+#endif
 
 char* tark_fetch_seq(faidx_t* fai, const char *str, int *seq_len) {
   char** seqs;
@@ -157,392 +88,858 @@ char* tark_translate_seq(faidx_t* fai, const char *str, int *seq_len) {
     
 }
 
-char* tark_iterator_fetch_translated_seq(seq_iterator_t* siterator, int *seq_len, char* seq_ptr) {
-  int r;
-  int i;
-  int k = 0;
-  int fetch_len = *seq_len;
-  int bytes_to_cr = -1;
-  //  int iterated_length;
-  //  int translated_length;
+/* We need to determine how many bytes to print before we add our first
+   carriage return. Then how many bytes to retrieve in total, taking in
+   to account all the CR that will be mixed in.
+
+   Given the iterator and remaining window available, return the bp
+   to retrieve, and set bytes_to_cr to the bytes to write before we
+   should print our first CR, 0 if the window starts with one. The
+   CR at the end of a line goes out before the next base, unless the
+   last window had exactly room left for it and sent it already.
+
+   This is unix type OS specific! It will not work in DOS/Windows based
+   operating systems (LF vs CR + LF)
+*/
+
+int tark_iterator_adjusted_seq_len(seq_iterator_t* siterator, int window, int64_t bp_remaining, uint64_t bp_iterated, int* bytes_to_cr) {
+  int line_length = siterator->line_length;
+  int bp_possible;
+  int possible_lines;
+  int leftover;
+  int bp;
+
+  /* How many bytes could be possibly send? */
+  bp_possible = bp_remaining < window ? (int)bp_remaining : window;
+
+  /* Don't be silly, why are you asking for the bytes to retrieve
+     when there's no line length set? */
+  if(line_length == 0) {
+    *bytes_to_cr = -1;
+    return bp_possible;
+  }
+
+  /* How many bytes before the first CR needs to be sent */
+  *bytes_to_cr = line_length - (bp_iterated % line_length);
+  if(*bytes_to_cr == line_length && bp_iterated > 0 && !siterator->cr_written) {
+    *bytes_to_cr = 0;
+  }
+
+  /* If we have less bytes to send than until the next end of line,
+     tell the caller to just fetch that many */
+  if(window <= *bytes_to_cr) {
+    return bp_possible;
+  }
+
+  /* After the first CR every line costs us line_length + 1 bytes,
+     and a partial line at the end its CR plus the bases */
+  window -= *bytes_to_cr;
+  possible_lines = window / (line_length + 1);
+  leftover = window % (line_length + 1);
+
+  bp = *bytes_to_cr + (possible_lines * line_length) + (leftover > 0 ? leftover - 1 : 0);
+
+  return bp_possible < bp ? bp_possible : bp;
+}
+
+/* The one place bases are written to output. Copy len bases from
+   src in to dest, applying the SEQ_XFORM_* transform (on the reverse
+   strand src is read from its last base back to its first), and if
+   line_len isn't 0 put a CR every line_len bases.
+
+   bytes_to_cr is how many bases until the next CR and is kept up to
+   date so runs can be chained. A CR due exactly at the end of the
+   bases is left for the next call, so we never end on a CR.
+
+   Returns the number of CR added.
+*/
+
+static TARK_INLINE int _tark_copy_transform_body(void* dest, const char* src, int len, int transform, int line_len, int *bytes_to_cr) {
+  char* d = dest;
+  int cr = 0;
+  int n;
+
+  while(len > 0) {
+    if(line_len == 0) {
+      n = len;
+    } else {
+      if(*bytes_to_cr == 0) {
+	*d++ = '\n';
+	cr++;
+	*bytes_to_cr = line_len;
+      }
+      n = *bytes_to_cr < len ? *bytes_to_cr : len;
+      *bytes_to_cr -= n;
+    }
+
+    if(transform == 0) {
+      memcpy(d, src, n);
+      src += n;
+    } else if(transform & SEQ_XFORM_REVCOMP) {
+      seq_transform(d, src + len - n, n, transform);
+    } else {
+      seq_transform(d, src, n, transform);
+      src += n;
+    }
+
+    d += n;
+    len -= n;
+  }
+
+  return cr;
+}
+
+int tark_copy_transform(void* dest, const char* src, int len, int transform, int line_len, int *bytes_to_cr) {
+  return _tark_copy_transform_body(dest, src, len, transform, line_len, bytes_to_cr);
+}
+
+/* faidx only takes 64 bit positions from htslib 1.10, and has a 64
+   bit length from 1.15. Before that a sequence or range past INT_MAX
+   can only be read through a seq_reader. */
+
+#if defined(HTS_VERSION) && HTS_VERSION >= 101500
+#define TARK_FAIDX_SEQ_LEN faidx_seq_len64
+#else
+#define TARK_FAIDX_SEQ_LEN faidx_seq_len
+#endif
+
+static char* _tark_faidx_fetch(faidx_t* fai, const char* seq_name, uint64_t beg, uint64_t end, int* len) {
+#if defined(HTS_VERSION) && HTS_VERSION >= 101000
+  hts_pos_t fetched;
   char* seq;
-  char* translated_seq;
 
-  //  translated_length = tark_iterator_translated_length(siterator, &r, NULL);
-  //  iterated_length = translated_length - r;
+  seq = faidx_fetch_seq64(fai, seq_name, beg, end, &fetched);
+  *len = (int)fetched;
+  return seq;
+#else
+  if(end > INT_MAX) {
+    *len = 0;
+    return NULL;
+  }
+
+  return faidx_fetch_seq(fai, seq_name, (int)beg, (int)end, len);
+#endif
+}
 
-  if(r <= 0) {
+/* Copy the bases seg_start-seg_end of the iterator's sequence in to
+   dest, in one pass from the source with tark_copy_transform doing
+   any reverse complementing, case folding and line breaks on the way.
+   With a reader the bases come straight out of the mapped file, a
+   line at a time, or for a bgzip file decompressed in to the reader's
+   scratch buffer. On the reverse strand the file is read backwards.
+   Otherwise we fall back to faidx_fetch_seq.
+
+   Returns the number of CR added if we're doing line lengths.
+*/
+
+static TARK_INLINE int _tark_copy_segment_body(seq_iterator_t* siterator, char* dest, uint64_t seg_start, uint64_t seg_end, int transform, int* bytes_to_cr, const int reverse, const int wrap) {
+  const char* src;
+  char* seg_seq;
+  uint64_t run_len;
+  int64_t pos;
+  int len;
+  int cr = 0;
+  int line_len = wrap ? siterator->line_length : 0;
+
+  if(siterator->reader == NULL) {
+    seg_seq = _tark_faidx_fetch(siterator->fai, siterator->seq_name, seg_start, seg_end, &len);
+    if(seg_seq == NULL) {
+      return 0;
+    }
+
+    cr = _tark_copy_transform_body(dest, seg_seq, len, transform, line_len, bytes_to_cr);
+    free(seg_seq);
+    return cr;
+  }
+
+  if(reverse) {
+    for(pos = seg_end; pos >= (int64_t)seg_start; pos -= run_len) {
+      src = seq_reader_run_back(siterator->reader, siterator->seq_id, pos, pos - seg_start + 1, &run_len);
+      if(src == NULL) {
+	break;
+      }
+
+      cr += _tark_copy_transform_body(dest + (seg_end - pos) + cr, src, run_len, transform, line_len, bytes_to_cr);
+    }
+
+  } else {
+    for(pos = seg_start; pos <= (int64_t)seg_end; pos += run_len) {
+      src = seq_reader_run(siterator->reader, siterator->seq_id, pos, seg_end - pos + 1, &run_len);
+      if(src == NULL) {
+	break;
+      }
+
+      cr += _tark_copy_transform_body(dest + (pos - seg_start) + cr, src, run_len, transform, line_len, bytes_to_cr);
+    }
+  }
+
+  return cr;
+}
+
+/* Read ahead the extent a segment is in when we first reach it */
+
+static TARK_INLINE void _tark_iterator_read_ahead(seq_iterator_t* siterator, seq_location_t* segment) {
+  if(segment->extent != siterator->extent_ptr) {
+    siterator->extent_ptr = segment->extent;
+    if(segment->extent != TARK_NO_EXTENT) {
+      seq_reader_prefetch(siterator->reader, siterator->seq_id,
+			  siterator->extents[segment->extent].start,
+			  siterator->extents[segment->extent].end - siterator->extents[segment->extent].start + 1);
+    }
+  }
+}
+
+/* Copy the next fetch_len bases of the iterator in to dest, walking
+   the segments from where we left off, forwards or on the reverse
+   strand backwards from the end, and move the iterator along. The
+   caller makes sure fetch_len is no more than what's left. The
+   transform, and the line breaks if we're wrapping, are applied on
+   the way through, reverse and wrap are always constants.
+
+   Returns the number of CR added.
+*/
+
+static TARK_INLINE int _tark_iterator_copy_body(seq_iterator_t* siterator, char* dest, int fetch_len, int transform, int* bytes_to_cr, const int reverse, const int wrap) {
+  int bp_retrieved = 0;
+  int cr = 0;
+  int len, bp_remaining;
+  uint64_t seg_start, seg_end;
+  seq_location_t *segment = NULL;
+
+  /* On the reverse strand we walk the segments backwards from the
+     end of the iterator, the first time through put ourselves there */
+  if(reverse) {
+    transform |= SEQ_XFORM_REVCOMP;
+
+    if(siterator->seq_iterated == 0) {
+      siterator->segment_ptr = siterator->nlocations - 1;
+      siterator->segment_bp_ptr = siterator->locations[siterator->segment_ptr].length;
+    }
+  }
+
+  /* Loop through fetching segments until we reach our limit */
+  while(bp_retrieved < fetch_len) {
+    bp_remaining = fetch_len - bp_retrieved;
+
+    if(reverse) {
+      /* Going backwards segment_bp_ptr is how much of the segment
+	 is left to send, step back a segment when it's used up */
+      if(siterator->segment_bp_ptr == 0) {
+	siterator->segment_ptr--;
+	siterator->segment_bp_ptr = siterator->locations[siterator->segment_ptr].length;
+      }
+      segment = &(siterator->locations[siterator->segment_ptr]);
+
+      len = siterator->segment_bp_ptr < (uint64_t)bp_remaining ? (int)siterator->segment_bp_ptr : bp_remaining;
+      seg_end = segment->start + siterator->segment_bp_ptr - 1;
+      seg_start = seg_end - len + 1;
+      siterator->segment_bp_ptr -= len;
+
+    } else {
+      segment = &(siterator->locations[siterator->segment_ptr]);
+
+      seg_start = segment->start + siterator->segment_bp_ptr;
+
+      if(segment->length - siterator->segment_bp_ptr > (uint64_t)bp_remaining) {
+	// We only want part of this segment
+	len = bp_remaining;
+	siterator->segment_bp_ptr += bp_remaining;
+      } else {
+	// We want all of the segment, plus move to next segment
+	len = (int)(segment->length - siterator->segment_bp_ptr);
+	siterator->segment_bp_ptr = 0;
+	siterator->segment_ptr++;
+      }
+      seg_end = seg_start + len - 1;
+    }
+
+    _tark_iterator_read_ahead(siterator, segment);
+
+    cr += _tark_copy_segment_body(siterator, dest+bp_retrieved+cr, seg_start, seg_end, transform, bytes_to_cr, reverse, wrap);
+    bp_retrieved += len;
+  }
+
+  siterator->seq_iterated += bp_retrieved;
+
+  return cr;
+}
+
+/* The body of the fetch, specialised below for each strand and
+   line wrapping combination, reverse and wrap are always constants */
+
+static TARK_INLINE char* _tark_fetch_seq_body(seq_iterator_t* siterator, int *seq_len, char* seq_ptr, const int reverse, const int wrap) {
+  char* s = NULL;
+  int cr = 0;
+  int fetch_len;
+  int bytes_to_cr = -1;
+  int64_t bp_remaining = siterator->seq_length - siterator->seq_iterated;
+
+  if(bp_remaining <= 0) {
     *seq_len = 0;
     return NULL;
   }
 
-  /* Do we have a line length? */
-  if(siterator->line_length) {
-    fetch_len = tark_iterator_adjusted_seq_len(*seq_len, r, siterator->seq_iterated, siterator->line_length, &bytes_to_cr);
+  /* We allow the user to send us a pointer to a string they want
+     us to fill in, rather than allocating our own */
+  if(seq_ptr == NULL) {
+    s = malloc(*seq_len + 1);
+    if(s == NULL) { // If we aren't able to allocate the memory, bail.
+      *seq_len = 0;
+      return NULL;
+    }
+  } else {
+    s = seq_ptr;
+  }
+
+  s[*seq_len] = 0;
+
+  if(wrap) {
+    fetch_len = tark_iterator_adjusted_seq_len(siterator, *seq_len, bp_remaining, siterator->seq_iterated, &bytes_to_cr);
   } else {
-    fetch_len = r < *seq_len ? r : *seq_len;
+    fetch_len = *seq_len > bp_remaining ? (int)bp_remaining : *seq_len;
+  }
+
+  cr = _tark_iterator_copy_body(siterator, s, fetch_len, siterator->transform, &bytes_to_cr, reverse, wrap);
+
+  if(fetch_len > 0) {
+    siterator->cr_written = 0;
   }
 
-  /* Is remaining translated sequence less than what we're told
-     our full window would use with CR added? If yes, then only
-     fetch the remaining abount of sequence, the CR calculations
-     should still work out fine. */
-  //  if(r < fetch_len) {
-  //    fetch_len = r;
-  //  }
+  /* If the window has exactly room left for the CR at the end of
+     the line, send it now rather than at the start of the next */
+  if(wrap && bytes_to_cr == 0 &&
+     (fetch_len+cr) < *seq_len &&
+     siterator->seq_iterated < siterator->seq_length) {
+    s[fetch_len+cr] = '\n';
+    cr++;
+    siterator->cr_written = 1;
+  }
+
+  *seq_len = fetch_len+cr;
+  s[*seq_len] = 0;
+
+  return s;
+
+}
+
+/* The body of the translated fetch, the reverse and wrap arguments
+   are constants in each of the variants generated below, so the
+   compiler drops the branches on them.
+
+   The bases are gathered in to the iterator's scratch buffer, up to
+   TARK_TRANSLATE_SCRATCH at a time, and translated from there in to
+   the window. We only ever take whole codons, so the reading frame
+   carries on from one window to the next, and a codon split between
+   two segments is put back together in scratch. A partial codon at
+   the very end is padded with N and comes out as an X. */
 
-  // Reuse r
-  r = fetch_len * 3;
-  seq = _tark_iterator_fetch_seq(siterator, &r, NULL, 0);
+static TARK_INLINE char* _tark_fetch_translated_body(seq_iterator_t* siterator, int *seq_len, char* seq_ptr, const int reverse, const int wrap) {
+  char* s;
+  char* scratch;
+  const char* code = siterator->code ? siterator->code : seq_codon_table;
+  int64_t r, bp_remaining;
+  int i, n, codons, bases;
+  int k = 0;
+  int fetch_len;
+  int bytes_to_cr = -1;
+  int unused_cr = -1;
+
+  tark_iterator_translated_length(siterator, &r, NULL);
+
+  if(r <= 0) {
+    *seq_len = 0;
+    return NULL;
+  }
+
+  /* One scratch buffer for the life of the iterator */
+  if(siterator->scratch == NULL) {
+    siterator->scratch = tark_alloc(&siterator->alloc, TARK_TRANSLATE_SCRATCH);
+    if(siterator->scratch == NULL) {
+      *seq_len = 0;
+      return NULL;
+    }
+  }
+  scratch = siterator->scratch;
 
   if(seq_ptr == NULL) {
-    translated_seq = malloc((*seq_len) + 1);
+    s = malloc(*seq_len + 1);
+    if(s == NULL) {
+      *seq_len = 0;
+      return NULL;
+    }
   } else {
-    translated_seq = seq_ptr;
+    s = seq_ptr;
   }
-  translated_seq[(*seq_len)] = '\0';
 
-  for(i = 2; i < r; i+=3) { // Work our way through the current row
-    //    printf("i: %d\n", i);
-    if(bytes_to_cr == 0) {
-      translated_seq[k] = '\n';
-      k++;
-      bytes_to_cr = siterator->line_length;
+  s[*seq_len] = 0;
+
+  /* Do we have a line length? Count it in amino acids */
+  if(wrap) {
+    fetch_len = tark_iterator_adjusted_seq_len(siterator, *seq_len, r, siterator->seq_iterated / 3, &bytes_to_cr);
+  } else {
+    fetch_len = r < *seq_len ? (int)r : *seq_len;
+  }
+
+  while(fetch_len > 0) {
+    codons = fetch_len < TARK_TRANSLATE_SCRATCH / 3 ? fetch_len : TARK_TRANSLATE_SCRATCH / 3;
+
+    bp_remaining = siterator->seq_length - siterator->seq_iterated;
+    bases = codons * 3 < bp_remaining ? codons * 3 : (int)bp_remaining;
+    _tark_iterator_copy_body(siterator, scratch, bases, siterator->transform & SEQ_XFORM_HARDMASK, &unused_cr, reverse, 0);
+    for(; bases < codons * 3; bases++) {
+      scratch[bases] = 'N';
     }
-    translated_seq[k] = codons[trnconv[(int)seq[i-2]]]
-                              [trnconv[(int)seq[i-1]]]
-                              [trnconv[(int)seq[i]]];
-    //    printf("codon: %c%c%c, p: %c\n", seq[i-2], seq[i-1], seq[i], translated_seq[k]);
-    k++;
-    bytes_to_cr--;
+
+    /* Translate up to each end of line in one go */
+    for(i = 0; i < codons; i += n) {
+      if(wrap && bytes_to_cr == 0) {
+	s[k] = '\n';
+	k++;
+	bytes_to_cr = siterator->line_length;
+      }
+
+      n = codons - i;
+      if(wrap && bytes_to_cr < n) {
+	n = bytes_to_cr;
+      }
+
+      seq_translate_code(s + k, scratch + i*3, n*3, code);
+      k += n;
+      bytes_to_cr -= n;
+    }
+
+    fetch_len -= codons;
   }
 
-  if(r == i) { // we have 1 leftover bp
-    //    puts("2 left");
-    translated_seq[k] = codons[trnconv[(int)seq[i-2]]]
-                              [trnconv[(int)seq[i-1]]]
-                              [4];
-    //    printf("codon: %c%c%c, p: %c\n", seq[i-2], seq[i-1], 'N', translated_seq[k]);
-    k++;
+  if(k > 0) {
+    siterator->cr_written = 0;
+  }
 
-  } else if(++r == i) { // we have 2 leftover bp
-    //    puts("1 left");
-    translated_seq[k] = codons[trnconv[(int)seq[i-2]]]
-                              [4]
-                              [4];
-    //    printf("codon: %c%c%c, p: %c\n", seq[i-2], 'N', 'N', translated_seq[k]);
+  /* As with bases, send the CR at the end of the line now if the
+     window has exactly room left for it. Otherwise a window of one
+     byte at the end of a line would never move us along. */
+  if(wrap && bytes_to_cr == 0 &&
+     k < *seq_len &&
+     siterator->seq_iterated < siterator->seq_length) {
+    s[k] = '\n';
     k++;
+    siterator->cr_written = 1;
   }
 
-  translated_seq[k] = '\0';
+  s[k] = '\0';
   *seq_len = k;
-  free(seq);
 
-  return translated_seq;
+  return s;
 
 }
 
-/* We need to determine how many bytes to print before we add our first
-   carriage return. Then how many bytes to retrieve in total, taking in
-   to account all the CR that will be mixed in.
+/* One fetch function per strand and line wrapping combination, and
+   the same again translated, each with the branches on those folded
+   away and the inner copy loops inlined. tark_iterator_specialize
+   picks one when the iterator is set up, rather than us testing the
+   strand and line length over again for every window. */
 
-   Given the iterator and remaining window available, reset the window
-   parameter to the bytes to retrieve from the faidx and return the
-   bytes to write before we should print our first CR.
+#define TARK_FETCH_VARIANT(name, body, reverse, wrap)			\
+  static char* name(seq_iterator_t* siterator, int *seq_len, char* seq_ptr) { \
+    return body(siterator, seq_len, seq_ptr, reverse, wrap);		\
+  }
 
-   This is unix type OS specific! It will not work in DOS/Windows based
-   operating systems (LF vs CR + LF)
+TARK_FETCH_VARIANT(_tark_fetch_seq_fwd, _tark_fetch_seq_body, 0, 0)
+TARK_FETCH_VARIANT(_tark_fetch_seq_fwd_wrap, _tark_fetch_seq_body, 0, 1)
+TARK_FETCH_VARIANT(_tark_fetch_seq_rev, _tark_fetch_seq_body, 1, 0)
+TARK_FETCH_VARIANT(_tark_fetch_seq_rev_wrap, _tark_fetch_seq_body, 1, 1)
+TARK_FETCH_VARIANT(_tark_fetch_translated_fwd, _tark_fetch_translated_body, 0, 0)
+TARK_FETCH_VARIANT(_tark_fetch_translated_fwd_wrap, _tark_fetch_translated_body, 0, 1)
+TARK_FETCH_VARIANT(_tark_fetch_translated_rev, _tark_fetch_translated_body, 1, 0)
+TARK_FETCH_VARIANT(_tark_fetch_translated_rev_wrap, _tark_fetch_translated_body, 1, 1)
+
+/* Indexed [translate][reverse][wrap] */
+static const tark_fetcher_t tark_fetchers[2][2][2] = {
+  { { _tark_fetch_seq_fwd, _tark_fetch_seq_fwd_wrap },
+    { _tark_fetch_seq_rev, _tark_fetch_seq_rev_wrap } },
+  { { _tark_fetch_translated_fwd, _tark_fetch_translated_fwd_wrap },
+    { _tark_fetch_translated_rev, _tark_fetch_translated_rev_wrap } }
+};
+
+static tark_fetcher_t _tark_fetcher(seq_iterator_t* siterator, int translate) {
+  return tark_fetchers[translate ? 1 : 0]
+                      [siterator->strand == -1 ? 1 : 0]
+                      [siterator->line_length ? 1 : 0];
+}
+
+/* Pick the fetch function for how the iterator is set up, call this
+   again if strand or translate are changed. Setting the line length
+   clears the choice so it's made again on the next fetch. */
+
+void tark_iterator_specialize(seq_iterator_t* siterator) {
+  if(siterator == NULL) {
+    return;
+  }
+
+  siterator->fetcher = _tark_fetcher(siterator, siterator->translate);
+}
+
+/* Fetch the next window from the iterator, translated or not
+   depending on how the iterator is set up. */
+
+char* tark_iterator_fetch(seq_iterator_t* siterator, int *seq_len, char* seq_ptr) {
+  if(siterator->fetcher == NULL) {
+    tark_iterator_specialize(siterator);
+  }
+
+  return siterator->fetcher(siterator, seq_len, seq_ptr);
+}
+
+char* tark_iterator_fetch_translated_seq(seq_iterator_t* siterator, int *seq_len, char* seq_ptr) {
+  return _tark_fetcher(siterator, 1)(siterator, seq_len, seq_ptr);
+}
+
+char* tark_iterator_fetch_seq(seq_iterator_t* siterator, int *seq_len, char* seq_ptr) {
+  return _tark_fetcher(siterator, 0)(siterator, seq_len, seq_ptr);
+}
+
+/* Can the iterator hand out its bases as spans of the mapped file
+   rather than copying them? Only if they go out exactly as they are
+   in the file: forwards, not translated, no case folding or masking
+   and no line breaks of our own. A span never crosses the end of a
+   line in the file, min_run is the shortest line worth sending that
+   way rather than copying, 0 for any.
+
+   Returns 1 if tark_iterator_fetch_spans can be used.
 */
 
-int tark_iterator_adjusted_seq_len(int window, int bp_remaining, int bp_iterated, int line_length, int* bytes_to_cr) {
-  int bp_possible;
-  int window_remaining;
-  int cr_count;
-  int possible_lines;
-  int bp_in_lines;
-  int bp_with_crs;
-  static int start_window_with_cr = 0;
+int tark_iterator_spannable(seq_iterator_t* siterator, uint64_t min_run) {
+  seq_reader_t* reader = siterator->reader;
 
-  /* How many bytes could be possibly send? */
-  bp_possible = bp_remaining < window ? bp_remaining : window;
+  if(reader == NULL || reader->type != SEQ_READER_MMAP ||
+     siterator->seq_id < 0 || siterator->seq_id >= reader->nseqs) {
+    return 0;
+  }
 
-  /* Don't be silly, why are you asking for the bytes to retrieve
-     when there's no line length set? */
-  if(line_length == 0) {
-    *bytes_to_cr = -1;
-    return bp_possible;
+  if(siterator->strand == -1 || siterator->translate || siterator->frames ||
+     siterator->transform != 0 || siterator->line_length != 0) {
+    return 0;
   }
 
-  /* How many bytes before the first CR needs to be sent */
-  if(start_window_with_cr) {
-    start_window_with_cr = 0;
-    *bytes_to_cr = 0;
-  } else {
-    *bytes_to_cr = line_length - (bp_iterated % line_length);
+  return reader->seqs[siterator->seq_id].line_bases >= min_run;
+}
+
+/* Hand out the next bases of a spannable iterator as up to max_spans
+   spans of the mapped file, totalling no more than max_bp bases, and
+   move the iterator along. Nothing is copied, the spans stay valid
+   until the file is closed. Runs that follow on in the file, from
+   segments that abut, come back as one span.
+
+   Returns the number of spans, 0 when the iterator is finished or
+   -1 if it can't be spanned or the file couldn't be read.
+*/
+
+int tark_iterator_fetch_spans(seq_iterator_t* siterator, tark_span_t* spans, int max_spans, uint64_t max_bp) {
+  seq_location_t* segment;
+  const char* src;
+  uint64_t run_len, want;
+  uint64_t bp = 0;
+  int n = 0;
+
+  if(!tark_iterator_spannable(siterator, 0)) {
+    return -1;
   }
 
-  /* If we have less bytes to send than until the next end of line,
-     tell the caller to just fetch that many */
-  if(*bytes_to_cr > bp_possible) {
-    return bp_possible;
+  while(siterator->seq_iterated < siterator->seq_length && bp < max_bp) {
+    segment = &(siterator->locations[siterator->segment_ptr]);
+    _tark_iterator_read_ahead(siterator, segment);
+
+    want = segment->length - siterator->segment_bp_ptr;
+    if(want > max_bp - bp) {
+      want = max_bp - bp;
+    }
+
+    src = seq_reader_run(siterator->reader, siterator->seq_id,
+			 segment->start + siterator->segment_bp_ptr, want, &run_len);
+    if(src == NULL) {
+      return -1;
+    }
+
+    if(n > 0 && spans[n-1].base + spans[n-1].len == src) {
+      spans[n-1].len += run_len;
+    } else if(n < max_spans) {
+      spans[n].base = src;
+      spans[n].len = run_len;
+      n++;
+    } else {
+      break;
+    }
+
+    bp += run_len;
+    siterator->seq_iterated += run_len;
+    siterator->segment_bp_ptr += run_len;
+    if(siterator->segment_bp_ptr == segment->length) {
+      siterator->segment_bp_ptr = 0;
+      siterator->segment_ptr++;
+    }
   }
 
-  cr_count = 1;
+  return n;
+}
 
-  /* We know we have at least to the next end of line worth of
-     bytes to send */
-  window_remaining = window - (*bytes_to_cr + 1);
+/* Fetch the bases beg-end (0 based, inclusive, the same as
+   faidx_fetch_seq) of a sequence straight in to a buffer the
+   caller passes in. Nothing is allocated, the caller must make
+   sure dest has room for end - beg + 1 bases, it's not NUL
+   terminated.
 
-  /* How many lines could we send after the first cr? */
-  possible_lines = window_remaining / (line_length + 1);
+   Returns the number of bases fetched, or -1 if the range is
+   outside the sequence or the file couldn't be read.
+*/
+
+int64_t tark_fetch_seq_into(seq_reader_t* reader, int seq_id, uint64_t beg, uint64_t end, char* dest) {
+  if(reader == NULL || end < beg) {
+    return -1;
+  }
 
-  /* How many bp does this represent? */
-  bp_in_lines = possible_lines * line_length;
+  return seq_reader_fetch(reader, seq_id, beg, end - beg + 1, dest);
+}
 
-  cr_count += possible_lines;
+/* We're going to be a little unsafe with our memory copying here because the code that
+   calls us should be sane in how it passes parameters. We're not going to recheck thing
+   that the caller shouldn't have gotten wrong. */
 
-  /* The last training bit after the last end of line */
-  window_remaining -= (bp_in_lines + possible_lines);
+int memcpy_with_cr(void* dest, void* src, int len, int line_len, int *bytes_to_cr) {
+  return tark_copy_transform(dest, src, len, 0, line_len, bytes_to_cr);
+}
 
-  /* If the window remaining had an exact number of lines, we're
-     at the end of a line and don't add that remaining CR*/
-  if(window_remaining == line_length) {
-    cr_count--;
-        start_window_with_cr = 1;
+void tark_iterator_set_line_length(seq_iterator_t* siterator, unsigned int length) {
+  if(siterator == NULL) {
+    return;
   }
 
-  /* In a theoretical full window, how many total bp would we
-     want to send? */
-  bp_with_crs = *bytes_to_cr + bp_in_lines + window_remaining;
+  siterator->line_length = length;
+  siterator->fetcher = NULL;
+}
+
+/* Case folding or masking for every base the iterator fetches,
+   SEQ_XFORM_UPPER, SEQ_XFORM_LOWER, SEQ_XFORM_HARDMASK or 0 to leave
+   them as they are in the file */
 
-  /* If the remaining bp is less than what we'd send in the window,
-     tell the caller to fetch that. Otherwise we want to suck the full
-     amount that would fit in our window */
-  return bp_possible < bp_with_crs ? bp_possible : bp_with_crs;
+void tark_iterator_set_transform(seq_iterator_t* siterator, int transform) {
+  if(siterator == NULL) {
+    return;
+  }
+
+  siterator->transform = transform & (SEQ_XFORM_UPPER | SEQ_XFORM_LOWER | SEQ_XFORM_HARDMASK);
 }
 
-char* tark_iterator_fetch_seq(seq_iterator_t* siterator, int *seq_len, char* seq_ptr) {
-  return _tark_iterator_fetch_seq(siterator, seq_len, seq_ptr, siterator->line_length);
+/* Genetic code to translate with, an NCBI transl_table id
+
+   Returns 1 on success, 0 if there's no such code, in which case
+   the iterator keeps the code it had.
+*/
+
+int tark_iterator_set_genetic_code(seq_iterator_t* siterator, int id) {
+  const char* code;
+
+  if(siterator == NULL) {
+    return 0;
+  }
+
+  code = seq_genetic_code(id);
+  if(code == NULL) {
+    return 0;
+  }
+
+  siterator->code = code;
+
+  return 1;
 }
 
-char* _tark_iterator_fetch_seq(seq_iterator_t* siterator, int *seq_len, char* seq_ptr, int do_line_length) {
-  char* s = NULL;
-  char* seg_seq = NULL;
-  int bp_retrieved = 0;
-  int cr = 0;
-  int len, seg_start, seg_end, segment_remaining, fetch_len;
-  int bytes_to_cr = -1;
-  int bp_remaining = siterator->seq_length - siterator->seq_iterated;
-  seq_location_t *segment = NULL;
+/* Have the iterator read bases directly through a seq_reader
+   rather than faidx_fetch_seq.
 
-  //  *seq_len = *seq_len > bp_remaining ? bp_remaining : *seq_len;
+   Returns 1 if the reader knows our sequence and will be used,
+   0 if not, in which case the iterator carries on using faidx. */
 
-  if(bp_remaining <= 0) {
-    *seq_len = 0;
-    return NULL;
+int tark_iterator_set_reader(seq_iterator_t* siterator, seq_reader_t* reader) {
+  int seq_id;
+
+  if(siterator == NULL || reader == NULL) {
+    return 0;
   }
 
-  /* We allow the user to send us a pointer to a string they want
-     us to fill in, rather than allocating our own */
-  if(seq_ptr == NULL) {
-    //s = calloc(*seq_len + 1, 1);
-    s = malloc(*seq_len + 1);
-    if(s == NULL) { // If we aren't able to allocate the memory, bail.
-      *seq_len = 0;
-      return NULL;
-    }
-  } else {
-    s = seq_ptr;
+  seq_id = seq_reader_seq_id(reader, siterator->seq_name);
+  if(seq_id < 0) {
+    return 0;
   }
 
-  s[*seq_len] = 0;
+  siterator->reader = reader;
+  siterator->seq_id = seq_id;
+  _tark_iterator_plan_reads(siterator);
 
-  if(do_line_length) {
-    fetch_len = tark_iterator_adjusted_seq_len(*seq_len, bp_remaining, siterator->seq_iterated, siterator->line_length, &bytes_to_cr);
-  } else {
-    fetch_len = *seq_len > bp_remaining ? bp_remaining : *seq_len;
-  }
+  return 1;
+}
 
-  // If we're on the reverse strand we need to seek the interator,
-  // otherwise our seeking should be in the correct place as we retrieve
-  if( siterator->strand == -1 &&
-      ! tark_iterator_seek( siterator,
-			    ( bp_remaining - fetch_len ) ) ) {
+/* Sort the segments by where they start, for planning reads */
 
-    /* If we weren't given a pointer by the caller,
-       the memory isn't ours to free */
-    if(seq_ptr == NULL) {
-      free(s);
-    }
-    return NULL;
+typedef struct tark_plan_item {
+  uint64_t start;
+  uint64_t end;
+  unsigned int segment;
+} tark_plan_item_t;
+
+static int _tark_plan_cmp(const void* a, const void* b) {
+  const tark_plan_item_t* x = a;
+  const tark_plan_item_t* y = b;
+
+  if(x->start != y->start) {
+    return x->start < y->start ? -1 : 1;
   }
+  return x->segment < y->segment ? -1 : (x->segment > y->segment);
+}
 
-  /* Loop through fetching segments until we reach our limit */
-  while(bp_retrieved < fetch_len) {
-    segment = &(siterator->locations[siterator->segment_ptr]);
-    segment_remaining = segment->length - siterator->segment_bp_ptr;
-    bp_remaining = fetch_len - bp_retrieved;
-    seg_start = segment->start + siterator->segment_bp_ptr;
+/* Plan the reads for a multi-segment iterator. Going through the
+   segments in the order they are in the file, any that overlap or
+   sit close enough together that they and everything between them
+   fit in the reader's scratch buffer become one extent, so a block
+   of a compressed file is decompressed once however many exons or
+   probes land in it. The segments are still sent in the order they
+   were asked for, each extent is read ahead the first time one of
+   its segments is reached.
 
-    if(segment_remaining > bp_remaining) {
-      // We only want part of this segment
-      seg_end = segment->start + siterator->segment_bp_ptr + bp_remaining - 1;
-      siterator->segment_bp_ptr += bp_remaining;
-    } else {
-      // We want all of the segment, plus move to next segment
-      seg_end = segment->end;
-      siterator->segment_bp_ptr = 0;
-      siterator->segment_ptr++;
-    }
+   Returns the number of extents, 0 if every segment is read alone.
+*/
 
-    seg_seq = faidx_fetch_seq(siterator->fai,
-			      siterator->seq_name, 
-			      seg_start,
-			      seg_end,
-			      &len);
+int _tark_iterator_plan_reads(seq_iterator_t* siterator) {
+  tark_plan_item_t* items;
+  unsigned int i, k, first, sorted;
+  uint64_t start, end, e;
+  unsigned int n = siterator->nlocations;
 
-    /* If we have a line length, use our custom memcpy wrapper
-       that will handle adding the CR as needed */
-    if(do_line_length) {
-      cr += memcpy_with_cr(s+bp_retrieved+cr, seg_seq, len, siterator->line_length, &bytes_to_cr);
-      bp_retrieved += len;
+  tark_free(&siterator->alloc, siterator->extents);
+  siterator->extents = NULL;
+  siterator->nextents = 0;
+  siterator->extent_ptr = TARK_NO_EXTENT;
 
-      /* Very specific case where we need to pad out one last EOL */
-      if(bytes_to_cr == 0 && (bp_retrieved+cr+1) == *seq_len) {
-	*(char*)(s+bp_retrieved+cr) = '\n';
-	cr++;
-      }
-    } else {
-      memcpy(s+bp_retrieved, seg_seq, len);
-      bp_retrieved += len;
-    }
-    free(seg_seq);
+  for(i = 0; i < n; i++) {
+    siterator->locations[i].extent = TARK_NO_EXTENT;
   }
 
-  siterator->seq_iterated += bp_retrieved;
-  *seq_len = bp_retrieved+cr;
-  s[*seq_len] = 0;
+  if(siterator->reader == NULL || n < 2) {
+    return 0;
+  }
 
-  if(siterator->strand == -1) {
-    //    puts("reversing");
-    tark_revcomp_seq(s);      
+  items = tark_alloc(&siterator->alloc, n * sizeof(tark_plan_item_t));
+  siterator->extents = tark_alloc(&siterator->alloc, n / 2 * sizeof(seq_extent_t));
+  if(items == NULL || siterator->extents == NULL) {
+    tark_free(&siterator->alloc, items);
+    tark_free(&siterator->alloc, siterator->extents);
+    siterator->extents = NULL;
+    return 0;
   }
 
-  return s;
+  /* Exons and tiled probes usually come in order already */
+  sorted = 1;
+  for(i = 0; i < n; i++) {
+    items[i].start = siterator->locations[i].start;
+    items[i].end = siterator->locations[i].end;
+    items[i].segment = i;
+    if(i > 0 && items[i].start < items[i-1].start) {
+      sorted = 0;
+    }
+  }
 
-}
+  if(!sorted) {
+    qsort(items, n, sizeof(tark_plan_item_t), _tark_plan_cmp);
+  }
 
-/* We're going to be a little unsafe with our memory copying here because the code that
-   calls us should be sane in how it passes parameters. We're not going to recheck thing
-   that the caller shouldn't have gotten wrong. */
+  for(first = 0; first < n; first = i) {
+    start = items[first].start;
+    end = items[first].end;
 
-int memcpy_with_cr(void* dest, void* src, int len, int line_len, int *bytes_to_cr) {
-  int cr = 0;
+    for(i = first + 1; i < n; i++) {
+      e = items[i].end > end ? items[i].end : end;
+      if(e - start + 1 > SEQ_READER_SCRATCH) {
+	break;
+      }
+      end = e;
+    }
 
-  if(len < *bytes_to_cr) {
-    memcpy(dest, src, len);
-    *bytes_to_cr -= len;
-    return 0;
-  }
+    /* A segment on its own gains nothing from an extent */
+    if(i - first < 2) {
+      continue;
+    }
 
-  /* We have to inject a CR before we start looping on line lengths */
-  if(*bytes_to_cr > 0) {
-    memcpy(dest, src, *bytes_to_cr);
-    dest += *bytes_to_cr;
-    src += *bytes_to_cr;
-    *(char*)dest = '\n';
-    cr++;
-    len -= *bytes_to_cr;
-  } else if(*bytes_to_cr == 0) {
-    *(char*)dest = '\n';
-    cr++;
+    for(k = first; k < i; k++) {
+      siterator->locations[items[k].segment].extent = siterator->nextents;
+    }
+    siterator->extents[siterator->nextents].start = start;
+    siterator->extents[siterator->nextents].end = end;
+    siterator->nextents++;
   }
 
-  while(len > line_len) {
-    memcpy(dest+cr, src, line_len);
-    dest += line_len;
-    src += line_len;
-    *(char*)(dest+cr) = '\n';
-    cr++;
-    len -= line_len;
+  tark_free(&siterator->alloc, items);
+
+  if(siterator->nextents == 0) {
+    tark_free(&siterator->alloc, siterator->extents);
+    siterator->extents = NULL;
   }
-   
-  memcpy(dest+cr, src, len);
-  *bytes_to_cr = line_len - len;
 
-  return cr;
+  return siterator->nextents;
 }
 
-void tark_iterator_set_line_length(seq_iterator_t* siterator, unsigned int length) {
-  if(siterator == NULL) {
-    return;
-  }
+/* Move the iterator to bp (relative to the start of the iterator),
+   finding the segment by binary search on the segment offsets. A bp
+   on the boundary between two segments lands at the start of the
+   later one.
 
-  siterator->line_length = length;
-}
+   Returns 1 on success, 0 if bp is past the end of the iterator.
+*/
 
-int tark_iterator_seek(seq_iterator_t* siterator, unsigned int bp) {
-  int bp_count = 0;
-  int i;
+int tark_iterator_seek(seq_iterator_t* siterator, uint64_t bp) {
+  seq_location_t* locations = siterator->locations;
+  unsigned int lo, hi, mid;
 
-  if(bp > siterator->seq_length) {
+  if(bp > siterator->seq_length || siterator->nlocations == 0) {
     return 0; // error, too far
   }
 
-  for(i = 0; bp_count <= bp; i++) {
-    if((bp_count + siterator->locations[i].length) < bp) {
-      bp_count += siterator->locations[i].length;
-      continue;
+  /* Find the last segment starting at or before bp */
+  lo = 0;
+  hi = siterator->nlocations - 1;
+  while(lo < hi) {
+    mid = lo + (hi - lo + 1) / 2;
+    if(locations[mid].offset <= bp) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
     }
-
-    siterator->segment_ptr = i;
-    siterator->segment_bp_ptr = bp - bp_count;
-
-    return 1;
   }
 
-  return 0; // something is very wrong
+  siterator->segment_ptr = lo;
+  siterator->segment_bp_ptr = bp - locations[lo].offset;
 
+  return 1;
 }
 
 int tark_iterator_locations_count(seq_iterator_t* siterator) {
-  int bp_counted = 0;
-  int i;
 
   /* Sanity checking */
   if(siterator->locations == NULL) {
     return 0;
   }
 
-  for(i = 0; bp_counted < siterator->seq_length; i++) {
-    bp_counted += siterator->locations[i].length;
-  }
-
-  return i;
+  return siterator->nlocations;
 }
 
 char* tark_revcomp_seq(char *seq) {
-  char tmp;
-  int i, k, l, l2;
-
-  l = strlen(seq);
-  l2 = l/2;
-
-  // Two counters, less maths than doing a subtraction each time
-  k = l - 1;
-  for(i = 0; i < l2; i++) {
-    /* Keep any CR in place when reversing */
-    if(seq[k] == '\n') { k--; }
-    if(seq[i] == '\n') { i++; }
-    tmp = revcom[ trnconv[(int)seq[k]] ];
-    seq[k] = revcom[ trnconv[(int)seq[i]] ];
-    seq[i] = tmp;
+  return tark_revcomp_seq_len(seq, strlen(seq));
+}
 
-    k--;
-  } 
+/* Reverse complement len bases of seq in place, IUPAC codes are
+   complemented and case is kept. seq doesn't need to be NUL
+   terminated and mustn't contain line breaks. */
 
-  if(l % 2 != 0) {
-    seq[i] = revcom[ trnconv[(int)seq[i]] ];
+char* tark_revcomp_seq_len(char *seq, int len) {
+  if(len > 0) {
+    seq_revcomp_inplace(seq, len);
   }
 
   return seq;
@@ -572,7 +969,7 @@ char* tark_translate_seqs(char **seqs, int seq_len, int nseqs, int strand) {
   int i, k, l, r;
   int lenmod3;
   char* seq;
-  int *trntbl;
+  const unsigned char *trntbl;
 
   // Allocate a sufficient sized string
   seq = malloc(((seq_len / 3) + 2) * sizeof(char));
@@ -582,14 +979,14 @@ char* tark_translate_seqs(char **seqs, int seq_len, int nseqs, int strand) {
 
   // Handle strand, change the translation table being used
   if(strand == -1) {
-    trntbl = trncomp;
+    trntbl = seq_codon_base_comp;
     i = seq_len % 3;
     if(i) { // If we're starting with an initial phase, put that trailing X on the front
       seq[k] = 'X';
       k++;
     }
   } else {
-    trntbl = trnconv;
+    trntbl = seq_codon_base;
   }
 
   for(r = 0; ; r++) { // For each row in the set of sequences
@@ -600,9 +997,7 @@ char* tark_translate_seqs(char **seqs, int seq_len, int nseqs, int strand) {
 
     for(; i < lenmod3; i+=3) { // Work our way through the current row
       //    printf("i: %d k: %d\n", i, k);
-    seq[k] = codons[trntbl[(int)seqs[r][i]]]
-                   [trntbl[(int)seqs[r][i+1]]]
-                   [trntbl[(int)seqs[r][i+2]]];
+    seq[k] = seq_codon_table[ SEQ_CODON_INDEX(trntbl, seqs[r][i], seqs[r][i+1], seqs[r][i+2]) ];
     //      printf("codon: %c%c%c, p: %c\n", seqs[r][i], seqs[r][i+1], seqs[r][i+2], seq[k]);
       k++;
     }
@@ -613,17 +1008,13 @@ char* tark_translate_seqs(char **seqs, int seq_len, int nseqs, int strand) {
     // if we have leftover bp
     if(--l == i) { // we have 1 leftover bp
       puts("1 left");
-      seq[k] = codons[trntbl[(int)seqs[r][i]]]
-                     [trntbl[(int)seqs[r+1][0]]]
-                     [trntbl[(int)seqs[r+1][1]]];
+      seq[k] = seq_codon_table[ SEQ_CODON_INDEX(trntbl, seqs[r][i], seqs[r+1][0], seqs[r+1][1]) ];
       
       //      printf("codon: %c,%c,%c, p: %c\n", seqs[r][i], seqs[r+1][0], seqs[r+1][1], seq[k]);
       i = 2; k++;
     } else if(--l == i) { // we have 2 leftover bp
       puts("2 left");
-      seq[k] = codons[trntbl[(int)seqs[r][i]]]
-                     [trntbl[(int)seqs[r][i+1]]]
-                     [trntbl[(int)seqs[r+1][0]]];
+      seq[k] = seq_codon_table[ SEQ_CODON_INDEX(trntbl, seqs[r][i], seqs[r][i+1], seqs[r+1][0]) ];
       //      printf("codon: %c%c%c, p: %c\n", seqs[r][i], seqs[r][i+1], seqs[r+1][0], seq[k]);
       i = 1; k++;
     } else {
@@ -641,9 +1032,134 @@ char* tark_translate_seqs(char **seqs, int seq_len, int nseqs, int strand) {
   return seq;
 }
 
-int tark_iterator_translated_length(seq_iterator_t* siterator, int* remaining, int* unpadded_remaining) {
-  int length;
-  int remainder;
+/* Translate len bases of seq in all six reading frames with the
+   codon table code (NULL for the standard code). frames[0-2] are the
+   frames starting at the first, second and third base, frames[3-5]
+   the same on the reverse complement, which is written to rc on the
+   way. Each of frames must have room for len / 3 amino acids and rc
+   for len bases. Only whole codons are translated, the length of
+   each frame goes in to lens, nothing is NUL terminated.
+*/
+
+void tark_translate_frames(const char* seq, int len, const char* code, char* rc, char** frames, int* lens) {
+  int f;
+
+  if(code == NULL) {
+    code = seq_codon_table;
+  }
+
+  seq_revcomp(rc, seq, len);
+
+  for(f = 0; f < 3; f++) {
+    if(len <= f) {
+      lens[f] = lens[f + 3] = 0;
+      continue;
+    }
+
+    lens[f] = seq_translate_code(frames[f], seq + f, len - f, code);
+    lens[f + 3] = seq_translate_code(frames[f + 3], rc + f, len - f, code);
+  }
+}
+
+/* Sort ORFs by where they start on the forward strand, then frame */
+
+static int _tark_orf_cmp(const void* a, const void* b) {
+  const seq_orf_t* x = (const seq_orf_t*)a;
+  const seq_orf_t* y = (const seq_orf_t*)b;
+
+  if(x->start != y->start) {
+    return x->start < y->start ? -1 : 1;
+  }
+
+  return x->frame - y->frame;
+}
+
+/* Find the open reading frames in len bases of seq, on both strands,
+   of at least min_length amino acids. An ORF runs from the first M
+   after a stop (or the start of the frame) to the next stop, ones
+   that run off the end without a stop aren't counted.
+
+   The bases are translated in all six frames with code by
+   tark_translate_frames, rc and frames are as for that, and then
+   each frame is scanned for stops with memchr rather than codon by
+   codon. The ORFs' proteins point in to frames.
+
+   Returns the number of ORFs, in an array in orfs sorted by start
+   allocated through alloc (NULL for malloc), or -1 if we couldn't
+   allocate it.
+*/
+
+int tark_find_orfs(const char* seq, int len, const char* code, unsigned int min_length, char* rc, char** frames, seq_orf_t** orfs, const tark_allocator_t* alloc) {
+  static const int frame_ids[6] = { 1, 2, 3, -1, -2, -3 };
+  seq_orf_t* found = NULL;
+  seq_orf_t* grown;
+  const char* p;
+  const char* stop;
+  const char* start;
+  const char* frame_end;
+  unsigned int first, last;
+  int lens[6];
+  int nfound = 0;
+  int size = 0;
+  int f;
+
+  tark_translate_frames(seq, len, code, rc, frames, lens);
+
+  for(f = 0; f < 6; f++) {
+    p = frames[f];
+    frame_end = frames[f] + lens[f];
+
+    while(p < frame_end && (stop = memchr(p, '*', frame_end - p)) != NULL) {
+      start = memchr(p, 'M', stop - p);
+
+      if(start != NULL && stop - start >= min_length) {
+	/* Allocators needn't have a realloc, copy what we have */
+	if(nfound == size) {
+	  size = size ? size * 2 : 16;
+	  grown = tark_alloc(alloc, size * sizeof(seq_orf_t));
+	  if(grown == NULL) {
+	    tark_free(alloc, found);
+	    return -1;
+	  }
+	  if(nfound > 0) {
+	    memcpy(grown, found, nfound * sizeof(seq_orf_t));
+	  }
+	  tark_free(alloc, found);
+	  found = grown;
+	}
+
+	/* Codon offsets in the frame, in to bases */
+	first = (f % 3) + (start - frames[f]) * 3;
+	last = (f % 3) + (stop - frames[f]) * 3 + 3;
+	if(f < 3) {
+	  found[nfound].start = first;
+	  found[nfound].end = last;
+	} else {
+	  found[nfound].start = len - last;
+	  found[nfound].end = len - first;
+	}
+	found[nfound].frame = frame_ids[f];
+	found[nfound].length = stop - start;
+	found[nfound].protein = start;
+	nfound++;
+      }
+
+      p = stop + 1;
+    }
+  }
+
+  if(nfound > 1) {
+    qsort(found, nfound, sizeof(seq_orf_t), _tark_orf_cmp);
+  }
+
+  *orfs = found;
+
+  return nfound;
+}
+
+int64_t tark_iterator_translated_length(seq_iterator_t* siterator, int64_t* remaining, int64_t* unpadded_remaining) {
+  int64_t length;
+  int64_t remainder;
 
   length = siterator->seq_length / 3;
   if(siterator->seq_length % 3 != 0) length++;
@@ -665,8 +1181,8 @@ int tark_iterator_translated_length(seq_iterator_t* siterator, int* remaining, i
   return length;
 }
 
-int tark_iterator_remaining(seq_iterator_t* siterator, int translated) {
-  int remainder;
+int64_t tark_iterator_remaining(seq_iterator_t* siterator, int translated) {
+  int64_t remainder;
 
   remainder = siterator->seq_length - siterator->seq_iterated;
 
@@ -677,6 +1193,33 @@ int tark_iterator_remaining(seq_iterator_t* siterator, int translated) {
   return remainder;
 }
 
+/* A zeroed iterator with its own copy of seq_name, both allocated
+   through alloc, which it keeps for everything else it allocates */
+
+static seq_iterator_t* _tark_new_iterator(const tark_allocator_t* alloc, const char* seq_name) {
+  seq_iterator_t* siterator;
+  size_t len = strlen(seq_name) + 1;
+
+  siterator = tark_alloc(alloc, sizeof(seq_iterator_t));
+  if(siterator == NULL) {
+    return NULL;
+  }
+
+  memset(siterator, 0, sizeof(seq_iterator_t));
+  if(alloc != NULL) {
+    siterator->alloc = *alloc;
+  }
+
+  siterator->seq_name = tark_alloc(alloc, len);
+  if(siterator->seq_name == NULL) {
+    tark_free(alloc, siterator);
+    return NULL;
+  }
+  memcpy(siterator->seq_name, seq_name, len);
+
+  return siterator;
+}
+
 /*
    Create a interator for retrieving a sequence based on one or more
    locations in the reference
@@ -695,100 +1238,294 @@ int tark_iterator_remaining(seq_iterator_t* siterator, int translated) {
 */
 
 seq_iterator_t* tark_fetch_iterator(faidx_t* fai, const char *seq_name, const char *locs, int ensembl_coords) {
-  int c, i, l, k, location_end, beg, end, nseqs;
   seq_iterator_t* siterator;
-  char* s;
+  int64_t ref_length;
 
   // If we don't actually have this sequence, return an error (NULL)
   if(!faidx_has_seq(fai, seq_name)) {
     return NULL;
   }
 
+  /* The one and only time we look up the length by name */
+  ref_length = TARK_FAIDX_SEQ_LEN(fai, seq_name);
+  if(ref_length < 0) {
+    return NULL;
+  }
+
+  siterator = _tark_new_iterator(NULL, seq_name);
+  if(siterator == NULL) {
+    return NULL;
+  }
+  siterator->fai = fai;
+  siterator->seq_id = -1;
+  siterator->ref_length = ref_length;
+
+  if(!_tark_iterator_parse_locations(siterator, locs, ensembl_coords)) {
+    tark_free_iterator(siterator);
+    return NULL;
+  }
+
+  return siterator;
+}
+
+/*
+   Create an iterator for a sequence we already know the id of, its
+   position in the file's .fai index. Everything the iterator needs
+   about the sequence is resolved here, once, so nothing is looked up
+   by name while fetching.
+
+   Args
+   [1] fai, pointer to faidx_t structure references, may be NULL if
+       we have a reader
+   [2] reader, seq_reader_t* to fetch through, may be NULL in which case
+       we fall back to fetching through faidx (by name)
+   [3] seq_id, integer, the sequence's position in the index
+   [4] locations, as for tark_fetch_iterator
+   [5] ensembl_coords, as for tark_fetch_iterator
+
+   Return
+   seq_iterator_t* or NULL, pointer to a seq_iterator object or NULL if failure
+*/
+
+seq_iterator_t* tark_fetch_iterator_handle(faidx_t* fai, seq_reader_t* reader, int seq_id, const char *locs, int ensembl_coords) {
+  return tark_fetch_iterator_handle_alloc(fai, reader, seq_id, locs, ensembl_coords, NULL);
+}
+
+/*
+   As tark_fetch_iterator_handle, with the iterator, its locations and
+   its buffers allocated through alloc, which the iterator keeps a copy
+   of. NULL is malloc. If alloc has no free, as with an APR pool or an
+   arena, tark_free_iterator does nothing and the memory goes when the
+   pool or arena does.
+*/
+
+seq_iterator_t* tark_fetch_iterator_handle_alloc(faidx_t* fai, seq_reader_t* reader, int seq_id, const char *locs, int ensembl_coords, const tark_allocator_t* alloc) {
+  seq_iterator_t* siterator;
+  const char* seq_name;
+  int64_t ref_length;
+
+  if(reader != NULL) {
+    seq_name = seq_reader_iseq(reader, seq_id);
+    if(seq_name == NULL) {
+      return NULL;
+    }
+    ref_length = seq_reader_seq_len(reader, seq_id);
+
+  } else if(fai != NULL) {
+    if(seq_id < 0 || seq_id >= faidx_nseq(fai)) {
+      return NULL;
+    }
+    seq_name = faidx_iseq(fai, seq_id);
+    ref_length = TARK_FAIDX_SEQ_LEN(fai, seq_name);
+    if(ref_length < 0) {
+      return NULL;
+    }
+
+  } else {
+    return NULL;
+  }
+
+  siterator = _tark_new_iterator(alloc, seq_name);
+  if(siterator == NULL) {
+    return NULL;
+  }
+  siterator->fai = fai;
+  siterator->reader = reader;
+  siterator->seq_id = seq_id;
+  siterator->ref_length = ref_length;
+
+  if(!_tark_iterator_parse_locations(siterator, locs, ensembl_coords)) {
+    tark_free_iterator(siterator);
+    return NULL;
+  }
+
+  _tark_iterator_plan_reads(siterator);
+
+  return siterator;
+}
+
+/* Space, tab, newline, vertical tab, form feed or carriage return,
+   isspace without the locale lookup */
+#define TARK_ISSPACE(c) ((c) == ' ' || (unsigned char)((c) - '\t') <= '\r' - '\t')
+
+/* Read an unsigned decimal number at p, after any spaces, in to
+   value. Returns a pointer past the digits, or NULL if there are no
+   digits or the number doesn't fit in 64 bits. */
+
+static const char* _tark_parse_pos(const char* p, uint64_t* value) {
+  uint64_t v = 0;
+  unsigned int d;
+  const char* digits;
+
+  while(TARK_ISSPACE(*p)) {
+    p++;
+  }
+
+  for(digits = p; (d = (unsigned char)*p - '0') <= 9; p++) {
+    if(v > (UINT64_MAX - d) / 10) {
+      return NULL;
+    }
+    v = v * 10 + d;
+  }
+
+  if(p == digits) {
+    return NULL;
+  }
+
+  *value = v;
+  return p;
+}
+
+static const char* _tark_skip_space(const char* p) {
+  while(TARK_ISSPACE(*p)) {
+    p++;
+  }
+
+  return p;
+}
+
+/*
+   Fill in the locations of an iterator from a location string,
+   "beg-end,beg-end,...:strand", the iterator's ref_length must
+   already be set, every location is checked against it.
+
+   The string is read once, front to back, with the segments and
+   their running offsets written as we go. Anything malformed, a
+   number too big for a coordinate, a location outside the sequence
+   or more than TARK_MAX_LOCATIONS segments and we give up there.
+
+   Returns 1 on success, 0 if the locations are invalid.
+*/
+
+int _tark_iterator_parse_locations(seq_iterator_t* siterator, const char *locs, int ensembl_coords) {
+  seq_location_t* locations;
+  seq_location_t* segment;
+  unsigned int capacity = 0;
+  uint64_t beg, end, length, strand;
+  const char* p;
+  int sign;
+
   /* Special case, if we're not given a set of locations, we assume we
      want the entire sequence. So create an iterator that covers that. */
   if(locs == NULL) {
-    siterator = calloc(1, sizeof(seq_iterator_t));
-    siterator->locations = malloc( sizeof(seq_location_t) );
-    siterator->fai = fai;
-    siterator->seq_name = strdup(seq_name);
+    siterator->locations = tark_alloc(&siterator->alloc, sizeof(seq_location_t));
+    if(siterator->locations == NULL) {
+      return 0;
+    }
     siterator->strand = 1;
-    siterator->seq_length = faidx_seq_len(fai, seq_name);
+    siterator->seq_length = siterator->ref_length;
     ((seq_location_t *)siterator->locations)->start = 0;
     ((seq_location_t *)siterator->locations)->end = siterator->seq_length - 1;
     ((seq_location_t *)siterator->locations)->length = siterator->seq_length;
+    ((seq_location_t *)siterator->locations)->offset = 0;
+    ((seq_location_t *)siterator->locations)->extent = TARK_NO_EXTENT;
+    siterator->nlocations = 1;
 
-    return siterator;
+    return 1;
   }
 
-  l = strlen(locs);
-  s = (char*)malloc(l+1);
-  // remove spaces and count the sequences, 
-  // we could be fancier, but this is pretty much as efficient
-  location_end = -1;
-  nseqs = 1;
-  for (i = k = 0; i < l; ++i) {
-    if ( isspace(locs[i]) ) { continue; }
-    if (locs[i] == ':') { location_end = i; break; }
-    if (locs[i] == ',') { nseqs++; }
-    s[k++] = locs[i];
-  }
-  s[k] = 0; l = k;
-  //  puts("spaces removed\n");
+  siterator->nlocations = 0;
+  siterator->seq_length = 0;
+
+  for(p = locs;;) {
+    if((p = _tark_parse_pos(p, &beg)) == NULL) {
+      return 0;
+    }
 
-  // Let's assume things are going to go well, make our iterator structure
-  siterator = calloc(1, sizeof(seq_iterator_t));
-  siterator->locations = malloc( sizeof(seq_location_t) * nseqs );
+    p = _tark_skip_space(p);
+    if(*p != '-') {
+      return 0;
+    }
 
-  // Let's start filling in the details
-  siterator->fai = fai;
-  siterator->seq_name = strdup(seq_name);
-  if(location_end >= 0) {
-    siterator->strand = atoi(locs + location_end + 1); // deal with strand later, if it's valid or not
-  } // no strand is positive strand, tough.
-
-  c = nseqs - 1;
-  for(k--; k>=0; k--) {
-    if(s[k] == '-') {
-      end = atoi(s + k + 1);
-      if (end > 0 && ensembl_coords) --end;
-      s[k] = 0;
-    } else if(s[k] == ',' || k == 0) {
-      if( k == 0 ) k--; // Correct k for the last iteration so the ptr addition works
-      beg = atoi(s + k + 1);
-      //      if (beg > 0) --beg;
-      s[k] = 0;
-
-      // Start must be less than end and
-      // the end is less then the sequence length
-      if( end < beg || 
-	  faidx_seq_len(fai, seq_name) < end ) {
-	tark_free_iterator(siterator);
-	free(s);
-	return NULL;
+    if((p = _tark_parse_pos(p + 1, &end)) == NULL) {
+      return 0;
+    }
+    if(end > 0 && ensembl_coords) {
+      --end;
+    }
+
+    // Start must be less than end and
+    // the end must be within the sequence
+    if(end < beg || siterator->ref_length <= end) {
+      return 0;
+    }
+
+    length = end - beg + 1;
+    if(siterator->seq_length + length < siterator->seq_length) {
+      return 0;
+    }
+
+    /* Grow the locations by doubling, the iterator owns them as
+       soon as they exist so a failure further on frees them */
+    if(siterator->nlocations == capacity) {
+      if(capacity >= TARK_MAX_LOCATIONS) {
+	return 0;
       }
 
-      siterator->locations[c].start = beg;
-      siterator->locations[c].end = end;
-      siterator->locations[c].length = end - beg + 1;
-      
-      siterator->seq_length += siterator->locations[c].length;
-      c--;
+      capacity = capacity ? capacity * 2 : 4;
+      if(capacity > TARK_MAX_LOCATIONS) {
+	capacity = TARK_MAX_LOCATIONS;
+      }
+
+      /* Allocators needn't have a realloc, copy what we have */
+      locations = tark_alloc(&siterator->alloc, sizeof(seq_location_t) * capacity);
+      if(locations == NULL) {
+	return 0;
+      }
+      if(siterator->nlocations > 0) {
+	memcpy(locations, siterator->locations, sizeof(seq_location_t) * siterator->nlocations);
+      }
+      tark_free(&siterator->alloc, siterator->locations);
+      siterator->locations = locations;
+    }
+
+    segment = &(siterator->locations[siterator->nlocations++]);
+    segment->start = beg;
+    segment->end = end;
+    segment->length = length;
+    segment->offset = siterator->seq_length; // Running total so seeking can binary search
+    segment->extent = TARK_NO_EXTENT;
+    siterator->seq_length += length;
+
+    p = _tark_skip_space(p);
+    if(*p != ',') {
+      break;
     }
+    p++;
   }
 
-  free(s);
-  return siterator;
+  // no strand is positive strand, tough.
+  if(*p == ':') {
+    p = _tark_skip_space(p + 1);
+    sign = 1;
+    if(*p == '-' || *p == '+') {
+      sign = (*p == '-') ? -1 : 1;
+      p++;
+    }
+
+    if((p = _tark_parse_pos(p, &strand)) == NULL || strand > 1) {
+      return 0;
+    }
+    siterator->strand = sign * (int)strand;
+    p = _tark_skip_space(p);
+  }
+
+  return *p == '\0';
 }
 
+/* Free an iterator and everything it allocated, through the
+   allocator it was made with, a no-op if that has no free */
+
 void tark_free_iterator(seq_iterator_t* siterator) {
+  tark_allocator_t alloc;
+
   if( siterator != NULL ) {
-    if( siterator->locations != NULL ) {
-      free(siterator->locations);
-    }
-    if( siterator->seq_name != NULL ) {
-      free(siterator->seq_name);
-    }
-    free(siterator);
+    alloc = siterator->alloc;
+    tark_free(&alloc, siterator->locations);
+    tark_free(&alloc, siterator->extents);
+    tark_free(&alloc, siterator->scratch);
+    tark_free(&alloc, siterator->seq_name);
+    tark_free(&alloc, siterator);
   }
 }
 
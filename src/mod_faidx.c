@@ -61,6 +61,10 @@ static void* mod_Faidx_svr_conf(apr_pool_t* pool, server_rec* s) {
   /* Set the cache size in case the user doesn't set it in the config */
   svr->cachesize = DEFAULT_FILES_CACHE_SIZE;
 
+  /* The shared block cache is made once the config is read */
+  svr->shared_blockcache = DEFAULT_SHARED_BLOCK_CACHE_SIZE;
+  svr->shm = NULL;
+
   return svr;
 }
 
@@ -70,6 +74,10 @@ static const command_rec mod_Faidx_cmds[] = {
 		RSRC_CONF, "Base URI for module endpoints"),*/
   AP_INIT_TAKE1(SEQFILE_CACHESIZE_DIRECTIVE, modFaidx_init_cachesize, NULL, RSRC_CONF,
 		"Set the cache size for seqfiles"),
+  AP_INIT_TAKE1(BLOCK_CACHESIZE_DIRECTIVE, modFaidx_init_blockcache, NULL, RSRC_CONF,
+		"Set the bytes of decompressed bgzip blocks each process caches"),
+  AP_INIT_TAKE1(SHARED_BLOCK_CACHESIZE_DIRECTIVE, modFaidx_init_sharedblockcache, NULL, RSRC_CONF,
+		"Set the bytes of shared memory for decompressed bgzip blocks all processes use"),
   AP_INIT_FLAG(LABELS_ENDPOINT_DIRECTIVE, ap_set_flag_slot,
 	       (void *)APR_OFFSETOF(mod_Faidx_svr_cfg, labels_endpoints),
 	       RSRC_CONF, "Enable labels endpoints, limited to 'on' or 'off'"),
@@ -120,7 +128,7 @@ static int Faidx_handler(request_rec* r) {
   char* h_buf;
   int buf_remaining;
   int flushed = 0;
-  unsigned int total_seq_length = 0;
+  apr_off_t total_seq_length = 0;
 
 #ifdef DEBUG
       ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
@@ -216,6 +224,14 @@ static int Faidx_handler(request_rec* r) {
 	     old way, error. */
 	  return HTTP_BAD_REQUEST;
 	}
+      } else if( !strcmp(uri_ptr, "orfs") ) {
+	if( checksum != NULL ) {
+	  /* Scan the range for ORFs rather than sending it */
+	  t = ORFS_VERB;
+	  break;
+	} else {
+	  return HTTP_BAD_REQUEST;
+	}
       } else if( !strcmp(uri_ptr, "service-info") ) {
 	if( checksum != NULL ) {
 	  /* Do and return server info here */
@@ -291,16 +307,23 @@ static int Faidx_handler(request_rec* r) {
 
     if(siterator == NULL) return HTTP_INTERNAL_SERVER_ERROR;
 
+    if(t == ORFS_VERB) {
+      return orfs_handler(r, siterator, accept, formdata);
+    }
+
+    /* Six frames need records to come back in, FASTA or JSON */
+    if(siterator->frames && accept == CONTENT_TEXT) {
+      return HTTP_NOT_ACCEPTABLE;
+    }
+
     total_seq_length = tark_iterator_remaining(siterator, siterator->translate);
 
     /* If we've reached this point we must have an iterator and be ready to
-       send back sequence. Make a copy in to the request pool and free the
-       malloc'ed one from the external library. */
-    *(seq_iterator_t**)apr_array_push(location_iterators) = iterator_pool_copy(r, siterator);
+       send back sequence. It lives in the request pool, nothing to free. */
+    *(seq_iterator_t**)apr_array_push(location_iterators) = siterator;
 #ifdef DEBUG
     print_iterator(r, siterator);
 #endif
-    tark_free_iterator(siterator);
 
 
   } else if(r->method_number == M_POST) {
@@ -399,7 +422,15 @@ static int Faidx_handler(request_rec* r) {
 #ifdef DEBUG
     print_iterator(r, siterator);
 #endif
-    location_offset = Faidx_create_header(h_buf, accept, siterator->checksum, siterator->seq_name, siterator->location_str, Loc_count);
+    /* Six frame translations are sent as six records of their own */
+    if(siterator->frames) {
+      if( Faidx_send_frames( r, siterator, accept, h_buf, &Loc_count, &buf_remaining, &send_buf_cur ) ) {
+	flushed = 1;
+      }
+      continue;
+    }
+
+    location_offset = Faidx_create_header(h_buf, accept, siterator->checksum, siterator->seq_name, siterator->location_str, Loc_count, 0);
     if(location_offset > MAX_HEADER) {
       location_offset = MAX_HEADER;
 #ifdef DEBUG
@@ -411,19 +442,25 @@ static int Faidx_handler(request_rec* r) {
       flushed = 1;
     }
 
+    /* Bases going out exactly as they are in a mapped file, in long
+       enough lines, are sent from where they are without copying */
+    if(tark_iterator_spannable(siterator, MIN_SPAN_LENGTH)) {
+      /* Already logged, don't go on fetching for a connection
+	 that's gone */
+      if( Faidx_send_spans( r, siterator, &buf_remaining, &send_buf_cur ) != APR_SUCCESS ) {
+	return AP_FILTER_ERROR;
+      }
+      flushed = 1;
+    }
+
     /* Go through the iterators and start fetching sequence,
        sending chunks to the user if we fill up the buffer. */
     while(tark_iterator_remaining(siterator, siterator->translate) > 0) {
       s = buf_remaining;
 
-      if(siterator->translate == 1) {
-#ifdef DEBUG
-	print_iterator(r, siterator);
-#endif
-	tark_iterator_fetch_translated_seq( siterator, &s, send_buf_cur );
-      } else {
-	tark_iterator_fetch_seq( siterator, &s, send_buf_cur );
-      }
+      /* The iterator picked its fetch function when it was made,
+	 translated or not, for its strand and line length */
+      tark_iterator_fetch( siterator, &s, send_buf_cur );
 
       /* This is safe because we've limited the fetch to
          never be larger than the remaining buffer a few
@@ -472,8 +509,10 @@ int Faidx_append_or_send(request_rec* r, char* send_ptr, int send_length, int* b
 	 then set the buffer as full */
 
       memcpy(*buf_ptr, send_ptr, *buf_remaining);
+      send_ptr += *buf_remaining;
       send_length -= *buf_remaining;
-      (*buf_ptr)[*buf_remaining] = '\0';
+      (*buf_ptr) += *buf_remaining;
+      (*buf_ptr)[0] = '\0';
       *buf_remaining = 0; /* buffer is full */
 
     } else if(send_length > 0) {
@@ -509,6 +548,100 @@ int Faidx_append_or_send(request_rec* r, char* send_ptr, int send_length, int* b
   return flushed;
 }
 
+/* Send the bases of a spannable iterator as buckets pointing in to
+   the mapped file, a brigade of up to MAX_SPANS at a time, after
+   flushing whatever is in the send buffer ahead of them. The buckets
+   are transient rather than immortal, anything the output filters
+   have to hold on to is copied, as the file may be closed by a later
+   request before it's written.
+
+   Returns APR_SUCCESS once the bases have been sent, or the error
+   from the output filters, leaving the rest of the bases unsent.
+*/
+
+apr_status_t Faidx_send_spans(request_rec* r, seq_iterator_t* siterator, int* buf_remaining, char** buf_ptr) {
+  apr_bucket_brigade* bb;
+  tark_span_t spans[MAX_SPANS];
+  apr_status_t rv;
+  int i, n;
+
+  if(*buf_remaining < CHUNK_SIZE - 1) {
+    Faidx_append_or_send(r, NULL, 0, buf_remaining, buf_ptr, 1);
+  }
+
+  bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+
+  while((n = tark_iterator_fetch_spans(siterator, spans, MAX_SPANS, CHUNK_SIZE)) > 0) {
+    for(i = 0; i < n; i++) {
+      APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create(spans[i].base, spans[i].len,
+							      r->connection->bucket_alloc));
+    }
+
+    rv = ap_pass_brigade(r->output_filters, bb);
+    apr_brigade_cleanup(bb);
+    if(rv != APR_SUCCESS) {
+      ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "Error sending sequence");
+      return rv;
+    }
+  }
+
+  return APR_SUCCESS;
+}
+
+/* Send the translations of all the bases left in an iterator in
+   the six reading frames, +1 to +3 on the iterator's strand then -1
+   to -3 on the other, as six records. The bases are fetched once and
+   translated from memory, seq_count is moved on by six.
+
+   Returns 1 if the send buffer was flushed.
+*/
+
+int Faidx_send_frames(request_rec* r, seq_iterator_t* siterator, int format, char* h_buf, unsigned int* seq_count, int* buf_remaining, char** buf_ptr) {
+  static const int frame_ids[6] = { 1, 2, 3, -1, -2, -3 };
+  char* seq;
+  char* rc;
+  char* frames[6];
+  int lens[6];
+  int len, i, offset;
+  int flushed = 0;
+
+  len = (int)tark_iterator_remaining(siterator, 0); /* At most MAX_FRAMES_LENGTH */
+  seq = apr_palloc(r->pool, len + 1);
+  rc = apr_palloc(r->pool, len + 1);
+  for(i = 0; i < 6; i++) {
+    frames[i] = apr_palloc(r->pool, len / 3 + 1);
+  }
+
+  /* All the bases in one fetch, unwrapped */
+  tark_iterator_set_line_length(siterator, 0);
+  tark_iterator_fetch_seq(siterator, &len, seq);
+
+  tark_translate_frames(seq, len, siterator->code, rc, frames, lens);
+
+  for(i = 0; i < 6; i++) {
+    offset = Faidx_create_header(h_buf, format, siterator->checksum, siterator->seq_name, siterator->location_str, *seq_count, frame_ids[i]);
+    if(offset > MAX_HEADER) {
+      offset = MAX_HEADER;
+    }
+    if( Faidx_append_or_send( r, h_buf, offset, buf_remaining, buf_ptr, 0 ) ) {
+      flushed = 1;
+    }
+
+    if( Faidx_append_or_send( r, frames[i], lens[i], buf_remaining, buf_ptr, 0 ) ) {
+      flushed = 1;
+    }
+
+    offset = Faidx_create_footer(h_buf, format);
+    if( Faidx_append_or_send( r, h_buf, offset, buf_remaining, buf_ptr, 0 ) ) {
+      flushed = 1;
+    }
+
+    (*seq_count)++;
+  }
+
+  return flushed;
+}
+
 /* 
    Print a Fasta sequence to the client
    ARGS[1] : Request object
@@ -557,28 +690,52 @@ void print_fasta(request_rec* r, char* header, char* seq, int seq_len) {
 
 /* buf must be at least MAX_HEADER size */
 
-int Faidx_create_header(char* buf, int format, char* set, char* seq_name, char* location, int seq_count) {
+int Faidx_create_header(char* buf, int format, char* set, char* seq_name, char* location, int seq_count, int frame) {
   unsigned int sent = 0;
   unsigned int remaining = MAX_HEADER;
 
   if(format == CONTENT_FASTA) {
 
-    sent = snprintf( buf, remaining, ">%s [%s:%s]\n",
-		      set,
-		      seq_name,
-		      location);
+    /* End the last record's sequence */
+    if(seq_count > 1) {
+      sent = snprintf( buf, remaining, "\n");
+      remaining -= sent;
+      buf += sent;
+    }
+
+    if(frame) {
+      sent += snprintf( buf, remaining, ">%s [%s:%s] frame=%+d\n",
+			set,
+			seq_name,
+			location,
+			frame);
+    } else {
+      sent += snprintf( buf, remaining, ">%s [%s:%s]\n",
+			set,
+			seq_name,
+			location);
+    }
   } else if(format == CONTENT_JSON) {
 
+    /* The last record's footer closed it, just separate them */
     if(seq_count > 1) {
-      sent = snprintf( buf, remaining, "\",\n");
+      sent = snprintf( buf, remaining, ",\n");
       remaining -= sent;
       buf += sent;
     }
 
-    sent += snprintf( buf, remaining, "  {\n    \"checksum\": \"%s\",\n    \"location\": \"%s:%s\",\n    \"seq\": \"",
-		      set,
-		      seq_name,
-		      location);
+    if(frame) {
+      sent += snprintf( buf, remaining, "  {\n    \"checksum\": \"%s\",\n    \"location\": \"%s:%s\",\n    \"frame\": %d,\n    \"seq\": \"",
+			set,
+			seq_name,
+			location,
+			frame);
+    } else {
+      sent += snprintf( buf, remaining, "  {\n    \"checksum\": \"%s\",\n    \"location\": \"%s:%s\",\n    \"seq\": \"",
+			set,
+			seq_name,
+			location);
+    }
   } else {
     /* Ensure the buffer is cleared if we're not writing to it */
     buf[0] = '\0';
@@ -632,9 +789,12 @@ const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_
   seq_file_t* seqfile;
   char* locs = NULL;
   const char* str;
+  char* endp;
+  tark_allocator_t pool_alloc = { pool_allocate, NULL, r->pool };
   int ensembl_coords = 0;
-  int start;
-  int end;
+  apr_int64_t start;
+  apr_int64_t end;
+  apr_int64_t code;
   int strand;
   int rv;
 
@@ -647,6 +807,11 @@ const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_
   }
 
   seqfile = files_mgr_use_seqfile(svr->files, checksum_holder->file);
+  if(seqfile == NULL) {
+      ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
+		    "Couldn't open the seqfile for checksum %s", checksum);
+      return HTTP_INTERNAL_SERVER_ERROR;
+  }
 
   str = apr_hash_get(formdata, "strand", APR_HASH_KEY_STRING);
   if(str == NULL) {
@@ -674,14 +839,14 @@ const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_
     if(str == NULL) {
       start = 0;
     } else {
-      start = atoi(str);
+      start = apr_atoi64(str);
     }
 
     str = apr_hash_get(formdata, "end", APR_HASH_KEY_STRING);
     if(str == NULL) {
-      end = faidx_seq_len((faidx_t*)seqfile->file_ptr, checksum_holder->sequence->name);
+      end = files_mgr_seq_len(seqfile, checksum_holder->sequence);
     } else {
-      end = atoi(str);
+      end = apr_atoi64(str);
     }
 
     /* Special case, in zero based coordinates chr1:4-4 is an
@@ -696,13 +861,19 @@ const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_
     }
 
     ensembl_coords = 1;
-    locs = apr_psprintf(r->pool, "%d-%d:%d", start, end, strand);
+    locs = apr_psprintf(r->pool, "%" APR_INT64_T_FMT "-%" APR_INT64_T_FMT ":%d", start, end, strand);
   }
 
-  siterator = tark_fetch_iterator((faidx_t*)seqfile->file_ptr, 
-				  checksum_holder->sequence->name,
-				  locs,
-				  ensembl_coords);
+  /* The sequence was resolved to its id in the file when the config
+     was loaded, so the iterator never needs to look it up by name.
+     The iterator and everything it allocates comes from the request
+     pool, it's never freed */
+  siterator = tark_fetch_iterator_handle_alloc(files_mgr_faidx(seqfile),
+					       seqfile->reader,
+					       checksum_holder->sequence->seq_id,
+					       locs,
+					       ensembl_coords,
+					       &pool_alloc);
 
   if(siterator == NULL) {
      ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
@@ -712,7 +883,7 @@ const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_
 
   if(locs == NULL) {
     siterator->location_str = apr_psprintf(r->pool,
-					   "%d-%d:%d",
+					   "%d-%" APR_UINT64_T_FMT ":%d",
 					   1,
 					   siterator->seq_length,
 					   strand);
@@ -730,7 +901,6 @@ const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_
   } else {
     strand = atoi(str);
     if((strand != 1) && (strand != 0)) {
-      tark_free_iterator(siterator);
 #ifdef DEBUG
       ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
 		    "Translate param, bad value %s, %d", str, strand);
@@ -740,6 +910,61 @@ const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_
     siterator->translate = strand;
   }
 
+  /* The genetic code to translate with, the seqfile's unless
+     the request asks for another */
+  str = apr_hash_get(formdata, "code", APR_HASH_KEY_STRING);
+  if(str == NULL) {
+    code = seqfile->genetic_code;
+  } else {
+    /* Range checked before narrowing, so nothing wraps on to a table */
+    code = apr_strtoi64(str, &endp, 10);
+    if(*str == '\0' || *endp != '\0' || code < 1 || code > INT_MAX) {
+      code = -1;
+    }
+  }
+
+  if(!tark_iterator_set_genetic_code(siterator, (int)code)) {
+#ifdef DEBUG
+    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
+		  "Code param, unknown genetic code %s", str);
+#endif
+    return HTTP_BAD_REQUEST;
+  }
+
+  /* Translate in all six frames at once, the bases are held in
+     memory so there's a limit on how many */
+  str = apr_hash_get(formdata, "frames", APR_HASH_KEY_STRING);
+  if(str != NULL) {
+    if(strcmp(str, "6")) {
+      return HTTP_BAD_REQUEST;
+    }
+    if(siterator->seq_length > MAX_FRAMES_LENGTH) {
+      return HTTP_REQUEST_ENTITY_TOO_LARGE;
+    }
+    siterator->frames = 6;
+  }
+
+  /* Soft masked repeats are lower case in the file, keep them,
+     fold them to upper case or hard mask them to N as we copy */
+  str = apr_hash_get(formdata, "mask", APR_HASH_KEY_STRING);
+  if(str != NULL) {
+    if(!strcmp(str, "upper")) {
+      tark_iterator_set_transform(siterator, SEQ_XFORM_UPPER);
+    } else if(!strcmp(str, "hard")) {
+      tark_iterator_set_transform(siterator, SEQ_XFORM_HARDMASK);
+    } else if(strcmp(str, "preserve")) {
+#ifdef DEBUG
+      ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
+		    "Mask param, bad value %s", str);
+#endif
+      return HTTP_BAD_REQUEST;
+    }
+  }
+
+  /* Strand and translate are settled, choose the fetch function
+     once rather than for every window we send */
+  tark_iterator_specialize(siterator);
+
   siterator->checksum = apr_pstrdup(r->pool, checksum);
 
   /* Copy over the address of the iterator */
@@ -748,24 +973,10 @@ const int mod_Faidx_create_iterator(request_rec* r, mod_Faidx_svr_cfg* svr, apr_
   return OK;
 }
 
-/* Make a copy of a seq_iterator in to the request memory pool */
-
-seq_iterator_t* iterator_pool_copy(request_rec* r, seq_iterator_t* siterator) {
-  seq_iterator_t* aiterator;
+/* An allocator for the library drawing on an APR pool */
 
-  aiterator = apr_pcalloc(r->pool, sizeof(seq_iterator_t));
-
-  memcpy( (void*)aiterator, (void *)siterator, sizeof(seq_iterator_t) );
-
-  aiterator->locations = apr_pmemdup(r->pool,
-				     (void*)siterator->locations,
-				     sizeof(seq_location_t)*tark_iterator_locations_count(siterator));
-  aiterator->seq_name = apr_pstrdup(r->pool,
-				    (void*)siterator->seq_name);
-  aiterator->location_str = apr_pstrdup(r->pool, siterator->location_str);
-  aiterator->checksum = apr_pstrdup(r->pool, siterator->checksum);
-
-  return aiterator;
+void* pool_allocate(void* pool, size_t size) {
+  return apr_palloc((apr_pool_t*)pool, size);
 }
 
 int metadata_handler(request_rec* r, const char* checksum, checksum_obj* checksum_holder) {
@@ -777,14 +988,13 @@ int metadata_handler(request_rec* r, const char* checksum, checksum_obj* checksu
   svr = ap_get_module_config(r->server->module_config, &faidx_module);
   seqfile = files_mgr_use_seqfile(svr->files, checksum_holder->file);
 
-  /* Abstraction needed here if we ever want to support different sequence backends */
-  int i = faidx_seq_len((faidx_t*)seqfile->file_ptr, checksum_holder->sequence->name);
+  apr_int64_t i = files_mgr_seq_len(seqfile, checksum_holder->sequence);
 
   /* Start JSON header */
   ap_rputs( "{\n  \"metadata\" : {\n", r );
 
   ap_rprintf( r, "    \"id\" : \"%s\",\n", checksum );
-  ap_rprintf( r, "    \"length\" : %d,\n", i );
+  ap_rprintf( r, "    \"length\" : %" APR_INT64_T_FMT ",\n", i );
 
   ap_rputs( "    \"aliases\" : [\n", r );
 
@@ -802,14 +1012,169 @@ int metadata_handler(request_rec* r, const char* checksum, checksum_obj* checksu
 }
 
 int info_handler(request_rec* r) {
+  mod_Faidx_svr_cfg* svr
+    = ap_get_module_config(r->server->module_config, &faidx_module);
+  seq_block_cache_t* blocks = svr->files->blocks;
 
   ap_set_content_type(r, "application/json");
 
   ap_rputs( "{\n  \"service\" : {\n", r );
   ap_rputs( "    \"circular_supported\" : false,\n", r );
   ap_rputs( "    \"algorithms\" : [\"md5\", \"trunc512\"],\n", r );
-  ap_rputs( "    \"supported_api_versions\" : [\"0.3\"],\n", r );
-  ap_rputs( "  }\n}\n", r );
+  ap_rputs( "    \"supported_api_versions\" : [\"0.3\"]\n", r );
+  ap_rputs( "  }", r );
+
+  /* How well the decompressed block caches are doing, this
+     process's own and the one all the processes share */
+  if(blocks != NULL) {
+    ap_rputs( ",\n  \"block_cache\" : {\n", r );
+    ap_rprintf( r, "    \"bytes\" : %" APR_SIZE_T_FMT ",\n", blocks->used );
+    ap_rprintf( r, "    \"hits\" : %" APR_UINT64_T_FMT ",\n", blocks->hits );
+    ap_rprintf( r, "    \"misses\" : %" APR_UINT64_T_FMT ",\n", blocks->misses );
+    ap_rprintf( r, "    \"evictions\" : %" APR_UINT64_T_FMT, blocks->evictions );
+
+    if(blocks->shared != NULL) {
+      ap_rputs( ",\n    \"shared\" : {\n", r );
+      ap_rprintf( r, "      \"hits\" : %" APR_UINT64_T_FMT ",\n", blocks->shared->hits );
+      ap_rprintf( r, "      \"misses\" : %" APR_UINT64_T_FMT ",\n", blocks->shared->misses );
+      ap_rprintf( r, "      \"stores\" : %" APR_UINT64_T_FMT ",\n", blocks->shared->stores );
+      ap_rprintf( r, "      \"evictions\" : %" APR_UINT64_T_FMT ",\n", blocks->shared->evictions );
+      ap_rprintf( r, "      \"busy\" : %" APR_UINT64_T_FMT "\n", blocks->shared->busy );
+      ap_rputs( "    }", r );
+    }
+
+    ap_rputs( "\n  }", r );
+  }
+
+  ap_rputs( "\n}\n", r );
+
+  return OK;
+}
+
+/* Scan the iterator's range for open reading frames on both
+   strands and send back where they are, as JSON, FASTA records of
+   their proteins, or tab separated lines for plain text.
+
+   The range must be a single stretch of the sequence so the ORFs
+   have coordinates on it, 0 based half open like start and end.
+   min_length is the shortest ORF wanted in amino acids and
+   proteins=1 adds their sequences to the JSON and text.
+*/
+
+int orfs_handler(request_rec* r, seq_iterator_t* siterator, int accept, apr_hash_t* formdata) {
+  seq_orf_t* orfs;
+  const char* str;
+  char* endp;
+  char* seq;
+  char* rc;
+  char* frames[6];
+  tark_allocator_t pool_alloc = { pool_allocate, NULL, r->pool };
+  apr_uint64_t offset;
+  apr_int64_t min_length = DEFAULT_ORF_MIN_LENGTH;
+  int proteins = 0;
+  int len, norfs, i;
+
+  if(siterator->nlocations != 1) {
+    return HTTP_BAD_REQUEST;
+  }
+
+  if(siterator->seq_length > MAX_FRAMES_LENGTH) {
+    return HTTP_REQUEST_ENTITY_TOO_LARGE;
+  }
+
+  str = apr_hash_get(formdata, "min_length", APR_HASH_KEY_STRING);
+  if(str != NULL) {
+    min_length = apr_strtoi64(str, &endp, 10);
+    if(*str == '\0' || *endp != '\0' || min_length < 1 || min_length > siterator->seq_length / 3) {
+      return HTTP_BAD_REQUEST;
+    }
+  }
+
+  str = apr_hash_get(formdata, "proteins", APR_HASH_KEY_STRING);
+  if(str != NULL) {
+    if(strcmp(str, "1") && strcmp(str, "0")) {
+      return HTTP_BAD_REQUEST;
+    }
+    proteins = (*str == '1');
+  }
+
+  /* Both strands come from the forward one, fetched once */
+  len = (int)siterator->seq_length;
+  seq = apr_palloc(r->pool, len + 1);
+  rc = apr_palloc(r->pool, len + 1);
+  for(i = 0; i < 6; i++) {
+    frames[i] = apr_palloc(r->pool, len / 3 + 1);
+  }
+
+  siterator->strand = 1;
+  tark_iterator_set_line_length(siterator, 0);
+  tark_iterator_fetch_seq(siterator, &len, seq);
+
+  norfs = tark_find_orfs(seq, len, siterator->code, min_length, rc, frames, &orfs, &pool_alloc);
+  if(norfs < 0) {
+    return HTTP_INTERNAL_SERVER_ERROR;
+  }
+
+  offset = siterator->locations[0].start;
+
+  if(accept == CONTENT_FASTA) {
+    ap_set_content_type(r, "text/x-fasta");
+  } else if(accept == CONTENT_JSON) {
+    ap_set_content_type(r, "application/json");
+    ap_rprintf( r, "{\n  \"checksum\" : \"%s\",\n", siterator->checksum );
+    ap_rprintf( r, "  \"location\" : \"%s:%" APR_UINT64_T_FMT "-%" APR_UINT64_T_FMT "\",\n", siterator->seq_name, offset, offset + len );
+    ap_rprintf( r, "  \"min_length\" : %d,\n", (int)min_length );
+    ap_rputs( "  \"orfs\" : [", r );
+  } else {
+    ap_set_content_type(r, "text/plain; charset=us-ascii");
+  }
+
+  for(i = 0; i < norfs; i++) {
+    if(accept == CONTENT_FASTA) {
+      ap_rprintf( r, ">%s [%s:%" APR_UINT64_T_FMT "-%" APR_UINT64_T_FMT ":%d] frame=%+d length=%u\n",
+		  siterator->checksum,
+		  siterator->seq_name,
+		  offset + orfs[i].start,
+		  offset + orfs[i].end,
+		  orfs[i].frame > 0 ? 1 : -1,
+		  orfs[i].frame,
+		  orfs[i].length );
+      ap_rwrite( orfs[i].protein, orfs[i].length, r );
+      ap_rputs( "\n", r );
+
+    } else if(accept == CONTENT_JSON) {
+      ap_rprintf( r, "%s\n    {\n      \"start\" : %" APR_UINT64_T_FMT ",\n      \"end\" : %" APR_UINT64_T_FMT ",\n      \"strand\" : %d,\n      \"frame\" : %d,\n      \"length\" : %u",
+		  i > 0 ? "," : "",
+		  offset + orfs[i].start,
+		  offset + orfs[i].end,
+		  orfs[i].frame > 0 ? 1 : -1,
+		  orfs[i].frame,
+		  orfs[i].length );
+      if(proteins) {
+	ap_rputs( ",\n      \"seq\" : \"", r );
+	ap_rwrite( orfs[i].protein, orfs[i].length, r );
+	ap_rputs( "\"", r );
+      }
+      ap_rputs( "\n    }", r );
+
+    } else {
+      ap_rprintf( r, "%" APR_UINT64_T_FMT "\t%" APR_UINT64_T_FMT "\t%d\t%d\t%u",
+		  offset + orfs[i].start,
+		  offset + orfs[i].end,
+		  orfs[i].frame > 0 ? 1 : -1,
+		  orfs[i].frame,
+		  orfs[i].length );
+      if(proteins) {
+	ap_rputs( "\t", r );
+	ap_rwrite( orfs[i].protein, orfs[i].length, r );
+      }
+      ap_rputs( "\n", r );
+    }
+  }
+
+  if(accept == CONTENT_JSON) {
+    ap_rputs( norfs > 0 ? "\n  ]\n}\n" : "]\n}\n", r );
+  }
 
   return OK;
 }
@@ -822,7 +1187,11 @@ int info_handler(request_rec* r) {
    <seqfile /path/file.faa>
      Seq 1 md5  abcdef1234
      Seq 1 sha1 987654abcd
+     GeneticCode 2
   </seqfile>
+
+   GeneticCode is optional, the NCBI genetic code to translate
+   the file's sequences with, 1 (standard) if not given.
 */
 
 static const char* seqfile_section(cmd_parms * cmd, void * dummy, const char * arg) {
@@ -836,6 +1205,7 @@ static const char* seqfile_section(cmd_parms * cmd, void * dummy, const char * a
   checksum_obj* checksum_holder;
   int line_no = 0;
   int rv;
+  apr_int64_t code;
   char* return_str;
   char line[MAX_STRING_LEN]; /* expected by ap_cfg_getline */
   /* Cast the module config for convenience */
@@ -866,7 +1236,7 @@ static const char* seqfile_section(cmd_parms * cmd, void * dummy, const char * a
 	return NULL;
   }
 
-  checksum = files_mgr_add_seqfile(cfg->files, file, FM_FAIDX);
+  checksum = files_mgr_add_seqfile(cfg->files, file, files_mgr_file_type(file));
 
 #ifdef DEBUG
   files_mgr_print_md5(checksum);
@@ -942,6 +1312,15 @@ static const char* seqfile_section(cmd_parms * cmd, void * dummy, const char * a
       if(rv != APR_SUCCESS) {
 	apr_psprintf(cmd->pool, "Seq %s not found in Seqfile %s", seqname, file);
       }
+    } else if( !strcasecmp(first, GENETIC_CODE_DIRECTIVE) ) {
+      /* The genetic code translations from this file use by default */
+      first = ap_getword_conf_nc(cmd->temp_pool, &ptr);
+      code = apr_strtoi64(first, &endp, 10);
+      if(*first == '\0' || *endp != '\0' || code < 1 || code > INT_MAX || seq_genetic_code((int)code) == NULL) {
+	return apr_psprintf(cmd->pool, "Unknown genetic code %s on line %d of <Seqfile %s>", first, line_no, file);
+      }
+
+      files_mgr_get_seqfile(cfg->files, checksum)->genetic_code = (int)code;
     }
   }
 
@@ -1020,6 +1399,40 @@ static const char* modFaidx_init_cachesize(cmd_parms* cmd, void* cfg, const char
 
 }
 
+static const char* modFaidx_init_blockcache(cmd_parms* cmd, void* cfg, const char* blockcache) {
+  apr_int64_t size;
+  char* end;
+  mod_Faidx_svr_cfg* svr
+    = ap_get_module_config(cmd->server->module_config, &faidx_module);
+
+  size = apr_strtoi64(blockcache, &end, 10);
+  if(size < 0 || end == blockcache || *end != '\0') {
+    return apr_pstrcat(cmd->pool, cmd->cmd->name,
+		       " blockcache seems to be nonsense, should be bytes, 0 for none", NULL);
+  }
+
+  files_mgr_resize_block_cache(svr->files, (size_t)size);
+
+  return OK;
+}
+
+static const char* modFaidx_init_sharedblockcache(cmd_parms* cmd, void* cfg, const char* blockcache) {
+  apr_int64_t size;
+  char* end;
+  mod_Faidx_svr_cfg* svr
+    = ap_get_module_config(cmd->server->module_config, &faidx_module);
+
+  size = apr_strtoi64(blockcache, &end, 10);
+  if(size < 0 || end == blockcache || *end != '\0') {
+    return apr_pstrcat(cmd->pool, cmd->cmd->name,
+		       " sharedblockcache seems to be nonsense, should be bytes, 0 for none", NULL);
+  }
+
+  svr->shared_blockcache = (apr_size_t)size;
+
+  return OK;
+}
+
 /* Add error reporting?  "Could not load model" etc */
 
 static int mod_Faidx_hook_post_config(apr_pool_t *pconf, apr_pool_t *plog,
@@ -1087,6 +1500,26 @@ static int mod_Faidx_hook_post_config(apr_pool_t *pconf, apr_pool_t *plog,
   }
 #endif
 
+  /* Bind the sequence kernels for this CPU before any children are
+     forked, they inherit the choice */
+  seq_kernels_init();
+  ap_log_error(APLOG_MARK, APLOG_INFO, 0, s,
+	       "Using %s sequence kernels", seq_kernels_impl());
+
+  /* The shared block cache has to be in place before the children
+     are forked so they all map it. It goes with pconf, a graceful
+     restart starts a new one. Without it each child has only its
+     own blocks. */
+  if(svr->shared_blockcache > 0) {
+    if(apr_shm_create(&(svr->shm), svr->shared_blockcache, NULL, pconf) != APR_SUCCESS ||
+       files_mgr_share_blocks(svr->files, apr_shm_baseaddr_get(svr->shm),
+			      apr_shm_size_get(svr->shm)) != APR_SUCCESS) {
+      ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s,
+		   "Couldn't set up %" APR_SIZE_T_FMT " bytes of shared block cache, children will only have their own",
+		   svr->shared_blockcache);
+    }
+  }
+
   /* Register the faidx objects for cleanup when the module exits,
      needed for graceful reloads to not leak memory */
   apr_pool_cleanup_register(pconf, svr, &Faidx_cleanup_fais, apr_pool_cleanup_null);
@@ -1466,8 +1899,8 @@ void print_iterator(request_rec* r, seq_iterator_t* siterator) {
   ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "__ITERATOR__");
   ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "seq_name: %s", siterator->seq_name);
   ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "location_str: %s", siterator->location_str);
-  ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "seq_length: %d", siterator->seq_length);
-  ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "seq_iterated: %d", siterator->seq_iterated);
+  ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "seq_length: %" APR_UINT64_T_FMT, siterator->seq_length);
+  ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "seq_iterated: %" APR_UINT64_T_FMT, siterator->seq_iterated);
   ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "line_length: %d", siterator->line_length);
   ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "strand: %d", siterator->strand);
   ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "translate: %d", siterator->translate);
@@ -1475,8 +1908,8 @@ void print_iterator(request_rec* r, seq_iterator_t* siterator) {
 
   for(i = 0; i < tark_iterator_locations_count(siterator); i++) {
     ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "Seq Location %d", i);
-    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "start: %d", siterator->locations[0].start);
-    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "end: %d", siterator->locations[0].end);
-    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "length: %d", siterator->locations[0].length);
+    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "start: %" APR_UINT64_T_FMT, siterator->locations[0].start);
+    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "end: %" APR_UINT64_T_FMT, siterator->locations[0].end);
+    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "length: %" APR_UINT64_T_FMT, siterator->locations[0].length);
   }
 }
@@ -0,0 +1,306 @@
+/* Decompressed block cache
+
+ An LRU cache of decompressed BGZF blocks, keyed by the file
+ they came from and their compressed offset, holding no more
+ than a byte budget of data, in front of an optional cache
+ shared between processes. See seq_block_cache.h.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "seq_block_cache.h"
+
+#define SEQ_BLOCK_HASH(cache, file_id, offset) \
+  ((((offset) ^ ((file_id) * 0xC2B2AE3D27D4EB4FULL)) * 0x9E3779B97F4A7C15ULL >> 32) & ((cache)->nbuckets - 1))
+
+/* Create a cache holding up to budget bytes of decompressed
+   data, a budget of 0 makes a cache that never holds anything.
+
+   Returns NULL if we're out of memory.
+ */
+
+seq_block_cache_t* seq_block_cache_create(size_t budget) {
+  seq_block_cache_t* cache;
+
+  cache = calloc(1, sizeof(seq_block_cache_t));
+  if(cache == NULL) {
+    return NULL;
+  }
+
+  cache->buckets = calloc(SEQ_BLOCK_BUCKETS, sizeof(seq_block_t*));
+  if(cache->buckets == NULL) {
+    free(cache);
+    return NULL;
+  }
+
+  cache->nbuckets = SEQ_BLOCK_BUCKETS;
+  cache->budget = budget;
+
+  return cache;
+}
+
+void seq_block_cache_destroy(seq_block_cache_t* cache) {
+  seq_block_t* block;
+  seq_block_t* next;
+
+  if(cache == NULL) {
+    return;
+  }
+
+  for(block = cache->head; block != NULL; block = next) {
+    next = block->next;
+    free(block);
+  }
+
+  free(cache->buckets);
+  free(cache->bounce);
+  free(cache);
+}
+
+/* Change the budget, dropping the least recently used blocks
+   until what's held fits in it */
+
+void seq_block_cache_resize(seq_block_cache_t* cache, size_t budget) {
+  seq_block_t* block;
+
+  cache->budget = budget;
+
+  while(cache->used > cache->budget) {
+    block = cache->tail;
+    _seq_block_cache_unlink(cache, block);
+    free(block);
+    cache->evictions++;
+  }
+}
+
+/* Look for blocks we don't hold in a cache shared with other
+   processes, and put the blocks we're given there too. NULL
+   goes back to being on our own. */
+
+void seq_block_cache_share(seq_block_cache_t* cache, seq_shared_cache_t* shared) {
+  cache->shared = shared;
+}
+
+/* Find the block file_id has at offset, making it the most
+   recently used. If we don't hold it but the shared cache does
+   it's copied from there, and held if it fits. The data is only
+   good until the next get, put or resize.
+
+   Returns the data and sets len, or NULL if it isn't held.
+ */
+
+const char* seq_block_cache_get(seq_block_cache_t* cache, uint64_t file_id, uint64_t offset, size_t* len) {
+  seq_block_t* block;
+  const char* data;
+  int64_t shared_len;
+
+  for(block = cache->buckets[SEQ_BLOCK_HASH(cache, file_id, offset)];
+      block != NULL;
+      block = block->chain) {
+    if(block->file_id == file_id && block->offset == offset) {
+      break;
+    }
+  }
+
+  if(block == NULL) {
+    cache->misses++;
+
+    if(cache->shared == NULL) {
+      return NULL;
+    }
+
+    if(cache->bounce == NULL) {
+      cache->bounce = malloc(SEQ_BLOCK_MAX);
+      if(cache->bounce == NULL) {
+	return NULL;
+      }
+    }
+
+    shared_len = seq_shared_cache_get(cache->shared, file_id, offset, cache->bounce, SEQ_BLOCK_MAX);
+    if(shared_len < 0) {
+      return NULL;
+    }
+
+    *len = (size_t)shared_len;
+    data = _seq_block_cache_store(cache, file_id, offset, cache->bounce, *len);
+
+    return data != NULL ? data : cache->bounce;
+  }
+
+  /* To the front of the LRU list */
+  if(block != cache->head) {
+    block->prev->next = block->next;
+    if(block->next != NULL) {
+      block->next->prev = block->prev;
+    } else {
+      cache->tail = block->prev;
+    }
+
+    block->prev = NULL;
+    block->next = cache->head;
+    cache->head->prev = block;
+    cache->head = block;
+  }
+
+  cache->hits++;
+  *len = block->len;
+  return block->data;
+}
+
+/* Copy len bytes of a block just decompressed in to the cache,
+   and the shared cache if there is one. The caller must have
+   checked the block isn't already held.
+
+   Returns our copy, or NULL if we didn't keep one (bigger than
+   the budget or out of memory), the caller still has its own
+   copy to use.
+ */
+
+const char* seq_block_cache_put(seq_block_cache_t* cache, uint64_t file_id, uint64_t offset, const char* data, size_t len) {
+  if(cache->shared != NULL) {
+    seq_shared_cache_put(cache->shared, file_id, offset, data, len);
+  }
+
+  return _seq_block_cache_store(cache, file_id, offset, data, len);
+}
+
+/* Copy a block in to our own cache, making room by dropping the
+   least recently used blocks.
+
+   Returns our copy, or NULL if it wasn't kept.
+ */
+
+const char* _seq_block_cache_store(seq_block_cache_t* cache, uint64_t file_id, uint64_t offset, const char* data, size_t len) {
+  seq_block_t* block;
+  uint64_t bucket;
+
+  if(len > cache->budget || len > SEQ_BLOCK_MAX) {
+    return NULL;
+  }
+
+  while(cache->used + len > cache->budget) {
+    block = cache->tail;
+    _seq_block_cache_unlink(cache, block);
+    free(block);
+    cache->evictions++;
+  }
+
+  /* Keep the chains short, a failure to grow only costs speed */
+  if(cache->nblocks >= cache->nbuckets) {
+    _seq_block_cache_grow(cache);
+  }
+
+  block = malloc(sizeof(seq_block_t) + len);
+  if(block == NULL) {
+    return NULL;
+  }
+
+  block->file_id = file_id;
+  block->offset = offset;
+  block->len = len;
+  block->data = (char*)(block + 1);
+  memcpy(block->data, data, len);
+
+  bucket = SEQ_BLOCK_HASH(cache, file_id, offset);
+  block->chain = cache->buckets[bucket];
+  cache->buckets[bucket] = block;
+
+  block->prev = NULL;
+  block->next = cache->head;
+  if(cache->head != NULL) {
+    cache->head->prev = block;
+  } else {
+    cache->tail = block;
+  }
+  cache->head = block;
+
+  cache->used += len;
+  cache->nblocks++;
+
+  return block->data;
+}
+
+/* Drop every block of a file we hold, when it's closed. Blocks
+   in the shared cache are left for the other processes. */
+
+void seq_block_cache_drop(seq_block_cache_t* cache, uint64_t file_id) {
+  seq_block_t* block;
+  seq_block_t* next;
+
+  for(block = cache->head; block != NULL; block = next) {
+    next = block->next;
+    if(block->file_id == file_id) {
+      _seq_block_cache_unlink(cache, block);
+      free(block);
+    }
+  }
+}
+
+/* Take a block out of the LRU list and its hash bucket, the
+   caller frees it */
+
+void _seq_block_cache_unlink(seq_block_cache_t* cache, seq_block_t* block) {
+  seq_block_t** link;
+
+  for(link = &(cache->buckets[SEQ_BLOCK_HASH(cache, block->file_id, block->offset)]);
+      *link != block;
+      link = &((*link)->chain));
+  *link = block->chain;
+
+  if(block->prev != NULL) {
+    block->prev->next = block->next;
+  } else {
+    cache->head = block->next;
+  }
+
+  if(block->next != NULL) {
+    block->next->prev = block->prev;
+  } else {
+    cache->tail = block->prev;
+  }
+
+  cache->used -= block->len;
+  cache->nblocks--;
+}
+
+/* Double the hash buckets and rehash every block.
+
+   Returns 1 on success, 0 if we're out of memory, the cache
+   carries on with the buckets it has.
+ */
+
+int _seq_block_cache_grow(seq_block_cache_t* cache) {
+  seq_block_t** buckets;
+  seq_block_t* block;
+  uint64_t bucket;
+
+  buckets = calloc(cache->nbuckets * 2, sizeof(seq_block_t*));
+  if(buckets == NULL) {
+    return 0;
+  }
+
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->nbuckets *= 2;
+
+  for(block = cache->head; block != NULL; block = block->next) {
+    bucket = SEQ_BLOCK_HASH(cache, block->file_id, block->offset);
+    block->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = block;
+  }
+
+  return 1;
+}
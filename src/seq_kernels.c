@@ -0,0 +1,743 @@
+/* Sequence kernels
+
+ Tight loops over buffers of bases, reverse complementing and
+ the like, with SIMD versions where the compiler target allows
+ and plain C versions otherwise.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <string.h>
+#include "seq_kernels.h"
+
+/* On x86 the SIMD kernels are always built, with the compiler told
+   per function which instruction set to use, and picked at run time */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEQ_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+const unsigned char seq_complement[256] =
+{
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+  0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+  0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+  /* @     A     B     C     D     E     F     G     H     I     J     K     L     M     N     O */
+  0x40,  'T',  'V',  'G',  'H',  'E',  'F',  'C',  'D',  'I',  'J',  'M',  'L',  'K',  'N',  'O',
+  /* P     Q     R     S     T     U     V     W     X     Y     Z     [     \     ]     ^     _ */
+   'P',  'Q',  'Y',  'S',  'A',  'A',  'B',  'W',  'X',  'R',  'Z', 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+  /* `     a     b     c     d     e     f     g     h     i     j     k     l     m     n     o */
+  0x60,  't',  'v',  'g',  'h',  'e',  'f',  'c',  'd',  'i',  'j',  'm',  'l',  'k',  'n',  'o',
+  /* p     q     r     s     t     u     v     w     x     y     z     {     |     }     ~      */
+   'p',  'q',  'y',  's',  'a',  'a',  'b',  'w',  'x',  'r',  'z', 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+  0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+  0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+  0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+  0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+  0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+  0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+  0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+  0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+
+/* The SIMD versions complement letters through the low five bits
+   of the byte, which are the same for upper and lower case, and
+   leave the case bits alone. Index 1 is A/a, 26 is Z/z. These two
+   tables are the low five bits of the complement for index 0-15
+   and 16-31. */
+
+#define SEQ_COMP_LO 0, 20, 22,  7,  8,  5,  6,  3,  4,  9, 10, 13, 12, 11, 14, 15
+#define SEQ_COMP_HI 16, 17, 25, 19,  1,  1,  2, 23, 24, 18, 26, 27, 28, 29, 30, 31
+#define SEQ_REVERSE 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0
+
+#ifdef SEQ_KERNELS_X86
+
+/* Each instruction set's kernels are compiled for it whatever the
+   build's -march, and only called once seq_kernels_init has seen the
+   CPU supports it */
+
+#define SEQ_SSE41 __attribute__((target("sse4.1")))
+#define SEQ_AVX2 __attribute__((target("avx2")))
+#define SEQ_AVX512 __attribute__((target("avx512bw")))
+
+/* SSE4.1, 16 bytes at a time */
+
+static inline SEQ_SSE41 __m128i _seq_revcomp_block_sse41(__m128i v) {
+  const __m128i rev = _mm_setr_epi8(SEQ_REVERSE);
+  const __m128i lo = _mm_setr_epi8(SEQ_COMP_LO);
+  const __m128i hi = _mm_setr_epi8(SEQ_COMP_HI);
+  __m128i idx, comp, lower, letter;
+
+  v = _mm_shuffle_epi8(v, rev);
+
+  /* Look up both halves of the table, pick by bit 4 of the index */
+  idx = _mm_and_si128(v, _mm_set1_epi8(0x1F));
+  comp = _mm_blendv_epi8(_mm_shuffle_epi8(lo, idx),
+			 _mm_shuffle_epi8(hi, idx),
+			 _mm_slli_epi16(idx, 3));
+
+  /* Only letters are complemented */
+  lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			 _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+
+  comp = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi8((char)0xE0)), comp);
+  return _mm_blendv_epi8(v, comp, letter);
+}
+
+static inline SEQ_SSE41 __m128i _seq_transform_block_sse41(__m128i v, int flags) {
+  __m128i lower, letter;
+
+  if(flags & SEQ_XFORM_REVCOMP) {
+    v = _seq_revcomp_block_sse41(v);
+  }
+
+  if(flags & SEQ_XFORM_HARDMASK) {
+    lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+			  _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), v));
+    v = _mm_blendv_epi8(v, _mm_set1_epi8('N'), lower);
+  }
+
+  if(flags & (SEQ_XFORM_UPPER | SEQ_XFORM_LOWER)) {
+    lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			   _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+    letter = _mm_and_si128(letter, _mm_set1_epi8(0x20));
+
+    if(flags & SEQ_XFORM_UPPER) {
+      v = _mm_andnot_si128(letter, v);
+    } else {
+      v = _mm_or_si128(v, letter);
+    }
+  }
+
+  return v;
+}
+
+#define SEQ_TARGET SEQ_SSE41
+#define SEQ_NAME(fn) fn##_sse41
+#define SEQ_SHORT(fn) fn##_scalar
+#define SEQ_VEC __m128i
+#define SEQ_BLOCK 16
+#define SEQ_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define SEQ_STORE(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#include "seq_kernels_simd.h"
+
+/* AVX2, 32 bytes at a time */
+
+static inline SEQ_AVX2 __m256i _seq_revcomp_block_avx2(__m256i v) {
+  const __m256i rev = _mm256_setr_epi8(SEQ_REVERSE, SEQ_REVERSE);
+  const __m256i lo = _mm256_setr_epi8(SEQ_COMP_LO, SEQ_COMP_LO);
+  const __m256i hi = _mm256_setr_epi8(SEQ_COMP_HI, SEQ_COMP_HI);
+  __m256i idx, comp, lower, letter;
+
+  /* Reverse each 128 bit lane, then swap the lanes */
+  v = _mm256_shuffle_epi8(v, rev);
+  v = _mm256_permute4x64_epi64(v, 0x4E);
+
+  /* Look up both halves of the table, pick by bit 4 of the index */
+  idx = _mm256_and_si256(v, _mm256_set1_epi8(0x1F));
+  comp = _mm256_blendv_epi8(_mm256_shuffle_epi8(lo, idx),
+			    _mm256_shuffle_epi8(hi, idx),
+			    _mm256_slli_epi16(idx, 3));
+
+  /* Only letters are complemented */
+  lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+			    _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+
+  comp = _mm256_or_si256(_mm256_and_si256(v, _mm256_set1_epi8((char)0xE0)), comp);
+  return _mm256_blendv_epi8(v, comp, letter);
+}
+
+static inline SEQ_AVX2 __m256i _seq_transform_block_avx2(__m256i v, int flags) {
+  __m256i lower, letter;
+
+  if(flags & SEQ_XFORM_REVCOMP) {
+    v = _seq_revcomp_block_avx2(v);
+  }
+
+  if(flags & SEQ_XFORM_HARDMASK) {
+    lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+			     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+    v = _mm256_blendv_epi8(v, _mm256_set1_epi8('N'), lower);
+  }
+
+  if(flags & (SEQ_XFORM_UPPER | SEQ_XFORM_LOWER)) {
+    lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+			      _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    letter = _mm256_and_si256(letter, _mm256_set1_epi8(0x20));
+
+    if(flags & SEQ_XFORM_UPPER) {
+      v = _mm256_andnot_si256(letter, v);
+    } else {
+      v = _mm256_or_si256(v, letter);
+    }
+  }
+
+  return v;
+}
+
+#define SEQ_TARGET SEQ_AVX2
+#define SEQ_NAME(fn) fn##_avx2
+#define SEQ_SHORT(fn) fn##_sse41
+#define SEQ_VEC __m256i
+#define SEQ_BLOCK 32
+#define SEQ_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define SEQ_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#include "seq_kernels_simd.h"
+
+/* AVX-512BW, 64 bytes at a time, the letter tests are mask
+   registers rather than vectors */
+
+static inline SEQ_AVX512 __mmask64 _seq_letters_avx512(__m512i v) {
+  __m512i lower = _mm512_or_si512(v, _mm512_set1_epi8(0x20));
+
+  return _mm512_cmplt_epu8_mask(_mm512_sub_epi8(lower, _mm512_set1_epi8('a')),
+				_mm512_set1_epi8(26));
+}
+
+static inline SEQ_AVX512 __m512i _seq_revcomp_block_avx512(__m512i v) {
+  const __m512i rev = _mm512_broadcast_i32x4(_mm_setr_epi8(SEQ_REVERSE));
+  const __m512i lo = _mm512_broadcast_i32x4(_mm_setr_epi8(SEQ_COMP_LO));
+  const __m512i hi = _mm512_broadcast_i32x4(_mm_setr_epi8(SEQ_COMP_HI));
+  __m512i idx, comp;
+
+  /* Reverse each 128 bit lane, then the order of the lanes */
+  v = _mm512_shuffle_epi8(v, rev);
+  v = _mm512_permutexvar_epi64(_mm512_setr_epi64(6, 7, 4, 5, 2, 3, 0, 1), v);
+
+  /* Look up both halves of the table, pick by bit 4 of the index */
+  idx = _mm512_and_si512(v, _mm512_set1_epi8(0x1F));
+  comp = _mm512_mask_blend_epi8(_mm512_test_epi8_mask(idx, _mm512_set1_epi8(0x10)),
+				_mm512_shuffle_epi8(lo, idx),
+				_mm512_shuffle_epi8(hi, idx));
+
+  /* Only letters are complemented */
+  comp = _mm512_or_si512(_mm512_and_si512(v, _mm512_set1_epi8((char)0xE0)), comp);
+  return _mm512_mask_blend_epi8(_seq_letters_avx512(v), v, comp);
+}
+
+static inline SEQ_AVX512 __m512i _seq_transform_block_avx512(__m512i v, int flags) {
+  __m512i fold;
+
+  if(flags & SEQ_XFORM_REVCOMP) {
+    v = _seq_revcomp_block_avx512(v);
+  }
+
+  if(flags & SEQ_XFORM_HARDMASK) {
+    v = _mm512_mask_blend_epi8(_mm512_cmplt_epu8_mask(_mm512_sub_epi8(v, _mm512_set1_epi8('a')),
+						      _mm512_set1_epi8(26)),
+			       v, _mm512_set1_epi8('N'));
+  }
+
+  if(flags & (SEQ_XFORM_UPPER | SEQ_XFORM_LOWER)) {
+    fold = _mm512_maskz_mov_epi8(_seq_letters_avx512(v), _mm512_set1_epi8(0x20));
+
+    if(flags & SEQ_XFORM_UPPER) {
+      v = _mm512_andnot_si512(fold, v);
+    } else {
+      v = _mm512_or_si512(v, fold);
+    }
+  }
+
+  return v;
+}
+
+#define SEQ_TARGET SEQ_AVX512
+#define SEQ_NAME(fn) fn##_avx512
+#define SEQ_SHORT(fn) fn##_avx2
+#define SEQ_VEC __m512i
+#define SEQ_BLOCK 64
+#define SEQ_LOAD(p) _mm512_loadu_si512((const void*)(p))
+#define SEQ_STORE(p, v) _mm512_storeu_si512((void*)(p), v)
+#include "seq_kernels_simd.h"
+
+#endif
+
+void _seq_revcomp_scalar(char* dest, const char* src, size_t len) {
+  const unsigned char* p = (const unsigned char*)src + len;
+
+  while(len--) {
+    *dest++ = seq_complement[*--p];
+  }
+}
+
+void _seq_revcomp_inplace_scalar(char* seq, size_t len) {
+  unsigned char* i = (unsigned char*)seq;
+  unsigned char* k = i + len;
+  unsigned char tmp;
+
+  while(i + 1 < k) {
+    tmp = seq_complement[*--k];
+    *k = seq_complement[*i];
+    *i++ = tmp;
+  }
+
+  if(i < k) {
+    *i = seq_complement[*i];
+  }
+}
+
+void _seq_transform_scalar(char* dest, const char* src, size_t len, int flags) {
+  const unsigned char* p = (const unsigned char*)src;
+  unsigned char c;
+  size_t i;
+
+  if(flags == SEQ_XFORM_REVCOMP) {
+    _seq_revcomp_scalar(dest, src, len);
+    return;
+  }
+
+  for(i = 0; i < len; i++) {
+    if(flags & SEQ_XFORM_REVCOMP) {
+      c = seq_complement[ p[len - 1 - i] ];
+    } else {
+      c = p[i];
+    }
+
+    /* Soft masked, lower case, letters are masked out */
+    if((flags & SEQ_XFORM_HARDMASK) && (unsigned char)(c - 'a') < 26) {
+      c = 'N';
+    }
+
+    /* Only letters change case */
+    if((unsigned char)((c | 0x20) - 'a') < 26) {
+      if(flags & SEQ_XFORM_UPPER) {
+	c &= ~0x20;
+      } else if(flags & SEQ_XFORM_LOWER) {
+	c |= 0x20;
+      }
+    }
+
+    dest[i] = c;
+  }
+}
+
+/* Translation
+
+   Each base has a code, A 0, C 1, G 2, T/U 3 and anything else
+   0x54. A codon packs in to a 7 bit index, the first base in bits
+   4-5, second in 2-3 and third in 0-1. 0x54 sets bit 6 wherever it's
+   shifted to, so if any of the three is ambiguous the index lands
+   in the X half of seq_codon_table. */
+
+const unsigned char seq_codon_base[256] =
+{
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  /* @     A     B     C     D     E     F     G     H     I     J     K     L     M     N     O */
+  0x54,    0, 0x54,    1, 0x54, 0x54, 0x54,    2, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  /* P     Q     R     S     T     U     V     W     X     Y     Z     [     \     ]     ^     _ */
+  0x54, 0x54, 0x54, 0x54,    3,    3, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  /* `     a     b     c     d     e     f     g     h     i     j     k     l     m     n     o */
+  0x54,    0, 0x54,    1, 0x54, 0x54, 0x54,    2, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  /* p     q     r     s     t     u     v     w     x     y     z     {     |     }     ~      */
+  0x54, 0x54, 0x54, 0x54,    3,    3, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54
+};
+
+/* The code of each base's complement */
+const unsigned char seq_codon_base_comp[256] =
+{
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  /* @     A     B     C     D     E     F     G     H     I     J     K     L     M     N     O */
+  0x54,    3, 0x54,    2, 0x54, 0x54, 0x54,    1, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  /* P     Q     R     S     T     U     V     W     X     Y     Z     [     \     ]     ^     _ */
+  0x54, 0x54, 0x54, 0x54,    0,    0, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  /* `     a     b     c     d     e     f     g     h     i     j     k     l     m     n     o */
+  0x54,    3, 0x54,    2, 0x54, 0x54, 0x54,    1, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  /* p     q     r     s     t     u     v     w     x     y     z     {     |     }     ~      */
+  0x54, 0x54, 0x54, 0x54,    0,    0, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54,
+  0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54
+};
+
+/* The codon table of each NCBI genetic code, generated from
+   genetic_codes.txt at build time. Each is the code's amino acid for
+   every codon, then X for all the ambiguous ones. */
+#include "seq_genetic_codes.h"
+
+const char* const seq_codon_table = seq_genetic_code_tables[SEQ_GENETIC_CODE_STANDARD];
+
+/* The codon table for NCBI genetic code id, or NULL if there's
+   no such code */
+
+const char* seq_genetic_code(int id) {
+  if(id < 0 || id > SEQ_GENETIC_CODE_MAX || seq_genetic_code_tables[id][0] == '\0') {
+    return NULL;
+  }
+
+  return seq_genetic_code_tables[id];
+}
+
+/* The name of NCBI genetic code id, or NULL */
+
+const char* seq_genetic_code_name(int id) {
+  if(seq_genetic_code(id) == NULL) {
+    return NULL;
+  }
+
+  return seq_genetic_code_names[id];
+}
+
+#ifdef SEQ_KERNELS_X86
+
+/* Turn 16 bytes of bases in to their codes, as seq_codon_base
+   but with 4 for anything ambiguous, we test the bit ourselves */
+
+static inline SEQ_SSE41 __m128i _seq_codon_codes(__m128i v) {
+  const __m128i lo = _mm_setr_epi8(4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4);
+  const __m128i hi = _mm_setr_epi8(4, 4, 4, 4, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4);
+  __m128i idx, codes, lower, letter;
+
+  idx = _mm_and_si128(v, _mm_set1_epi8(0x1F));
+  codes = _mm_blendv_epi8(_mm_shuffle_epi8(lo, idx),
+			  _mm_shuffle_epi8(hi, idx),
+			  _mm_slli_epi16(idx, 3));
+
+  lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			 _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+
+  return _mm_blendv_epi8(_mm_set1_epi8(4), codes, letter);
+}
+
+/* Pick base p of each of the 16 codons out of 48 coded bases */
+
+static inline SEQ_SSE41 __m128i _seq_codon_position(__m128i a, __m128i b, __m128i c, int p) {
+  static const signed char picks[3][3][16] = {
+    { {  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 } },
+    { {  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 } },
+    { {  2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15 } }
+  };
+
+  return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, _mm_loadu_si128((const __m128i*)picks[p][0])),
+				   _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i*)picks[p][1]))),
+		      _mm_shuffle_epi8(c, _mm_loadu_si128((const __m128i*)picks[p][2])));
+}
+
+/* Translate 16 codons, 48 bases, in to dest, t0-t3 are the four
+   quarters of the codon table */
+
+static inline SEQ_SSE41 void _seq_translate_block(char* dest, const char* src, __m128i t0, __m128i t1, __m128i t2, __m128i t3) {
+  const __m128i three = _mm_set1_epi8(3);
+  __m128i a, b, c, p1, p2, p3, idx, bit4, aa;
+
+  a = _seq_codon_codes(_mm_loadu_si128((const __m128i*)src));
+  b = _seq_codon_codes(_mm_loadu_si128((const __m128i*)(src + 16)));
+  c = _seq_codon_codes(_mm_loadu_si128((const __m128i*)(src + 32)));
+
+  p1 = _seq_codon_position(a, b, c, 0);
+  p2 = _seq_codon_position(a, b, c, 1);
+  p3 = _seq_codon_position(a, b, c, 2);
+
+  /* The codes are at most 4, so shifting 16 bit lanes never
+     carries between bytes */
+  idx = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_and_si128(p1, three), 4),
+				  _mm_slli_epi16(_mm_and_si128(p2, three), 2)),
+		     _mm_and_si128(p3, three));
+
+  /* 64 entry lookup, four 16 entry tables picked by bits 4 and 5 */
+  bit4 = _mm_slli_epi16(idx, 3);
+  aa = _mm_blendv_epi8(_mm_blendv_epi8(_mm_shuffle_epi8(t0, idx), _mm_shuffle_epi8(t1, idx), bit4),
+		       _mm_blendv_epi8(_mm_shuffle_epi8(t2, idx), _mm_shuffle_epi8(t3, idx), bit4),
+		       _mm_slli_epi16(idx, 2));
+
+  /* Any ambiguous base makes the codon an X */
+  aa = _mm_blendv_epi8(aa, _mm_set1_epi8('X'),
+		       _mm_slli_epi16(_mm_or_si128(_mm_or_si128(p1, p2), p3), 5));
+
+  _mm_storeu_si128((__m128i*)dest, aa);
+}
+
+/* The AVX2 and AVX-512 kernels translate with this too, the codon
+   picking doesn't cross 128 bit lanes so gains little from them */
+
+static SEQ_SSE41 size_t _seq_translate_sse41(char* dest, const char* src, size_t len, const char* code) {
+  const __m128i t0 = _mm_loadu_si128((const __m128i*)code);
+  const __m128i t1 = _mm_loadu_si128((const __m128i*)(code + 16));
+  const __m128i t2 = _mm_loadu_si128((const __m128i*)(code + 32));
+  const __m128i t3 = _mm_loadu_si128((const __m128i*)(code + 48));
+  size_t codons = len / 3;
+  size_t i = 0;
+
+  for(; i + 16 <= codons; i += 16) {
+    _seq_translate_block(dest + i, src + i * 3, t0, t1, t2, t3);
+  }
+
+  _seq_translate_scalar(dest + i, src + i * 3, (codons - i) * 3, code);
+
+  return codons;
+}
+
+#endif
+
+size_t _seq_translate_scalar(char* dest, const char* src, size_t len, const char* code) {
+  const unsigned char* s = (const unsigned char*)src;
+  size_t codons = len / 3;
+  size_t i;
+
+  for(i = 0; i < codons; i++, s += 3) {
+    dest[i] = code[ SEQ_CODON_INDEX(seq_codon_base, s[0], s[1], s[2]) ];
+  }
+
+  return codons;
+}
+
+/* 2bit unpacking
+
+   UCSC .2bit files pack four bases a byte, the first in the top
+   two bits, T 0, C 1, A 2 and G 3. */
+
+#define SEQ_2BIT_BASES "TCAG"
+
+#ifdef SEQ_KERNELS_X86
+
+/* 16 bases out of 4 bytes at a time. Each byte is copied to the
+   four positions of its bases, the nibble holding the base picked
+   out (high for the first two, low for the last two), and the
+   nibble looked up in the table for its top or bottom two bits.
+   The AVX2 and AVX-512 kernels unpack with this too, it's already
+   writing far faster than the bytes can come off the disk. */
+
+static SEQ_SSE41 void _seq_unpack_2bit_sse41(char* dest, const unsigned char* src, size_t nbytes) {
+  const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+  const __m128i low_nibble = _mm_setr_epi8(0, 0, -1, -1, 0, 0, -1, -1, 0, 0, -1, -1, 0, 0, -1, -1);
+  const __m128i odd = _mm_setr_epi8(0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1);
+  const __m128i top = _mm_setr_epi8('T', 'T', 'T', 'T', 'C', 'C', 'C', 'C',
+				    'A', 'A', 'A', 'A', 'G', 'G', 'G', 'G');
+  const __m128i bottom = _mm_setr_epi8('T', 'C', 'A', 'G', 'T', 'C', 'A', 'G',
+				       'T', 'C', 'A', 'G', 'T', 'C', 'A', 'G');
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  __m128i v, nib;
+  uint32_t word;
+  size_t i;
+
+  for(i = 0; i + 4 <= nbytes; i += 4) {
+    memcpy(&word, src + i, 4);
+    v = _mm_shuffle_epi8(_mm_cvtsi32_si128((int)word), spread);
+
+    nib = _mm_blendv_epi8(_mm_and_si128(_mm_srli_epi16(v, 4), nibble),
+			  _mm_and_si128(v, nibble),
+			  low_nibble);
+
+    _mm_storeu_si128((__m128i*)(dest + i * 4),
+		     _mm_blendv_epi8(_mm_shuffle_epi8(top, nib),
+				     _mm_shuffle_epi8(bottom, nib),
+				     odd));
+  }
+
+  _seq_unpack_2bit_scalar(dest + i * 4, src + i, nbytes - i);
+}
+
+#endif
+
+void _seq_unpack_2bit_scalar(char* dest, const unsigned char* src, size_t nbytes) {
+  size_t i;
+
+  for(i = 0; i < nbytes; i++, dest += 4) {
+    dest[0] = SEQ_2BIT_BASES[src[i] >> 6];
+    dest[1] = SEQ_2BIT_BASES[(src[i] >> 4) & 3];
+    dest[2] = SEQ_2BIT_BASES[(src[i] >> 2) & 3];
+    dest[3] = SEQ_2BIT_BASES[src[i] & 3];
+  }
+}
+
+/* Dispatch
+
+   The kernels for each SEQ_KERNELS_* level, seq_kernels_init binds
+   the best the CPU runs the first time any kernel is called, or it
+   can be called at start up. */
+
+typedef struct seq_kernels {
+  const char* name;
+  void (*revcomp)(char* dest, const char* src, size_t len);
+  void (*revcomp_inplace)(char* seq, size_t len);
+  void (*transform)(char* dest, const char* src, size_t len, int flags);
+  size_t (*translate)(char* dest, const char* src, size_t len, const char* code);
+  void (*unpack_2bit)(char* dest, const unsigned char* src, size_t nbytes);
+} seq_kernels_t;
+
+static const seq_kernels_t seq_kernels_levels[] = {
+  { "scalar", _seq_revcomp_scalar, _seq_revcomp_inplace_scalar, _seq_transform_scalar, _seq_translate_scalar,
+    _seq_unpack_2bit_scalar },
+#ifdef SEQ_KERNELS_X86
+  { "sse4.1", _seq_revcomp_sse41, _seq_revcomp_inplace_sse41, _seq_transform_sse41, _seq_translate_sse41,
+    _seq_unpack_2bit_sse41 },
+  { "avx2", _seq_revcomp_avx2, _seq_revcomp_inplace_avx2, _seq_transform_avx2, _seq_translate_sse41,
+    _seq_unpack_2bit_sse41 },
+  { "avx512bw", _seq_revcomp_avx512, _seq_revcomp_inplace_avx512, _seq_transform_avx512, _seq_translate_sse41,
+    _seq_unpack_2bit_sse41 },
+#endif
+};
+
+static const seq_kernels_t* seq_kernels = NULL;
+
+/* The best level of kernels this CPU can run */
+
+int seq_kernels_detect() {
+#ifdef SEQ_KERNELS_X86
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx512bw")) {
+    return SEQ_KERNELS_AVX512;
+  }
+  if(__builtin_cpu_supports("avx2")) {
+    return SEQ_KERNELS_AVX2;
+  }
+  if(__builtin_cpu_supports("sse4.1")) {
+    return SEQ_KERNELS_SSE41;
+  }
+#endif
+
+  return SEQ_KERNELS_SCALAR;
+}
+
+/* Use the kernels for level, if the CPU can run them.
+
+   Returns 1 on success, 0 if the CPU or build doesn't support level.
+*/
+
+int seq_kernels_use(int level) {
+  if(level < SEQ_KERNELS_SCALAR || level > seq_kernels_detect()) {
+    return 0;
+  }
+
+  seq_kernels = &seq_kernels_levels[level];
+
+  return 1;
+}
+
+/* Bind the best kernels for this CPU, it's safe to call this more
+   than once.
+
+   Returns the level chosen.
+*/
+
+int seq_kernels_init() {
+  int level = seq_kernels_detect();
+
+  seq_kernels_use(level);
+
+  return level;
+}
+
+static inline const seq_kernels_t* _seq_kernels() {
+  if(seq_kernels == NULL) {
+    seq_kernels_init();
+  }
+
+  return seq_kernels;
+}
+
+/* Which kernels are in use */
+
+const char* seq_kernels_impl() {
+  return _seq_kernels()->name;
+}
+
+/* Write the reverse complement of len bytes of src in to dest,
+   the two must not overlap. Nothing is NUL terminated. */
+
+void seq_revcomp(char* dest, const char* src, size_t len) {
+  _seq_kernels()->revcomp(dest, src, len);
+}
+
+/* Reverse complement len bytes of seq in place */
+
+void seq_revcomp_inplace(char* seq, size_t len) {
+  _seq_kernels()->revcomp_inplace(seq, len);
+}
+
+/* Copy len bytes of src to dest applying the SEQ_XFORM_* flags
+   in one pass, reverse complementing, hard masking and/or folding
+   the case of letters. The two must not overlap. */
+
+void seq_transform(char* dest, const char* src, size_t len, int flags) {
+  if(flags == 0) {
+    memcpy(dest, src, len);
+    return;
+  }
+
+  _seq_kernels()->transform(dest, src, len, flags);
+}
+
+/* Translate the len / 3 whole codons in src in to dest with the
+   standard genetic code, a trailing partial codon is ignored.
+
+   Returns the number of amino acids written.
+*/
+
+size_t seq_translate(char* dest, const char* src, size_t len) {
+  return _seq_kernels()->translate(dest, src, len, seq_codon_table);
+}
+
+/* The same with another genetic code, code is a codon table from
+   seq_genetic_code */
+
+size_t seq_translate_code(char* dest, const char* src, size_t len, const char* code) {
+  return _seq_kernels()->translate(dest, src, len, code);
+}
+
+/* Unpack len bases of a .2bit sequence's packed DNA in to dest,
+   starting with base first, upper case with no N or masking,
+   which the caller lays over them. Nothing is NUL terminated. */
+
+void seq_unpack_2bit(char* dest, const unsigned char* packed, uint64_t first, size_t len) {
+  const unsigned char* src = packed + first / 4;
+  size_t n;
+
+  /* Finish the byte first starts in */
+  for(n = first % 4; n % 4 != 0 && len > 0; n++, len--) {
+    *dest++ = SEQ_2BIT_BASES[(*src >> (6 - 2 * n)) & 3];
+  }
+  if(n != first % 4) {
+    src++;
+  }
+
+  _seq_kernels()->unpack_2bit(dest, src, len / 4);
+  dest += len & ~(size_t)3;
+  src += len / 4;
+
+  for(n = 0; n < len % 4; n++) {
+    *dest++ = SEQ_2BIT_BASES[(*src >> (6 - 2 * n)) & 3];
+  }
+}
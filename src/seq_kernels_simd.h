@@ -0,0 +1,104 @@
+/* Sequence kernels, the block loops
+
+ Included by seq_kernels.c once for each instruction set, which
+ defines before including us:
+
+   SEQ_TARGET     function attribute to compile for the instruction set
+   SEQ_NAME(fn)   the name of fn for the instruction set
+   SEQ_SHORT(fn)  the name of fn for less than a block, the next
+                  instruction set down
+   SEQ_VEC        the vector type
+   SEQ_BLOCK      bytes in a vector
+   SEQ_LOAD(p)    unaligned load of a vector from p
+   SEQ_STORE(p,v) unaligned store of v to p
+
+ and the block functions SEQ_NAME(_seq_revcomp_block) and
+ SEQ_NAME(_seq_transform_block). Everything is undefined again at
+ the end so the next instruction set can be included.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+static SEQ_TARGET void SEQ_NAME(_seq_revcomp)(char* dest, const char* src, size_t len) {
+  size_t i;
+
+  if(len < SEQ_BLOCK) {
+    SEQ_SHORT(_seq_revcomp)(dest, src, len);
+    return;
+  }
+
+  for(i = 0; i + SEQ_BLOCK <= len; i += SEQ_BLOCK) {
+    SEQ_STORE(dest + i, SEQ_NAME(_seq_revcomp_block)(SEQ_LOAD(src + len - i - SEQ_BLOCK)));
+  }
+
+  /* What's left is the start of src, redo a whole block of it
+     rather than finishing byte by byte */
+  if(i < len) {
+    SEQ_STORE(dest + len - SEQ_BLOCK, SEQ_NAME(_seq_revcomp_block)(SEQ_LOAD(src)));
+  }
+}
+
+static SEQ_TARGET void SEQ_NAME(_seq_revcomp_inplace)(char* seq, size_t len) {
+  SEQ_VEC head, tail;
+  size_t i = 0;
+  size_t k = len;
+
+  /* Swap a block from each end until they'd meet */
+  while(k - i >= 2 * SEQ_BLOCK) {
+    head = SEQ_LOAD(seq + i);
+    tail = SEQ_LOAD(seq + k - SEQ_BLOCK);
+    SEQ_STORE(seq + i, SEQ_NAME(_seq_revcomp_block)(tail));
+    SEQ_STORE(seq + k - SEQ_BLOCK, SEQ_NAME(_seq_revcomp_block)(head));
+    i += SEQ_BLOCK;
+    k -= SEQ_BLOCK;
+  }
+
+  SEQ_SHORT(_seq_revcomp_inplace)(seq + i, k - i);
+}
+
+static SEQ_TARGET void SEQ_NAME(_seq_transform)(char* dest, const char* src, size_t len, int flags) {
+  size_t i;
+
+  if(len < SEQ_BLOCK) {
+    SEQ_SHORT(_seq_transform)(dest, src, len, flags);
+    return;
+  }
+
+  for(i = 0; i + SEQ_BLOCK <= len; i += SEQ_BLOCK) {
+    if(flags & SEQ_XFORM_REVCOMP) {
+      SEQ_STORE(dest + i, SEQ_NAME(_seq_transform_block)(SEQ_LOAD(src + len - i - SEQ_BLOCK), flags));
+    } else {
+      SEQ_STORE(dest + i, SEQ_NAME(_seq_transform_block)(SEQ_LOAD(src + i), flags));
+    }
+  }
+
+  /* Rather than finishing byte by byte redo a whole block ending
+     at the end of dest, rewriting some bytes with the same values */
+  if(i < len) {
+    i = len - SEQ_BLOCK;
+    if(flags & SEQ_XFORM_REVCOMP) {
+      SEQ_STORE(dest + i, SEQ_NAME(_seq_transform_block)(SEQ_LOAD(src), flags));
+    } else {
+      SEQ_STORE(dest + i, SEQ_NAME(_seq_transform_block)(SEQ_LOAD(src + i), flags));
+    }
+  }
+}
+
+#undef SEQ_TARGET
+#undef SEQ_NAME
+#undef SEQ_SHORT
+#undef SEQ_VEC
+#undef SEQ_BLOCK
+#undef SEQ_LOAD
+#undef SEQ_STORE
@@ -0,0 +1,1383 @@
+/* Direct sequence reader
+
+ Reads bases straight out of indexed fasta files using the
+ offsets in the .fai index, bypassing the faidx_fetch_seq
+ path and its per call allocations.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#else
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "seq_reader.h"
+#include "seq_kernels.h"
+
+/* Bytes of a BGZF block before and after its deflated data, the
+   gzip header with the BC extra field and the CRC32 and ISIZE */
+#define BGZF_HEADER 18
+#define BGZF_FOOTER 8
+
+/* The seekable zstd format's seek table, a skippable frame at the
+   end of the file, its header, an entry for every frame and then
+   the footer with the frame count and the seekable magic */
+#define ZSTD_FRAME_MAGIC 0xFD2FB528U
+#define ZSTD_SEEK_TABLE_MAGIC 0x184D2A5EU
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1U
+#define ZSTD_SEEK_HEADER 8
+#define ZSTD_SEEK_FOOTER 9
+
+/* The first word of a .2bit file, in the endianness it was
+   written in */
+#define TWOBIT_SIGNATURE 0x1A412743U
+#define TWOBIT_HEADER 16
+
+#define LE32(p) ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | \
+		 ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+/* A sequence's name alongside its id, sorted to build the name
+   lookup table without qsort needing to see the reader */
+typedef struct seq_reader_name {
+  const char* name;
+  int id;
+} seq_reader_name_t;
+
+static int _seq_reader_cmp_names(const void* a, const void* b) {
+  return strcmp(((const seq_reader_name_t*)a)->name, ((const seq_reader_name_t*)b)->name);
+}
+
+/* Open a fasta file for direct reading. The file must have
+   a .fai index alongside it, unless it's a .2bit file, which
+   carries its own.
+
+   Uncompressed files are mapped in to memory, bgzip files have
+   their blocks read and inflated one at a time as the .gzi index
+   says where they are, and seekable zstd files their frames as
+   the seek table at the end of the file says. .2bit files are
+   mapped and unpacked as they're read. The .fai of a
+   compressed file gives offsets in to the uncompressed text. For
+   anything else (or any error) we return NULL and the caller
+   should fall back to going through faidx.
+ */
+
+seq_reader_t* seq_reader_open(const char* path) {
+  seq_reader_t* reader;
+
+  reader = calloc(1, sizeof(seq_reader_t));
+  if(reader == NULL) {
+    return NULL;
+  }
+  reader->fd = -1;
+
+  if(_seq_reader_open_2bit(reader, path)) {
+    return reader;
+  } else if(reader->type != 0) {
+    seq_reader_close(reader);
+    return NULL; /* A .2bit file, but a broken one */
+  }
+
+  if(!_seq_reader_load_index(reader, path)) {
+    seq_reader_close(reader);
+    return NULL;
+  }
+
+  if(_seq_reader_map_file(reader, path)) {
+    reader->type = SEQ_READER_MMAP;
+    return reader;
+  }
+
+  /* Compressed, the type is set as soon as the file looks like
+     one, so a broken bgzip file isn't then tried as zstd */
+  if(!_seq_reader_open_fd(reader, path) ||
+     (!_seq_reader_open_bgzf(reader, path) &&
+      (reader->type != 0 || !_seq_reader_open_zstd(reader)))) {
+    seq_reader_close(reader);
+    return NULL;
+  }
+
+  return reader;
+}
+
+void seq_reader_close(seq_reader_t* reader) {
+  int i;
+
+  if(reader == NULL) {
+    return;
+  }
+
+  if(reader->map != NULL) {
+    munmap(reader->map, reader->map_size);
+  }
+
+  if(reader->fd >= 0) {
+    close(reader->fd);
+  }
+
+  if(reader->inflater != NULL && reader->type == SEQ_READER_BGZF) {
+#ifdef HAVE_LIBDEFLATE
+    libdeflate_free_decompressor(reader->inflater);
+#else
+    inflateEnd(reader->inflater);
+    free(reader->inflater);
+#endif
+  }
+
+#ifdef HAVE_ZSTD
+  if(reader->inflater != NULL && reader->type == SEQ_READER_ZSTD) {
+    ZSTD_freeDCtx(reader->inflater);
+  }
+#endif
+
+  free(reader->block);
+  free(reader->cblock);
+
+  if(reader->scratch != NULL) {
+    free(reader->scratch);
+  }
+
+  /* Our blocks are no use to anyone else */
+  if(reader->blocks != NULL) {
+    seq_block_cache_drop(reader->blocks, reader->file_id);
+  }
+
+  if(reader->gzi != NULL) {
+    free(reader->gzi);
+  }
+
+  if(reader->seqs != NULL) {
+    for(i = 0; i < reader->nseqs; i++) {
+      free(reader->seqs[i].name);
+    }
+    free(reader->seqs);
+  }
+
+  if(reader->sorted != NULL) {
+    free(reader->sorted);
+  }
+
+  free(reader);
+}
+
+int seq_reader_nseq(seq_reader_t* reader) {
+  return reader->nseqs;
+}
+
+const char* seq_reader_iseq(seq_reader_t* reader, int seq_id) {
+  if(seq_id < 0 || seq_id >= reader->nseqs) {
+    return NULL;
+  }
+
+  return reader->seqs[seq_id].name;
+}
+
+/* Look up the id of a sequence by name, binary search on the
+   sorted table. Returns -1 if we don't have that sequence. */
+
+int seq_reader_seq_id(seq_reader_t* reader, const char* name) {
+  int lo = 0;
+  int hi = reader->nseqs - 1;
+  int mid, c;
+
+  while(lo <= hi) {
+    mid = lo + (hi - lo) / 2;
+    c = strcmp(name, reader->seqs[reader->sorted[mid]].name);
+
+    if(c == 0) {
+      return reader->sorted[mid];
+    } else if(c < 0) {
+      hi = mid - 1;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  return -1;
+}
+
+uint64_t seq_reader_seq_len(seq_reader_t* reader, int seq_id) {
+  if(seq_id < 0 || seq_id >= reader->nseqs) {
+    return 0;
+  }
+
+  return reader->seqs[seq_id].length;
+}
+
+/* Return a pointer to the bases starting at pos (0 based) in
+   the sequence. At most len bases are available, less if the
+   run is cut short by the end of a line in a mapped file or the
+   size of the scratch buffer for a compressed one, the number
+   available is put in run_len.
+
+   The pointer is in to the mapped file or the reader's scratch
+   buffer, it's only valid until the next call on the reader and
+   must not be written to.
+
+   Returns NULL if the position is outside of the sequence.
+ */
+
+const char* seq_reader_run(seq_reader_t* reader, int seq_id, uint64_t pos, uint64_t len, uint64_t* run_len) {
+  seq_reader_entry_t* seq;
+  uint64_t line, col;
+
+  if(seq_id < 0 || seq_id >= reader->nseqs) {
+    *run_len = 0;
+    return NULL;
+  }
+
+  seq = &(reader->seqs[seq_id]);
+
+  if(pos >= seq->length) {
+    *run_len = 0;
+    return NULL;
+  }
+
+  if(len > seq->length - pos) {
+    len = seq->length - pos;
+  }
+
+  if(reader->type != SEQ_READER_MMAP) {
+    /* Already decompressed, by a prefetch or the last run */
+    if(seq_id == reader->scratch_id &&
+       pos >= reader->scratch_beg && pos < reader->scratch_beg + reader->scratch_len) {
+      *run_len = reader->scratch_beg + reader->scratch_len - pos;
+      if(*run_len > len) {
+	*run_len = len;
+      }
+      return reader->scratch + (pos - reader->scratch_beg);
+    }
+
+    if(len > SEQ_READER_SCRATCH) {
+      len = SEQ_READER_SCRATCH;
+    }
+
+    if(!_seq_reader_fill_scratch(reader, seq_id, pos, len)) {
+      *run_len = 0;
+      return NULL;
+    }
+
+    *run_len = len;
+    return reader->scratch;
+  }
+
+  line = pos / seq->line_bases;
+  col = pos % seq->line_bases;
+
+  *run_len = seq->line_bases - col;
+  if(*run_len > len) {
+    *run_len = len;
+  }
+
+  return reader->map + seq->offset + (line * seq->line_width) + col;
+}
+
+/* The same as seq_reader_run but working backwards, the run ends
+   at base end (inclusive) and starts no earlier than len bases
+   before it. For a mapped file the run won't cross the start of a
+   line in the file.
+
+   Returns a pointer to the first base of the run, the caller walks
+   it backwards from there + run_len - 1.
+*/
+
+const char* seq_reader_run_back(seq_reader_t* reader, int seq_id, uint64_t end, uint64_t len, uint64_t* run_len) {
+  seq_reader_entry_t* seq;
+  uint64_t line, col;
+
+  if(seq_id < 0 || seq_id >= reader->nseqs) {
+    *run_len = 0;
+    return NULL;
+  }
+
+  seq = &(reader->seqs[seq_id]);
+
+  if(end >= seq->length || len == 0) {
+    *run_len = 0;
+    return NULL;
+  }
+
+  if(len > end + 1) {
+    len = end + 1;
+  }
+
+  if(reader->type != SEQ_READER_MMAP) {
+    if(seq_id == reader->scratch_id &&
+       end >= reader->scratch_beg && end < reader->scratch_beg + reader->scratch_len) {
+      *run_len = end - reader->scratch_beg + 1;
+      if(*run_len > len) {
+	*run_len = len;
+      }
+      return reader->scratch + (end - reader->scratch_beg) + 1 - *run_len;
+    }
+
+    if(len > SEQ_READER_SCRATCH) {
+      len = SEQ_READER_SCRATCH;
+    }
+
+    if(!_seq_reader_fill_scratch(reader, seq_id, end - len + 1, len)) {
+      *run_len = 0;
+      return NULL;
+    }
+
+    *run_len = len;
+    return reader->scratch;
+  }
+
+  line = end / seq->line_bases;
+  col = end % seq->line_bases;
+
+  *run_len = col + 1;
+  if(*run_len > len) {
+    *run_len = len;
+  }
+
+  return reader->map + seq->offset + (line * seq->line_width) + col + 1 - *run_len;
+}
+
+/* Copy len bases starting at beg (0 based) in to dest, the caller
+   must make sure dest is large enough. dest is not NUL terminated.
+
+   Returns the number of bases copied, or -1 if the range isn't
+   within the sequence.
+ */
+
+int64_t seq_reader_fetch(seq_reader_t* reader, int seq_id, uint64_t beg, uint64_t len, char* dest) {
+  const char* src;
+  uint64_t copied = 0;
+  uint64_t run_len;
+
+  if(seq_id < 0 || seq_id >= reader->nseqs ||
+     beg + len > reader->seqs[seq_id].length) {
+    return -1;
+  }
+
+  /* .2bit files unpack straight in to dest */
+  if(reader->type == SEQ_READER_2BIT) {
+    return _seq_reader_2bit_fetch(reader, &(reader->seqs[seq_id]), beg, len, dest);
+  }
+
+  /* Compressed files decompress straight in to dest */
+  if(reader->type != SEQ_READER_MMAP) {
+    return _seq_reader_block_fetch(reader, &(reader->seqs[seq_id]), beg, len, dest);
+  }
+
+  while(copied < len) {
+    src = seq_reader_run(reader, seq_id, beg + copied, len - copied, &run_len);
+    memcpy(dest + copied, src, run_len);
+    copied += run_len;
+  }
+
+  return (int64_t)copied;
+}
+
+/* Tell the reader bases beg to beg + len - 1 of a sequence are
+   about to be read, so it can read them in one go rather than as
+   they're asked for. For a compressed or .2bit file they're
+   decompressed or unpacked in to scratch, where seq_reader_run and seq_reader_run_back find
+   them, if they fit. For a mapped file the kernel is asked to start
+   reading in the pages.
+
+   Returns 1 if the bases were read ahead, 0 if not, reading them
+   still works either way.
+*/
+
+int seq_reader_prefetch(seq_reader_t* reader, int seq_id, uint64_t beg, uint64_t len) {
+  seq_reader_entry_t* seq;
+  uint64_t first, last, page;
+
+  if(seq_id < 0 || seq_id >= reader->nseqs || len == 0 ||
+     beg + len > reader->seqs[seq_id].length) {
+    return 0;
+  }
+
+  if(reader->type != SEQ_READER_MMAP) {
+    if(seq_id == reader->scratch_id && beg >= reader->scratch_beg &&
+       beg + len <= reader->scratch_beg + reader->scratch_len) {
+      return 1;
+    }
+
+    if(len > SEQ_READER_SCRATCH) {
+      return 0;
+    }
+
+    return _seq_reader_fill_scratch(reader, seq_id, beg, len);
+  }
+
+  /* Round out to whole pages of the file */
+  seq = &(reader->seqs[seq_id]);
+  page = (uint64_t)sysconf(_SC_PAGESIZE);
+  first = seq->offset + (beg / seq->line_bases) * seq->line_width + (beg % seq->line_bases);
+  last = seq->offset + ((beg + len - 1) / seq->line_bases) * seq->line_width + ((beg + len - 1) % seq->line_bases);
+  first -= first % page;
+
+  reader->reads++;
+  return madvise(reader->map + first, last - first + 1, MADV_WILLNEED) == 0;
+}
+
+/* Read a compressed file's blocks through a cache shared with
+   other readers, rather than decompressing them again each time
+   they're needed. The reader must be closed before the cache is
+   destroyed.
+
+   Returns 1 if the cache is used, 0 if the reader has no use for
+   one (not a compressed file, .2bit files aren't). zstd frames bigger than
+   SEQ_BLOCK_MAX aren't cached, only the one we last decompressed
+   is kept.
+*/
+
+int seq_reader_set_block_cache(seq_reader_t* reader, seq_block_cache_t* cache) {
+  if(reader->type == SEQ_READER_MMAP || reader->type == SEQ_READER_2BIT || cache == NULL) {
+    return 0;
+  }
+
+  reader->blocks = cache;
+
+  return 1;
+}
+
+/* Decompress or unpack len bases (no more than SEQ_READER_SCRATCH)
+   starting at beg in to scratch, and remember what's there.
+
+   Returns 1 on success, 0 on a read error.
+ */
+
+int _seq_reader_fill_scratch(seq_reader_t* reader, int seq_id, uint64_t beg, uint64_t len) {
+  int64_t got;
+
+  reader->scratch_len = 0;
+  reader->reads++;
+
+  if(reader->type == SEQ_READER_2BIT) {
+    got = _seq_reader_2bit_fetch(reader, &(reader->seqs[seq_id]), beg, len, reader->scratch);
+  } else {
+    got = _seq_reader_block_fetch(reader, &(reader->seqs[seq_id]), beg, len, reader->scratch);
+  }
+
+  if(got < 0) {
+    return 0;
+  }
+
+  reader->scratch_id = seq_id;
+  reader->scratch_beg = beg;
+  reader->scratch_len = len;
+
+  return 1;
+}
+
+/* Read the .fai for a fasta file, fill in the index entries
+   and build the sorted lookup table.
+
+   Returns 1 on success, 0 on failure.
+ */
+
+int _seq_reader_load_index(seq_reader_t* reader, const char* path) {
+  FILE* fp;
+  char* fai_path;
+  char* line = NULL;
+  char* p;
+  size_t line_cap = 0;
+  ssize_t line_len;
+  int capacity = 0;
+  seq_reader_entry_t* seqs;
+  seq_reader_entry_t* seq;
+
+  fai_path = malloc(strlen(path) + 5);
+  if(fai_path == NULL) {
+    return 0;
+  }
+  sprintf(fai_path, "%s.fai", path);
+
+  fp = fopen(fai_path, "r");
+  free(fai_path);
+  if(fp == NULL) {
+    return 0;
+  }
+
+  while((line_len = getline(&line, &line_cap, fp)) > 0) {
+    if(reader->nseqs == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      seqs = realloc(reader->seqs, capacity * sizeof(seq_reader_entry_t));
+      if(seqs == NULL) {
+	break;
+      }
+      reader->seqs = seqs;
+    }
+
+    /* name \t length \t offset \t linebases \t linewidth [\t qualoffset] */
+    p = strchr(line, '\t');
+    if(p == NULL) {
+      break;
+    }
+    *p++ = '\0';
+
+    seq = &(reader->seqs[reader->nseqs]);
+    seq->length = strtoull(p, &p, 10);
+    seq->offset = strtoull(p, &p, 10);
+    seq->line_bases = strtoull(p, &p, 10);
+    seq->line_width = strtoull(p, &p, 10);
+
+    /* Nonsense line lengths would have us dividing by zero
+       or reading backwards */
+    if(seq->line_bases == 0 || seq->line_width < seq->line_bases) {
+      break;
+    }
+
+    seq->name = strdup(line);
+    if(seq->name == NULL) {
+      break;
+    }
+
+    reader->nseqs++;
+  }
+
+  free(line);
+  fclose(fp);
+
+  /* If we stopped before the end of the file something was wrong */
+  if(line_len > 0 || reader->nseqs == 0) {
+    return 0;
+  }
+
+  return _seq_reader_sort_names(reader);
+}
+
+/* Build the table of sequence ids sorted by name, for
+   seq_reader_seq_id.
+
+   Returns 1 on success, 0 if we're out of memory.
+ */
+
+int _seq_reader_sort_names(seq_reader_t* reader) {
+  seq_reader_name_t* names;
+  int i;
+
+  reader->sorted = malloc(reader->nseqs * sizeof(int));
+  names = malloc(reader->nseqs * sizeof(seq_reader_name_t));
+  if(reader->sorted == NULL || names == NULL) {
+    free(names);
+    return 0;
+  }
+
+  for(i = 0; i < reader->nseqs; i++) {
+    names[i].name = reader->seqs[i].name;
+    names[i].id = i;
+  }
+
+  qsort(names, reader->nseqs, sizeof(seq_reader_name_t), _seq_reader_cmp_names);
+
+  for(i = 0; i < reader->nseqs; i++) {
+    reader->sorted[i] = names[i].id;
+  }
+  free(names);
+
+  return 1;
+}
+
+/* Map an uncompressed fasta file in to memory. We refuse
+   gzip/bgzip and zstd files and files too short for their index
+   (a stale .fai would have us reading past the mapping).
+
+   Returns 1 on success, 0 on failure.
+ */
+
+int _seq_reader_map_file(seq_reader_t* reader, const char* path) {
+  int fd;
+  struct stat st;
+  unsigned char magic[2];
+  seq_reader_entry_t* seq;
+  uint64_t last_base;
+  int i;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    return 0;
+  }
+
+  if(fstat(fd, &st) != 0 || st.st_size < 2 ||
+     pread(fd, magic, 2, 0) != 2 ||
+     (magic[0] == 0x1f && magic[1] == 0x8b) ||
+     (magic[0] == 0x28 && magic[1] == 0xb5)) {
+    close(fd);
+    return 0;
+  }
+
+  for(i = 0; i < reader->nseqs; i++) {
+    seq = &(reader->seqs[i]);
+    if(seq->length == 0) {
+      continue;
+    }
+
+    last_base = seq->offset +
+                ((seq->length - 1) / seq->line_bases) * seq->line_width +
+                ((seq->length - 1) % seq->line_bases);
+    if(last_base >= (uint64_t)st.st_size) {
+      close(fd);
+      return 0;
+    }
+  }
+
+  reader->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); /* The mapping holds its own reference to the file */
+
+  if(reader->map == MAP_FAILED) {
+    reader->map = NULL;
+    return 0;
+  }
+
+  reader->map_size = st.st_size;
+
+  return 1;
+}
+
+/* Open a compressed file to read its blocks from, noting its
+   size and its identity in the block caches.
+
+   Returns 1 on success, 0 on failure.
+ */
+
+int _seq_reader_open_fd(seq_reader_t* reader, const char* path) {
+  struct stat st;
+
+  reader->fd = open(path, O_RDONLY);
+  if(reader->fd < 0 || fstat(reader->fd, &st) != 0) {
+    return 0;
+  }
+
+  reader->file_size = st.st_size;
+  reader->block_coff = UINT64_MAX;
+
+  /* From things other processes see the same and that change if
+     the file is replaced */
+  reader->file_id = ((uint64_t)st.st_dev * 0x9E3779B97F4A7C15ULL) ^
+		    ((uint64_t)st.st_ino * 0xC2B2AE3D27D4EB4FULL) ^
+		    ((uint64_t)st.st_size * 0x165667B19E3779F9ULL) ^
+		    (uint64_t)st.st_mtime;
+  reader->file_id |= 1; /* Never 0, which means none */
+
+  return 1;
+}
+
+/* Make a bgzip compressed fasta file the reader's and load its
+   .gzi index, plain gzip files can't be seeked in so we refuse
+   them, as we do bgzip files without a .gzi.
+
+   Returns 1 on success, 0 on failure, with the type left 0 if it
+   isn't a bgzip file at all.
+ */
+
+int _seq_reader_open_bgzf(seq_reader_t* reader, const char* path) {
+  unsigned char header[BGZF_HEADER];
+
+  if(pread(reader->fd, header, BGZF_HEADER, 0) != BGZF_HEADER ||
+     !_seq_reader_bgzf_header(header)) {
+    return 0;
+  }
+
+  reader->type = SEQ_READER_BGZF;
+
+  if(!_seq_reader_load_gzi(reader, path)) {
+    return 0;
+  }
+
+  /* Allocated once, reused for every block and run */
+  reader->block_max = SEQ_BLOCK_MAX;
+  reader->cblock_max = SEQ_BLOCK_MAX;
+  reader->scratch = malloc(SEQ_READER_SCRATCH);
+  reader->block = malloc(reader->block_max);
+  reader->cblock = malloc(reader->cblock_max);
+  if(reader->scratch == NULL || reader->block == NULL || reader->cblock == NULL) {
+    return 0;
+  }
+
+#ifdef HAVE_LIBDEFLATE
+  reader->inflater = libdeflate_alloc_decompressor();
+  if(reader->inflater == NULL) {
+    return 0;
+  }
+#else
+  reader->inflater = calloc(1, sizeof(z_stream));
+  if(reader->inflater == NULL) {
+    return 0;
+  }
+
+  /* Raw deflate, there's no zlib header inside a block */
+  if(inflateInit2(reader->inflater, -15) != Z_OK) {
+    free(reader->inflater);
+    reader->inflater = NULL;
+    return 0;
+  }
+#endif
+
+  return 1;
+}
+
+/* Is this the start of a BGZF block, a gzip header with just the
+   BC extra field giving the block's size, the same test htslib
+   makes */
+
+int _seq_reader_bgzf_header(const unsigned char* header) {
+  return header[0] == 31 && header[1] == 139 && header[2] == 8 && (header[3] & 4) &&
+    header[10] == 6 && header[11] == 0 &&
+    header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+}
+
+/* Read the .gzi for a bgzip file, a count of entries followed by
+   the compressed and uncompressed offset of every block but the
+   first, all little endian 64 bit. The first block, at 0 in both,
+   is put in gzi too.
+
+   Returns 1 on success, 0 on failure with gzi left NULL.
+ */
+
+int _seq_reader_load_gzi(seq_reader_t* reader, const char* path) {
+  FILE* fp;
+  char* gzi_path;
+  unsigned char buf[8];
+  uint64_t n, i;
+  int j;
+
+  gzi_path = malloc(strlen(path) + 5);
+  if(gzi_path == NULL) {
+    return 0;
+  }
+  sprintf(gzi_path, "%s.gzi", path);
+
+  fp = fopen(gzi_path, "rb");
+  free(gzi_path);
+  if(fp == NULL) {
+    return 0;
+  }
+
+  if(fread(buf, 1, 8, fp) != 8) {
+    fclose(fp);
+    return 0;
+  }
+
+  for(n = 0, j = 7; j >= 0; j--) {
+    n = (n << 8) | buf[j];
+  }
+
+  /* A count that can't be right for any file we could open */
+  if(n >= (UINT64_MAX >> 5)) {
+    fclose(fp);
+    return 0;
+  }
+
+  reader->gzi = malloc((n + 1) * 2 * sizeof(uint64_t));
+  if(reader->gzi == NULL) {
+    fclose(fp);
+    return 0;
+  }
+
+  reader->gzi[0] = 0;
+  reader->gzi[1] = 0;
+
+  for(i = 2; i < (n + 1) * 2; i++) {
+    if(fread(buf, 1, 8, fp) != 8) {
+      break;
+    }
+
+    for(reader->gzi[i] = 0, j = 7; j >= 0; j--) {
+      reader->gzi[i] = (reader->gzi[i] << 8) | buf[j];
+    }
+  }
+
+  fclose(fp);
+
+  if(i < (n + 1) * 2) {
+    free(reader->gzi);
+    reader->gzi = NULL;
+    return 0;
+  }
+
+  reader->ngzi = n + 1;
+
+  return 1;
+}
+
+/* Make a seekable zstd compressed fasta file the reader's, a run
+   of independent zstd frames with a seek table at the end giving
+   the size of each. Needs building with zstd.
+
+   Returns 1 on success, 0 on failure, with the type left 0 if it
+   isn't a zstd file at all.
+ */
+
+int _seq_reader_open_zstd(seq_reader_t* reader) {
+#ifdef HAVE_ZSTD
+  unsigned char magic[4];
+
+  if(pread(reader->fd, magic, 4, 0) != 4 || LE32(magic) != ZSTD_FRAME_MAGIC) {
+    return 0;
+  }
+
+  reader->type = SEQ_READER_ZSTD;
+
+  /* Plain zstd files have no seek table and can't be seeked in */
+  if(!_seq_reader_load_seek_table(reader)) {
+    return 0;
+  }
+
+  /* Sized for the largest frame, allocated once */
+  reader->scratch = malloc(SEQ_READER_SCRATCH);
+  reader->block = malloc(reader->block_max > 0 ? reader->block_max : 1);
+  reader->cblock = malloc(reader->cblock_max > 0 ? reader->cblock_max : 1);
+  if(reader->scratch == NULL || reader->block == NULL || reader->cblock == NULL) {
+    return 0;
+  }
+
+  reader->inflater = ZSTD_createDCtx();
+  if(reader->inflater == NULL) {
+    return 0;
+  }
+
+  return 1;
+#else
+  return 0; /* Built without zstd */
+#endif
+}
+
+/* Read the seek table of a seekable zst file in to gzi, the frames'
+   compressed and uncompressed offsets found by adding up their
+   sizes, with one more pair for where the last frame ends. The
+   checksums the table may have are skipped, zstd checks the
+   frames' own if they were written with them.
+
+   Returns 1 on success, 0 on failure with gzi left NULL.
+ */
+
+int _seq_reader_load_seek_table(seq_reader_t* reader) {
+  unsigned char footer[ZSTD_SEEK_FOOTER];
+  unsigned char* table;
+  unsigned char* entry;
+  uint64_t nframes, entry_size, table_size, i;
+  uint64_t coff = 0, uoff = 0;
+  uint32_t csize, dsize;
+
+  if(reader->file_size < ZSTD_SEEK_HEADER + ZSTD_SEEK_FOOTER ||
+     pread(reader->fd, footer, ZSTD_SEEK_FOOTER, reader->file_size - ZSTD_SEEK_FOOTER) != ZSTD_SEEK_FOOTER ||
+     LE32(footer + 5) != ZSTD_SEEKABLE_MAGIC ||
+     (footer[4] & 0x7c)) {
+    return 0;
+  }
+
+  /* Entries have a checksum if the descriptor's top bit is set */
+  nframes = LE32(footer);
+  entry_size = (footer[4] & 0x80) ? 12 : 8;
+  table_size = ZSTD_SEEK_HEADER + nframes * entry_size + ZSTD_SEEK_FOOTER;
+  if(nframes == 0 || table_size > reader->file_size) {
+    return 0;
+  }
+
+  table = malloc(table_size);
+  if(table == NULL) {
+    return 0;
+  }
+
+  if(pread(reader->fd, table, table_size, reader->file_size - table_size) != (ssize_t)table_size ||
+     LE32(table) != ZSTD_SEEK_TABLE_MAGIC ||
+     LE32(table + 4) != table_size - ZSTD_SEEK_HEADER) {
+    free(table);
+    return 0;
+  }
+
+  reader->gzi = malloc((nframes + 1) * 2 * sizeof(uint64_t));
+  if(reader->gzi == NULL) {
+    free(table);
+    return 0;
+  }
+
+  for(i = 0; i < nframes; i++) {
+    entry = table + ZSTD_SEEK_HEADER + i * entry_size;
+    csize = LE32(entry);
+    dsize = LE32(entry + 4);
+
+    if(dsize > SEQ_READER_FRAME_MAX || csize > 2 * SEQ_READER_FRAME_MAX) {
+      break;
+    }
+
+    reader->gzi[i * 2] = coff;
+    reader->gzi[i * 2 + 1] = uoff;
+    coff += csize;
+    uoff += dsize;
+
+    if(csize > reader->cblock_max) {
+      reader->cblock_max = csize;
+    }
+    if(dsize > reader->block_max) {
+      reader->block_max = dsize;
+    }
+  }
+
+  free(table);
+
+  /* The frames must take us exactly to the seek table */
+  if(i < nframes || coff != reader->file_size - table_size) {
+    free(reader->gzi);
+    reader->gzi = NULL;
+    return 0;
+  }
+
+  reader->gzi[nframes * 2] = coff;
+  reader->gzi[nframes * 2 + 1] = uoff;
+  reader->ngzi = nframes;
+
+  return 1;
+}
+
+/* Copy len bases starting at beg (0 based) in to dest, a line
+   of the file at a time, skipping the EOLs, out of the blocks
+   holding them. Nothing is allocated, and the block we last
+   inflated or the block cache is used before inflating again.
+
+   Returns the number of bases read, or -1 on a read error.
+ */
+
+int64_t _seq_reader_block_fetch(seq_reader_t* reader, seq_reader_entry_t* seq, uint64_t beg, uint64_t len, char* dest) {
+  const char* src;
+  uint64_t raw_pos, col, run, avail;
+  uint64_t copied = 0;
+
+  col = beg % seq->line_bases;
+  raw_pos = seq->offset + (beg / seq->line_bases) * seq->line_width + col;
+
+  while(copied < len) {
+    /* Step over the EOL if we're at the start of a new line */
+    if(col == seq->line_bases) {
+      raw_pos += seq->line_width - seq->line_bases;
+      col = 0;
+    }
+
+    run = seq->line_bases - col;
+    if(run > len - copied) {
+      run = len - copied;
+    }
+
+    /* The line may carry on in to the next block */
+    while(run > 0) {
+      src = _seq_reader_block(reader, raw_pos, &avail);
+      if(src == NULL) {
+	return -1;
+      }
+
+      if(avail > run) {
+	avail = run;
+      }
+
+      memcpy(dest + copied, src, avail);
+      raw_pos += avail;
+      copied += avail;
+      col += avail;
+      run -= avail;
+    }
+  }
+
+  return (int64_t)copied;
+}
+
+/* Find the decompressed block holding uncompressed offset raw_pos,
+   the block we last inflated if it's that, from the block cache
+   if we have one and it's there, otherwise inflating it (and
+   putting it in the cache). A zstd file's frames are its blocks. What we hand back is only good until
+   the next call.
+
+   Returns a pointer to raw_pos in the block and sets avail to the
+   bytes from there to the end of the block, or NULL if raw_pos is
+   past the end of the file or on a read error.
+ */
+
+const char* _seq_reader_block(seq_reader_t* reader, uint64_t raw_pos, uint64_t* avail) {
+  const char* data = NULL;
+  uint64_t lo = 0, hi = reader->ngzi, mid;
+  uint64_t coff, uoff;
+  size_t len;
+
+  /* The last block starting at or before raw_pos, empty blocks
+     share their offset with the block after */
+  while(hi - lo > 1) {
+    mid = lo + (hi - lo) / 2;
+    if(reader->gzi[mid * 2 + 1] <= raw_pos) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  coff = reader->gzi[lo * 2];
+  uoff = reader->gzi[lo * 2 + 1];
+
+  if(coff == reader->block_coff) {
+    data = reader->block;
+    len = reader->block_len;
+
+  } else {
+    if(reader->blocks != NULL) {
+      data = seq_block_cache_get(reader->blocks, reader->file_id, coff, &len);
+    }
+
+    if(data == NULL) {
+      if(reader->type == SEQ_READER_ZSTD ? !_seq_reader_unzstd(reader, lo) : !_seq_reader_inflate(reader, lo)) {
+	return NULL;
+      }
+
+      data = reader->block;
+      len = reader->block_len;
+
+      if(reader->blocks != NULL) {
+	seq_block_cache_put(reader->blocks, reader->file_id, coff, data, len);
+      }
+    }
+  }
+
+  if(raw_pos - uoff >= len) {
+    return NULL;
+  }
+
+  *avail = len - (raw_pos - uoff);
+  return data + (raw_pos - uoff);
+}
+
+/* Read the nth block of the file in one pread and inflate it in
+   to block in one go, its ISIZE tells us exactly how big it is.
+   Its CRC32 is checked, as htslib does.
+
+   Returns 1 on success, 0 if the block is damaged or can't be read.
+ */
+
+int _seq_reader_inflate(seq_reader_t* reader, uint64_t block) {
+  unsigned char* cblock = reader->cblock;
+  uint64_t coff, clen;
+  ssize_t got;
+  size_t bsize;
+  uint32_t crc, isize;
+
+  coff = reader->gzi[block * 2];
+  clen = (block + 1 < reader->ngzi ? reader->gzi[block * 2 + 2] : reader->file_size) - coff;
+  if(clen > SEQ_BLOCK_MAX) {
+    clen = SEQ_BLOCK_MAX; /* The BC field has the real size */
+  }
+
+  reader->block_coff = UINT64_MAX;
+
+  got = pread(reader->fd, cblock, clen, coff);
+  if(got < BGZF_HEADER + BGZF_FOOTER || !_seq_reader_bgzf_header(cblock)) {
+    return 0;
+  }
+
+  bsize = (size_t)(cblock[16] | (cblock[17] << 8)) + 1;
+  if(bsize > (size_t)got || bsize < BGZF_HEADER + BGZF_FOOTER) {
+    return 0;
+  }
+
+  crc = cblock[bsize - 8] | (cblock[bsize - 7] << 8) |
+    (cblock[bsize - 6] << 16) | ((uint32_t)cblock[bsize - 5] << 24);
+  isize = cblock[bsize - 4] | (cblock[bsize - 3] << 8) |
+    (cblock[bsize - 2] << 16) | ((uint32_t)cblock[bsize - 1] << 24);
+  if(isize > SEQ_BLOCK_MAX) {
+    return 0;
+  }
+
+#ifdef HAVE_LIBDEFLATE
+  if(libdeflate_deflate_decompress(reader->inflater, cblock + BGZF_HEADER,
+				   bsize - BGZF_HEADER - BGZF_FOOTER,
+				   reader->block, isize, NULL) != LIBDEFLATE_SUCCESS ||
+     libdeflate_crc32(0, reader->block, isize) != crc) {
+    return 0;
+  }
+#else
+  {
+    z_stream* zs = reader->inflater;
+
+    if(inflateReset(zs) != Z_OK) {
+      return 0;
+    }
+
+    zs->next_in = cblock + BGZF_HEADER;
+    zs->avail_in = bsize - BGZF_HEADER - BGZF_FOOTER;
+    zs->next_out = (unsigned char*)reader->block;
+    zs->avail_out = isize;
+
+    if(inflate(zs, Z_FINISH) != Z_STREAM_END || zs->avail_out != 0 ||
+       crc32(crc32(0L, Z_NULL, 0), (unsigned char*)reader->block, isize) != crc) {
+      return 0;
+    }
+  }
+#endif
+
+  reader->block_len = isize;
+  reader->block_coff = coff;
+  reader->inflates++;
+
+  return 1;
+}
+
+/* Read the nth frame of a zstd file in one pread and decompress
+   it in to block, the seek table told us exactly how big it is.
+
+   Returns 1 on success, 0 if the frame is damaged or can't be read.
+ */
+
+int _seq_reader_unzstd(seq_reader_t* reader, uint64_t frame) {
+#ifdef HAVE_ZSTD
+  uint64_t coff, clen, ulen;
+  size_t got;
+
+  coff = reader->gzi[frame * 2];
+  clen = reader->gzi[frame * 2 + 2] - coff;
+  ulen = reader->gzi[frame * 2 + 3] - reader->gzi[frame * 2 + 1];
+
+  reader->block_coff = UINT64_MAX;
+
+  if(pread(reader->fd, reader->cblock, clen, coff) != (ssize_t)clen) {
+    return 0;
+  }
+
+  got = ZSTD_decompressDCtx(reader->inflater, reader->block, reader->block_max,
+			    reader->cblock, clen);
+  if(ZSTD_isError(got) || got != ulen) {
+    return 0;
+  }
+
+  reader->block_len = ulen;
+  reader->block_coff = coff;
+  reader->inflates++;
+
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/* Open a UCSC .2bit file, which has its own index of sequences
+   and their N and lower case blocks, so needs no .fai. The whole
+   file is mapped, only the index is read now.
+
+   Returns 1 on success, 0 on failure, with the type left 0 if it
+   isn't a .2bit file at all.
+ */
+
+int _seq_reader_open_2bit(seq_reader_t* reader, const char* path) {
+  int fd;
+  struct stat st;
+  uint32_t signature;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    return 0;
+  }
+
+  if(fstat(fd, &st) != 0 || st.st_size < TWOBIT_HEADER ||
+     pread(fd, &signature, 4, 0) != 4 ||
+     (signature != TWOBIT_SIGNATURE && signature != __builtin_bswap32(TWOBIT_SIGNATURE))) {
+    close(fd);
+    return 0;
+  }
+
+  reader->type = SEQ_READER_2BIT;
+  reader->swap = signature != TWOBIT_SIGNATURE;
+
+  reader->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(reader->map == MAP_FAILED) {
+    reader->map = NULL;
+    return 0;
+  }
+
+  reader->map_size = st.st_size;
+
+  /* Version 1 has 64 bit offsets, for files over 4GB */
+  if(_seq_reader_2bit_u32(reader, 4) > 1 ||
+     !_seq_reader_load_2bit_index(reader, _seq_reader_2bit_u32(reader, 4), _seq_reader_2bit_u32(reader, 8))) {
+    return 0;
+  }
+
+  reader->scratch = malloc(SEQ_READER_SCRATCH);
+  if(reader->scratch == NULL) {
+    return 0;
+  }
+
+  return _seq_reader_sort_names(reader);
+}
+
+/* Fill in the index entries from the names and offsets after the
+   header, and the header of each sequence's record they point to.
+   Everything the entries point at is checked to be inside the
+   mapping, so reads never need to check again.
+
+   Returns 1 on success, 0 if the index is damaged.
+ */
+
+int _seq_reader_load_2bit_index(seq_reader_t* reader, uint32_t version, uint32_t nseqs) {
+  seq_reader_entry_t* seq;
+  uint64_t pos = TWOBIT_HEADER;
+  uint64_t record, offset_size;
+  size_t name_len;
+
+  if(nseqs == 0 || nseqs > INT32_MAX || nseqs > reader->map_size) {
+    return 0;
+  }
+
+  reader->seqs = calloc(nseqs, sizeof(seq_reader_entry_t));
+  if(reader->seqs == NULL) {
+    return 0;
+  }
+
+  offset_size = version == 1 ? 8 : 4;
+
+  for(; reader->nseqs < (int)nseqs; reader->nseqs++) {
+    seq = &(reader->seqs[reader->nseqs]);
+
+    /* Name length, name, then offset of the record */
+    if(pos + 1 > reader->map_size) {
+      return 0;
+    }
+
+    name_len = (unsigned char)reader->map[pos];
+    if(pos + 1 + name_len + offset_size > reader->map_size) {
+      return 0;
+    }
+
+    seq->name = strndup(reader->map + pos + 1, name_len);
+    if(seq->name == NULL) {
+      return 0;
+    }
+    pos += 1 + name_len;
+
+    record = _seq_reader_2bit_u32(reader, pos);
+    if(version == 1) {
+      /* The high word is second if it was written little endian */
+      if(reader->swap) {
+	record = (record << 32) | _seq_reader_2bit_u32(reader, pos + 4);
+      } else {
+	record |= (uint64_t)_seq_reader_2bit_u32(reader, pos + 4) << 32;
+      }
+    }
+    pos += offset_size;
+
+    /* dnaSize, nBlockCount, nBlockStarts, nBlockSizes, maskBlockCount,
+       maskBlockStarts, maskBlockSizes, reserved, packedDna */
+    if(record > reader->map_size || reader->map_size - record < 8) {
+      return 0;
+    }
+
+    seq->length = _seq_reader_2bit_u32(reader, record);
+    seq->n_count = _seq_reader_2bit_u32(reader, record + 4);
+    seq->n_offset = record + 8;
+
+    if(reader->map_size - seq->n_offset < (uint64_t)seq->n_count * 8 + 4) {
+      return 0;
+    }
+
+    seq->mask_count = _seq_reader_2bit_u32(reader, seq->n_offset + (uint64_t)seq->n_count * 8);
+    seq->mask_offset = seq->n_offset + (uint64_t)seq->n_count * 8 + 4;
+
+    if(reader->map_size - seq->mask_offset < (uint64_t)seq->mask_count * 8 + 4) {
+      return 0;
+    }
+
+    seq->offset = seq->mask_offset + (uint64_t)seq->mask_count * 8 + 4;
+    if(reader->map_size - seq->offset < (seq->length + 3) / 4) {
+      return 0;
+    }
+
+    seq->line_bases = seq->length > 0 ? seq->length : 1;
+    seq->line_width = seq->line_bases;
+  }
+
+  return 1;
+}
+
+/* A 32 bit word of a .2bit file, swapped if it was written on a
+   machine of the other endianness */
+
+uint32_t _seq_reader_2bit_u32(seq_reader_t* reader, uint64_t offset) {
+  uint32_t v;
+
+  memcpy(&v, reader->map + offset, 4);
+
+  return reader->swap ? __builtin_bswap32(v) : v;
+}
+
+/* Unpack len bases starting at beg (0 based) of a .2bit sequence
+   in to dest, straight out of the mapping, then lay the N and
+   lower case blocks over them.
+
+   Returns the number of bases unpacked.
+ */
+
+int64_t _seq_reader_2bit_fetch(seq_reader_t* reader, seq_reader_entry_t* seq, uint64_t beg, uint64_t len, char* dest) {
+  seq_unpack_2bit(dest, (const unsigned char*)reader->map + seq->offset, beg, len);
+
+  /* Masked Ns come out as n, as they do from twoBitToFa */
+  _seq_reader_2bit_blocks(reader, seq->n_offset, seq->n_count, beg, len, dest, 0);
+  _seq_reader_2bit_blocks(reader, seq->mask_offset, seq->mask_count, beg, len, dest, 1);
+
+  return (int64_t)len;
+}
+
+/* Lay the blocks of one table, count starts at offset followed by
+   count sizes, over the len bases from beg in dest, as Ns or by
+   lower casing if mask is set. The blocks are in order and don't
+   overlap so a binary search finds the first one reaching beg. */
+
+void _seq_reader_2bit_blocks(seq_reader_t* reader, uint64_t offset, uint32_t count, uint64_t beg, uint64_t len, char* dest, int mask) {
+  uint64_t lo = 0, hi = count, mid;
+  uint64_t start, end, i;
+
+  while(lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    end = (uint64_t)_seq_reader_2bit_u32(reader, offset + mid * 4) +
+      _seq_reader_2bit_u32(reader, offset + (uint64_t)count * 4 + mid * 4);
+    if(end <= beg) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  for(; lo < count; lo++) {
+    start = _seq_reader_2bit_u32(reader, offset + lo * 4);
+    if(start >= beg + len) {
+      break;
+    }
+
+    end = start + _seq_reader_2bit_u32(reader, offset + (uint64_t)count * 4 + lo * 4);
+    if(start < beg) {
+      start = beg;
+    }
+    if(end > beg + len) {
+      end = beg + len;
+    }
+
+    if(mask) {
+      for(i = start; i < end; i++) {
+	dest[i - beg] |= 0x20;
+      }
+    } else if(end > start) {
+      memset(dest + (start - beg), 'N', end - start);
+    }
+  }
+}
@@ -0,0 +1,198 @@
+/* Shared decompressed block cache
+
+ Decompressed BGZF blocks held in shared memory, in sets of
+ SEQ_SHARED_WAYS guarded by sequence locks so lookups never
+ block. See seq_shared_cache.h.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <string.h>
+#include "seq_shared_cache.h"
+#include "seq_block_cache.h"
+
+#define SEQ_SHARED_ROUND(n) (((n) + 63) & ~(uint64_t)63)
+
+#define SEQ_SHARED_COUNT(cache, counter) \
+  __atomic_fetch_add(&((cache)->counter), 1, __ATOMIC_RELAXED)
+
+/* Lay out a cache in size bytes of shared memory at base, before
+   the children are forked. Whatever was in the region is lost.
+
+   Returns the cache, or NULL if the region can't hold a set.
+ */
+
+seq_shared_cache_t* seq_shared_cache_init(void* base, size_t size) {
+  seq_shared_cache_t* cache = base;
+  uint64_t header, set_bytes;
+
+  header = SEQ_SHARED_ROUND(sizeof(seq_shared_cache_t));
+  set_bytes = SEQ_SHARED_ROUND(sizeof(seq_shared_set_t)) + (uint64_t)SEQ_SHARED_WAYS * SEQ_BLOCK_MAX;
+
+  if(base == NULL || size < header + set_bytes) {
+    return NULL;
+  }
+
+  memset(cache, 0, sizeof(seq_shared_cache_t));
+  cache->nsets = (size - header) / set_bytes;
+  cache->sets_off = header;
+  cache->data_off = header + SEQ_SHARED_ROUND(cache->nsets * sizeof(seq_shared_set_t));
+
+  /* The sets' headers go together at the front, the data may
+     have lost us the last set */
+  while(cache->nsets > 0 &&
+	cache->data_off + cache->nsets * SEQ_SHARED_WAYS * (uint64_t)SEQ_BLOCK_MAX > size) {
+    cache->nsets--;
+    cache->data_off = header + SEQ_SHARED_ROUND(cache->nsets * sizeof(seq_shared_set_t));
+  }
+
+  if(cache->nsets == 0) {
+    return NULL;
+  }
+
+  memset((char*)cache + cache->sets_off, 0, cache->nsets * sizeof(seq_shared_set_t));
+  cache->magic = SEQ_SHARED_MAGIC;
+
+  return cache;
+}
+
+/* Copy the block file_id has at offset in to dest, which has room
+   for max bytes.
+
+   Returns the length of the block, or -1 if it isn't held, doesn't
+   fit, or was being written while we looked.
+ */
+
+int64_t seq_shared_cache_get(seq_shared_cache_t* cache, uint64_t file_id, uint64_t offset, char* dest, size_t max) {
+  seq_shared_set_t* set;
+  seq_shared_slot_t* slot;
+  uint32_t seq;
+  uint32_t len = 0;
+  int way;
+
+  set = _seq_shared_cache_set(cache, file_id, offset);
+
+  seq = __atomic_load_n(&(set->seq), __ATOMIC_ACQUIRE);
+  if(seq & 1) {
+    SEQ_SHARED_COUNT(cache, misses);
+    return -1;
+  }
+
+  for(way = 0; way < SEQ_SHARED_WAYS; way++) {
+    slot = &(set->slots[way]);
+    len = __atomic_load_n(&(slot->len), __ATOMIC_RELAXED);
+    if(len > 0 &&
+       __atomic_load_n(&(slot->file_id), __ATOMIC_RELAXED) == file_id &&
+       __atomic_load_n(&(slot->offset), __ATOMIC_RELAXED) == offset) {
+      break;
+    }
+  }
+
+  if(way == SEQ_SHARED_WAYS || len > max) {
+    SEQ_SHARED_COUNT(cache, misses);
+    return -1;
+  }
+
+  memcpy(dest, _seq_shared_cache_data(cache, set, way), len);
+
+  /* If a writer got in while we copied what we have is torn */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if(__atomic_load_n(&(set->seq), __ATOMIC_RELAXED) != seq) {
+    SEQ_SHARED_COUNT(cache, misses);
+    return -1;
+  }
+
+  __atomic_store_n(&(slot->stamp), SEQ_SHARED_COUNT(cache, clock), __ATOMIC_RELAXED);
+  SEQ_SHARED_COUNT(cache, hits);
+
+  return (int64_t)len;
+}
+
+/* Store a block just decompressed, in an empty slot of its set
+   or over the least recently used one. If another child is
+   writing to the set we don't wait, the block just isn't stored.
+
+   Returns 1 if the block is held, 0 if not.
+ */
+
+int seq_shared_cache_put(seq_shared_cache_t* cache, uint64_t file_id, uint64_t offset, const char* data, size_t len) {
+  seq_shared_set_t* set;
+  seq_shared_slot_t* slot;
+  uint32_t seq;
+  int way, victim = 0;
+
+  if(len == 0 || len > SEQ_BLOCK_MAX) {
+    return 0;
+  }
+
+  set = _seq_shared_cache_set(cache, file_id, offset);
+
+  seq = __atomic_load_n(&(set->seq), __ATOMIC_RELAXED);
+  if((seq & 1) ||
+     !__atomic_compare_exchange_n(&(set->seq), &seq, seq + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    SEQ_SHARED_COUNT(cache, busy);
+    return 0;
+  }
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  for(way = 0; way < SEQ_SHARED_WAYS; way++) {
+    slot = &(set->slots[way]);
+
+    /* Another child beat us to it */
+    if(slot->len > 0 && slot->file_id == file_id && slot->offset == offset) {
+      __atomic_store_n(&(set->seq), seq + 2, __ATOMIC_RELEASE);
+      return 1;
+    }
+
+    if(slot->len == 0) {
+      if(set->slots[victim].len > 0) {
+	victim = way;
+      }
+    } else if(set->slots[victim].len > 0 && slot->stamp < set->slots[victim].stamp) {
+      victim = way;
+    }
+  }
+
+  slot = &(set->slots[victim]);
+  if(slot->len > 0) {
+    SEQ_SHARED_COUNT(cache, evictions);
+  }
+
+  memcpy(_seq_shared_cache_data(cache, set, victim), data, len);
+  __atomic_store_n(&(slot->file_id), file_id, __ATOMIC_RELAXED);
+  __atomic_store_n(&(slot->offset), offset, __ATOMIC_RELAXED);
+  __atomic_store_n(&(slot->len), (uint32_t)len, __ATOMIC_RELAXED);
+  __atomic_store_n(&(slot->stamp), SEQ_SHARED_COUNT(cache, clock), __ATOMIC_RELAXED);
+
+  __atomic_store_n(&(set->seq), seq + 2, __ATOMIC_RELEASE);
+  SEQ_SHARED_COUNT(cache, stores);
+
+  return 1;
+}
+
+seq_shared_set_t* _seq_shared_cache_set(seq_shared_cache_t* cache, uint64_t file_id, uint64_t offset) {
+  uint64_t hash;
+
+  hash = (offset ^ (file_id * 0xC2B2AE3D27D4EB4FULL)) * 0x9E3779B97F4A7C15ULL;
+
+  return (seq_shared_set_t*)((char*)cache + cache->sets_off) + (hash >> 32) % cache->nsets;
+}
+
+char* _seq_shared_cache_data(seq_shared_cache_t* cache, seq_shared_set_t* set, int way) {
+  uint64_t slot;
+
+  slot = (uint64_t)(set - (seq_shared_set_t*)((char*)cache + cache->sets_off)) * SEQ_SHARED_WAYS + way;
+
+  return (char*)cache + cache->data_off + slot * SEQ_BLOCK_MAX;
+}
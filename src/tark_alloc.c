@@ -0,0 +1,190 @@
+/* Allocator hooks
+
+ The malloc fallback and a bump arena for librefseq's allocator
+ hooks, see tark_alloc.h.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "tark_alloc.h"
+
+#define TARK_ARENA_ROUND(n) (((n) + TARK_ARENA_ALIGN - 1) & ~(size_t)(TARK_ARENA_ALIGN - 1))
+
+/* Allocate through alloc, malloc if it's NULL or has no alloc */
+
+void* tark_alloc(const tark_allocator_t* alloc, size_t size) {
+  if(alloc == NULL || alloc->alloc == NULL) {
+    return malloc(size);
+  }
+
+  return alloc->alloc(alloc->ctx, size);
+}
+
+/* Give back memory from tark_alloc, nothing happens if the
+   allocator releases everything in one go */
+
+void tark_free(const tark_allocator_t* alloc, void* ptr) {
+  if(ptr == NULL) {
+    return;
+  }
+
+  if(alloc == NULL || alloc->alloc == NULL) {
+    free(ptr);
+  } else if(alloc->free != NULL) {
+    alloc->free(alloc->ctx, ptr);
+  }
+}
+
+/* A block and its data in one allocation, the data starting on
+   an aligned boundary after the header */
+
+static tark_arena_block_t* _tark_arena_new_block(size_t size) {
+  tark_arena_block_t* block;
+
+  block = malloc(TARK_ARENA_ROUND(sizeof(tark_arena_block_t)) + size);
+  if(block == NULL) {
+    return NULL;
+  }
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  block->data = (char*)block + TARK_ARENA_ROUND(sizeof(tark_arena_block_t));
+
+  return block;
+}
+
+/* Create an arena handing out memory from blocks of block_size,
+   TARK_ARENA_BLOCK if it's 0. No block is allocated until the
+   first allocation.
+
+   Returns NULL if we're out of memory.
+*/
+
+tark_arena_t* tark_arena_create(size_t block_size) {
+  tark_arena_t* arena;
+
+  arena = calloc(1, sizeof(tark_arena_t));
+  if(arena == NULL) {
+    return NULL;
+  }
+
+  arena->block_size = block_size ? TARK_ARENA_ROUND(block_size) : TARK_ARENA_BLOCK;
+
+  return arena;
+}
+
+/* Take size bytes from the current block, starting a new one when
+   it's full. Anything bigger than a block gets a block of its own,
+   put behind the current one so what's left of that still gets used.
+   Takes a void* so it can be the alloc of a tark_allocator_t.
+
+   Returns NULL if we're out of memory.
+*/
+
+void* tark_arena_alloc(void* ctx, size_t size) {
+  tark_arena_t* arena = ctx;
+  tark_arena_block_t* block = arena->blocks;
+  void* ptr;
+
+  size = TARK_ARENA_ROUND(size ? size : 1);
+
+  if(block != NULL && block->size - block->used >= size) {
+    ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+  }
+
+  if(size > arena->block_size) {
+    block = _tark_arena_new_block(size);
+    if(block == NULL) {
+      return NULL;
+    }
+
+    if(arena->blocks != NULL) {
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    } else {
+      arena->blocks = block;
+    }
+
+  } else {
+    block = _tark_arena_new_block(arena->block_size);
+    if(block == NULL) {
+      return NULL;
+    }
+
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+
+  block->used = size;
+  return block->data;
+}
+
+/* Give back everything allocated from the arena, keeping one
+   block to start again with so a loop resetting the arena each
+   time round doesn't go back to malloc */
+
+void tark_arena_reset(tark_arena_t* arena) {
+  tark_arena_block_t* block;
+  tark_arena_block_t* next;
+  tark_arena_block_t* keep = NULL;
+
+  for(block = arena->blocks; block != NULL; block = next) {
+    next = block->next;
+    if(keep == NULL && block->size == arena->block_size) {
+      keep = block;
+    } else {
+      free(block);
+    }
+  }
+
+  if(keep != NULL) {
+    keep->next = NULL;
+    keep->used = 0;
+  }
+  arena->blocks = keep;
+}
+
+void tark_arena_destroy(tark_arena_t* arena) {
+  tark_arena_block_t* block;
+  tark_arena_block_t* next;
+
+  if(arena == NULL) {
+    return;
+  }
+
+  for(block = arena->blocks; block != NULL; block = next) {
+    next = block->next;
+    free(block);
+  }
+
+  free(arena);
+}
+
+/* An allocator drawing on the arena, nothing is freed until
+   the arena is reset or destroyed */
+
+tark_allocator_t tark_arena_allocator(tark_arena_t* arena) {
+  tark_allocator_t alloc;
+
+  alloc.alloc = tark_arena_alloc;
+  alloc.free = NULL;
+  alloc.ctx = arena;
+
+  return alloc;
+}
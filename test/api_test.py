@@ -22,6 +22,7 @@
 from __future__ import print_function
 
 import requests
+import json
 import os
 import hashlib
 import sys
@@ -191,6 +192,23 @@ def test_translate():
 
     compare( get_endpoint(test_server, "/faidx/83b02c391f9109ea4d5106bce5fce846?translate=1", extra_headers={ "Range": "553-584,665-696" }), "NEICQSEKDKYKPHESLNVREX", "Testing multi-range translate, different frame" )
 
+    compare( get_status_code(test_server, "/faidx/83b02c391f9109ea4d5106bce5fce846?start=554&end=585&translate=1&code=2"), 200, "Testing translating with another genetic code" )
+
+    compare( get_status_code(test_server, "/faidx/83b02c391f9109ea4d5106bce5fce846?start=554&end=585&translate=1&code=4294967298"), 400, "Checking for 400 on a genetic code that overflows an int" )
+
+def test_frames():
+    print( "Testing six frame translation" )
+
+    r = get(test_server, "/faidx/83b02c391f9109ea4d5106bce5fce846?start=554&end=585&frames=6", content_type='application/json', die_on_errors=False)
+    try:
+        records = json.loads(r.text)
+    except ValueError:
+        records = None
+    compare( records is not None, True, "Parsing six frame JSON" )
+    if records is not None:
+        compare( [ record['frame'] for record in records ], [ 1, 2, 3, -1, -2, -3 ], "Six frame JSON records" )
+        compare( records[0]['seq'], "MKYVNQRKTN", "Six frame JSON frame +1, whole codons" )
+
 
 if __name__ == "__main__":
     """
@@ -220,6 +238,8 @@ if __name__ == "__main__":
 
     test_translate()
 
+    test_frames()
+
     if failures > 0:
         print( "{} tests failed".format(failures) )
         sys.exit(-1)
@@ -18,6 +18,9 @@
  limitations under the License.
 */
 
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "files_manager.h"
 
 #include "test_harness.h"
@@ -34,6 +37,19 @@ int main(int argc, const char* argv[]) {
   files_mgr_t* fm;
   seq_file_t* seqfile;
   const unsigned char** checksums;
+  seq_block_cache_t* cache;
+  seq_reader_t* reader;
+  const char* block;
+  char data[300];
+  char* seq;
+  char* faidx_seq;
+  size_t len, i;
+  seq_shared_cache_t* shared;
+  char* region;
+  size_t region_size = 4 * 1048576;
+  pid_t pid;
+  int status;
+  int seq_len;
 
   checksums = malloc(2 * sizeof(char*));
 
@@ -62,6 +78,196 @@ int main(int argc, const char* argv[]) {
   files_mgr_resize_cache(fm, 1);
   ASSERT_FALSE( files_mgr_seqfile_usable(seqfile) );
 
+  /* The block cache holds up to its budget, dropping the least
+     recently used blocks to make room */
+  cache = seq_block_cache_create(300);
+  ASSERT_PTR_NOTNULL(cache);
+  memset(data, 'A', sizeof(data));
+
+  ASSERT_PTR_EQUAL(NULL, seq_block_cache_get(cache, 1, 0, &len));
+  ASSERT_PTR_NOTNULL( seq_block_cache_put(cache, 1, 0, data, 100) );
+  ASSERT_PTR_NOTNULL( seq_block_cache_put(cache, 1, 500, data, 100) );
+  ASSERT_PTR_NOTNULL( seq_block_cache_put(cache, 2, 0, data, 100) );
+  ASSERT_INT_EQUAL(300, cache->used);
+
+  block = seq_block_cache_get(cache, 1, 0, &len);
+  ASSERT_PTR_NOTNULL(block);
+  ASSERT_INT_EQUAL(100, len);
+  ASSERT_INT_EQUAL(0, memcmp(block, data, 100));
+
+  /* 1:500 is now the oldest */
+  ASSERT_PTR_NOTNULL( seq_block_cache_put(cache, 3, 0, data, 50) );
+  ASSERT_PTR_EQUAL(NULL, seq_block_cache_get(cache, 1, 500, &len));
+  ASSERT_PTR_NOTNULL( seq_block_cache_get(cache, 2, 0, &len) );
+  ASSERT_INT_EQUAL(250, cache->used);
+  ASSERT_INT_EQUAL(1, cache->evictions);
+  ASSERT_INT_EQUAL(2, cache->hits);
+  ASSERT_INT_EQUAL(2, cache->misses);
+
+  /* Nothing bigger than the budget, nothing at all with none */
+  ASSERT_PTR_EQUAL(NULL, seq_block_cache_put(cache, 4, 0, data, 301));
+
+  seq_block_cache_drop(cache, 1);
+  ASSERT_PTR_EQUAL(NULL, seq_block_cache_get(cache, 1, 0, &len));
+  ASSERT_INT_EQUAL(150, cache->used);
+
+  seq_block_cache_resize(cache, 0);
+  ASSERT_INT_EQUAL(0, cache->used);
+  ASSERT_INT_EQUAL(0, cache->nblocks);
+  ASSERT_PTR_EQUAL(NULL, seq_block_cache_put(cache, 1, 0, data, 1));
+  seq_block_cache_destroy(cache);
+
+  /* Plenty of blocks, so the hash has to grow */
+  cache = seq_block_cache_create(1000 * 10);
+  for(i = 0; i < 1000; i++) {
+    ASSERT_PTR_NOTNULL( seq_block_cache_put(cache, 1, i * 1000, data, 10) );
+  }
+  ASSERT_TRUE(cache->nbuckets >= 1000);
+  for(i = 0; i < 1000; i++) {
+    ASSERT_PTR_NOTNULL( seq_block_cache_get(cache, 1, i * 1000, &len) );
+  }
+  ASSERT_INT_EQUAL(0, cache->evictions);
+  seq_block_cache_destroy(cache);
+
+  /* bgzip files read their blocks through the files manager's cache */
+  seqfile = files_mgr_use_seqfile(fm, checksums[1]);
+  ASSERT_PTR_NOTNULL(seqfile);
+  reader = seqfile->reader;
+  ASSERT_PTR_NOTNULL(reader);
+  ASSERT_PTR_EQUAL(fm->blocks, reader->blocks);
+  ASSERT_INT_EQUAL(2, reader->ngzi);
+
+  seq = malloc(49980);
+  ASSERT_INT_EQUAL(49980, seq_reader_fetch(reader, 0, 0, 49980, seq));
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "1", 0, 49979, &seq_len);
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, 49980));
+  free(faidx_seq);
+  ASSERT_INT_EQUAL(1, reader->inflates);
+  ASSERT_TRUE(fm->blocks->used > 0);
+
+  /* Found in the cache once bgzf has moved on to another block,
+     once for each line either side of the line break */
+  reader->block_coff = UINT64_MAX;
+  ASSERT_INT_EQUAL(10, seq_reader_fetch(reader, 0, 55, 10, seq));
+  ASSERT_INT_EQUAL(1, reader->inflates);
+  ASSERT_INT_EQUAL(2, fm->blocks->hits);
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "1", 55, 64, &seq_len);
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, 10));
+  free(faidx_seq);
+
+  /* With the cache turned off every other block is read again */
+  files_mgr_resize_block_cache(fm, 0);
+  ASSERT_INT_EQUAL(0, fm->blocks->used);
+  reader->block_coff = UINT64_MAX;
+  ASSERT_INT_EQUAL(10, seq_reader_fetch(reader, 0, 55, 10, seq));
+  ASSERT_INT_EQUAL(2, reader->inflates);
+  files_mgr_resize_block_cache(fm, DEFAULT_BLOCK_CACHE_SIZE);
+
+  /* Closing the file drops its blocks */
+  reader->block_coff = UINT64_MAX;
+  ASSERT_INT_EQUAL(10, seq_reader_fetch(reader, 0, 55, 10, seq));
+  ASSERT_TRUE(fm->blocks->used > 0);
+  files_mgr_close_file(fm, seqfile);
+  ASSERT_INT_EQUAL(0, fm->blocks->used);
+
+  /* A shared cache takes what sets fit in its memory, and
+     refuses memory too small for one */
+  region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ASSERT_TRUE(region != MAP_FAILED);
+  ASSERT_PTR_EQUAL(NULL, seq_shared_cache_init(region, 8 * SEQ_BLOCK_MAX));
+
+  shared = seq_shared_cache_init(region, region_size);
+  ASSERT_PTR_NOTNULL(shared);
+  ASSERT_INT_EQUAL(7, shared->nsets);
+
+  ASSERT_INT64_EQUAL(-1, seq_shared_cache_get(shared, 1, 0, data, sizeof(data)));
+  ASSERT_TRUE( seq_shared_cache_put(shared, 1, 0, data, 100) );
+  ASSERT_TRUE( seq_shared_cache_put(shared, 1, 0, data, 100) );
+  ASSERT_INT_EQUAL(1, shared->stores);
+  memset(data, 0, 100);
+  ASSERT_INT64_EQUAL(100, seq_shared_cache_get(shared, 1, 0, data, sizeof(data)));
+  ASSERT_INT_EQUAL('A', data[99]);
+  ASSERT_INT64_EQUAL(-1, seq_shared_cache_get(shared, 1, 0, data, 99));
+
+  /* A set being written to is skipped, not waited on */
+  _seq_shared_cache_set(shared, 1, 0)->seq++;
+  ASSERT_INT64_EQUAL(-1, seq_shared_cache_get(shared, 1, 0, data, sizeof(data)));
+  ASSERT_FALSE( seq_shared_cache_put(shared, 1, 0, data, 100) );
+  ASSERT_INT_EQUAL(1, shared->busy);
+  _seq_shared_cache_set(shared, 1, 0)->seq++;
+
+  /* The least recently used block of a full set goes */
+  for(i = 0; i < 7 * SEQ_SHARED_WAYS * 4; i++) {
+    seq_shared_cache_put(shared, 2, i, data, 10);
+  }
+  ASSERT_TRUE(shared->evictions > 0);
+  ASSERT_INT64_EQUAL(-1, seq_shared_cache_get(shared, 1, 0, data, sizeof(data)));
+
+  /* A block one process decompresses is used by another */
+  ASSERT_INT_EQUAL(APR_SUCCESS, files_mgr_share_blocks(fm, region, region_size));
+  shared = fm->blocks->shared;
+  ASSERT_INT_EQUAL(0, shared->stores);
+
+  pid = fork();
+  if(pid == 0) {
+    seqfile = files_mgr_use_seqfile(fm, checksums[1]);
+    if(seqfile == NULL || seq_reader_fetch(seqfile->reader, 0, 1000, 100, seq) != 100) {
+      _exit(1);
+    }
+    _exit(seqfile->reader->inflates == 1 ? 0 : 2);
+  }
+  ASSERT_TRUE(pid > 0);
+  ASSERT_INT_EQUAL(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_INT_EQUAL(0, WEXITSTATUS(status));
+  ASSERT_INT_EQUAL(1, shared->stores);
+
+  seqfile = files_mgr_use_seqfile(fm, checksums[1]);
+  reader = seqfile->reader;
+  ASSERT_INT_EQUAL(100, seq_reader_fetch(reader, 0, 1000, 100, seq));
+  ASSERT_INT_EQUAL(0, reader->inflates);
+  ASSERT_INT_EQUAL(1, shared->hits);
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "1", 1000, 1099, &seq_len);
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, 100));
+  free(faidx_seq);
+
+  /* and kept locally once it has been copied over */
+  ASSERT_TRUE(fm->blocks->used > 0);
+
+  files_mgr_close_file(fm, seqfile);
+  free(seq);
+
+  destroy_files_mgr(fm);
+  munmap(region, region_size);
+
+  /* bgzip files with both indexes can skip htslib altogether */
+  ASSERT_INT_EQUAL(FM_BGZF, files_mgr_file_type(human));
+  ASSERT_INT_EQUAL(FM_FAIDX, files_mgr_file_type(cat));
+  ASSERT_INT_EQUAL(FM_FAIDX, files_mgr_file_type("Homo_sapiens.missing.fa.gz"));
+
+  fm = init_files_mgr(mp);
+  checksums[1] = files_mgr_add_seqfile(fm, human, FM_BGZF);
+  ASSERT_PTR_NOTNULL(checksums[1]);
+  ASSERT_PTR_EQUAL(NULL, files_mgr_add_seqfile(fm, cat, FM_BGZF));
+
+  seqfile = files_mgr_use_seqfile(fm, checksums[1]);
+  ASSERT_PTR_NOTNULL(seqfile);
+  ASSERT_TRUE( files_mgr_seqfile_usable(seqfile) );
+  ASSERT_PTR_EQUAL(seqfile->reader, seqfile->file_ptr);
+  ASSERT_PTR_EQUAL(NULL, files_mgr_faidx(seqfile));
+  ASSERT_PTR_EQUAL(fm->blocks, seqfile->reader->blocks);
+  ASSERT_INT_EQUAL(1, apr_hash_count(seqfile->sequences));
+  ASSERT_INT64_EQUAL(49980, files_mgr_seq_len(seqfile, apr_hash_get(seqfile->sequences, "1", APR_HASH_KEY_STRING)));
+
+  seq = malloc(10);
+  ASSERT_INT_EQUAL(6, seq_reader_fetch(seqfile->reader, 0, 60, 6, seq));
+  ASSERT_INT_EQUAL(0, memcmp("ACCCTA", seq, 6));
+  free(seq);
+
+  files_mgr_close_file(fm, seqfile);
+  ASSERT_FALSE( files_mgr_seqfile_usable(seqfile) );
+  ASSERT_PTR_EQUAL(NULL, seqfile->reader);
+
   destroy_files_mgr(fm);
 
   return 0;
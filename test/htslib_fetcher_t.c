@@ -23,9 +23,362 @@
 
 #include "test_harness.h"
 
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 char* cat = INSERT_DATA_PATH "test/data-files/Felis_catus.Felis_catus_6.2.dna.sample.fa";
 char* human = INSERT_DATA_PATH "test/data-files/Homo_sapiens.sample.fa.gz";
 
+/* A synthetic sequence longer than an unsigned int can count, as a
+   sparse file with bases written only either side of the 4Gbp mark,
+   60 bases a line. big_base is the base at p. */
+
+#define BIG_LENGTH 4500000000ULL
+#define BIG_REGION_START 4294800000ULL
+#define BIG_REGION_END 4295400000ULL
+
+char* big = "big_t.fa";
+
+/* A bgzip file of two sequences, 70 bases a line, cut in to
+   blocks of an odd size so lines and bases straddle them, with
+   its .fai and .gzi. small_base is the base at p of sequence s.
+   The same text as seekable zstd, in frames of another odd size. */
+
+#define SMALL_LENGTH_A 200000
+#define SMALL_LENGTH_B 1000
+#define SMALL_BLOCK 4099
+#define SMALL_FRAME 9001
+
+char* small = "small_t.fa.gz";
+char* small_zst = "small_t.fa.zst";
+
+char small_base(int s, uint64_t p) {
+  return "ACGTacgt"[((p * 2654435761ULL + s * 40503ULL) >> 11) & 7];
+}
+
+void put_le32(FILE* f, uint32_t v) {
+  int j;
+
+  for(j = 0; j < 4; j++) {
+    fputc((v >> (j * 8)) & 0xff, f);
+  }
+}
+
+void put_le64(FILE* f, uint64_t v) {
+  int j;
+
+  for(j = 0; j < 8; j++) {
+    fputc((v >> (j * 8)) & 0xff, f);
+  }
+}
+
+/* The uncompressed text of the small files, writing its .fai for
+   path */
+
+char* small_text(const char* path, uint64_t* text_len) {
+  char name[256];
+  char* text;
+  uint64_t p;
+  FILE* f;
+  int s;
+  uint64_t lengths[2] = { SMALL_LENGTH_A, SMALL_LENGTH_B };
+
+  text = malloc(SMALL_LENGTH_A + SMALL_LENGTH_B + 10000);
+  if(text == NULL) return NULL;
+
+  sprintf(name, "%s.fai", path);
+  f = fopen(name, "w");
+  if(f == NULL) return NULL;
+
+  *text_len = 0;
+  for(s = 0; s < 2; s++) {
+    *text_len += sprintf(text + *text_len, ">%c\n", 'a' + s);
+    fprintf(f, "%c\t%llu\t%llu\t70\t71\n", 'a' + s, (unsigned long long)lengths[s], (unsigned long long)*text_len);
+    for(p = 0; p < lengths[s]; p++) {
+      text[(*text_len)++] = small_base(s, p);
+      if(p % 70 == 69 || p == lengths[s] - 1) {
+	text[(*text_len)++] = '\n';
+      }
+    }
+  }
+  fclose(f);
+
+  return text;
+}
+
+int make_bgzf_fasta(const char* path, uint64_t* nblocks) {
+  char name[256];
+  char* text;
+  unsigned char block[SMALL_BLOCK + 1024];
+  uint64_t* offsets;
+  uint64_t text_len, coff = 0, i;
+  uint32_t crc;
+  size_t n;
+  z_stream zs;
+  FILE* f;
+  int j;
+
+  text = small_text(path, &text_len);
+  if(text == NULL) return 0;
+
+  /* Every block plus the empty one marking the end */
+  *nblocks = (text_len + SMALL_BLOCK - 1) / SMALL_BLOCK + 1;
+  offsets = malloc(*nblocks * sizeof(uint64_t));
+  f = fopen(path, "wb");
+  if(f == NULL || offsets == NULL) return 0;
+
+  for(i = 0; i < *nblocks; i++) {
+    n = (i + 1) * SMALL_BLOCK > text_len ? text_len - i * SMALL_BLOCK : SMALL_BLOCK;
+    if(i == *nblocks - 1) n = 0;
+
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = (unsigned char*)text + i * SMALL_BLOCK;
+    zs.avail_in = n;
+    zs.next_out = block + 18;
+    zs.avail_out = sizeof(block) - 26;
+    deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+
+    memcpy(block, "\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+    block[16] = (zs.total_out + 25) & 0xff;
+    block[17] = (zs.total_out + 25) >> 8;
+    crc = crc32(0L, (unsigned char*)text + i * SMALL_BLOCK, n);
+    for(j = 0; j < 4; j++) {
+      block[18 + zs.total_out + j] = (crc >> (j * 8)) & 0xff;
+      block[22 + zs.total_out + j] = (n >> (j * 8)) & 0xff;
+    }
+
+    offsets[i] = coff;
+    fwrite(block, 1, zs.total_out + 26, f);
+    coff += zs.total_out + 26;
+  }
+  fclose(f);
+
+  /* The first block isn't in the .gzi */
+  sprintf(name, "%s.gzi", path);
+  f = fopen(name, "wb");
+  if(f == NULL) return 0;
+  put_le64(f, *nblocks - 1);
+  for(i = 1; i < *nblocks; i++) {
+    put_le64(f, offsets[i]);
+    put_le64(f, i * SMALL_BLOCK > text_len ? text_len : i * SMALL_BLOCK);
+  }
+  fclose(f);
+
+  free(offsets);
+  free(text);
+
+  return 1;
+}
+
+#ifdef HAVE_ZSTD
+/* Independent frames then the seek table, with checksums (which
+   the reader skips) so its entries are the longer kind */
+
+int make_zstd_fasta(const char* path, uint64_t* nframes) {
+  char* text;
+  char* frame;
+  uint32_t* sizes;
+  uint64_t text_len, i;
+  size_t n, bound;
+  FILE* f;
+
+  text = small_text(path, &text_len);
+  if(text == NULL) return 0;
+
+  *nframes = (text_len + SMALL_FRAME - 1) / SMALL_FRAME;
+  bound = ZSTD_compressBound(SMALL_FRAME);
+  frame = malloc(bound);
+  sizes = malloc(*nframes * 2 * sizeof(uint32_t));
+  f = fopen(path, "wb");
+  if(f == NULL || frame == NULL || sizes == NULL) return 0;
+
+  for(i = 0; i < *nframes; i++) {
+    n = (i + 1) * SMALL_FRAME > text_len ? text_len - i * SMALL_FRAME : SMALL_FRAME;
+    sizes[i * 2] = ZSTD_compress(frame, bound, text + i * SMALL_FRAME, n, 3);
+    sizes[i * 2 + 1] = n;
+    if(ZSTD_isError(sizes[i * 2])) return 0;
+    fwrite(frame, 1, sizes[i * 2], f);
+  }
+
+  put_le32(f, 0x184D2A5E);
+  put_le32(f, *nframes * 12 + 9);
+  for(i = 0; i < *nframes; i++) {
+    put_le32(f, sizes[i * 2]);
+    put_le32(f, sizes[i * 2 + 1]);
+    put_le32(f, 0);
+  }
+  put_le32(f, *nframes);
+  fputc(0x80, f);
+  put_le32(f, 0x8F92EAB1);
+  fclose(f);
+
+  free(sizes);
+  free(frame);
+  free(text);
+
+  return 1;
+}
+#endif
+
+/* A .2bit file of the sequences given as text, N runs becoming N
+   blocks and lower case runs mask blocks, written in the other
+   endianness if swap is set and with 64 bit offsets for version 1 */
+
+#define TWOBIT_LENGTH_A 100003
+
+char* twobit = "small_t.2bit";
+
+void put_2bit32(FILE* f, uint32_t v, int swap) {
+  put_le32(f, swap ? __builtin_bswap32(v) : v);
+}
+
+void put_2bit_blocks(FILE* f, const char* text, int mask, int swap) {
+  uint32_t starts[4096], sizes[4096];
+  uint32_t n = 0, i;
+  size_t p;
+  int in;
+
+  for(p = 0; text[p]; p++) {
+    in = mask ? (text[p] >= 'a') : (text[p] == 'N' || text[p] == 'n');
+    if(in && (n == 0 || starts[n - 1] + sizes[n - 1] != p)) {
+      starts[n] = p;
+      sizes[n++] = 1;
+    } else if(in) {
+      sizes[n - 1]++;
+    }
+  }
+
+  put_2bit32(f, n, swap);
+  for(i = 0; i < n; i++) put_2bit32(f, starts[i], swap);
+  for(i = 0; i < n; i++) put_2bit32(f, sizes[i], swap);
+}
+
+int make_2bit(const char* path, const char** names, const char** texts, int nseqs, int swap, int version) {
+  uint64_t offsets[8];
+  uint64_t record;
+  size_t len, p;
+  unsigned char b;
+  FILE* f;
+  int s;
+
+  f = fopen(path, "wb");
+  if(f == NULL) return 0;
+
+  /* Records follow the index, so we work out where they'll be */
+  record = 16;
+  for(s = 0; s < nseqs; s++) {
+    record += 1 + strlen(names[s]) + (version ? 8 : 4);
+  }
+
+  put_2bit32(f, 0x1A412743, swap);
+  put_2bit32(f, version, swap);
+  put_2bit32(f, nseqs, swap);
+  put_2bit32(f, 0, swap);
+
+  for(s = 0; s < nseqs; s++) {
+    fputc(strlen(names[s]), f);
+    fputs(names[s], f);
+    offsets[s] = record;
+    if(version) {
+      put_2bit32(f, swap ? record >> 32 : record & 0xffffffff, swap);
+      put_2bit32(f, swap ? record & 0xffffffff : record >> 32, swap);
+    } else {
+      put_2bit32(f, record, swap);
+    }
+
+    /* The record's size, counting its blocks as we'll write them */
+    len = strlen(texts[s]);
+    record += 8 + 4 + 4 + (len + 3) / 4;
+    for(p = 0; p < len; p++) {
+      if((texts[s][p] == 'N' || texts[s][p] == 'n') && (p == 0 || (texts[s][p - 1] != 'N' && texts[s][p - 1] != 'n'))) record += 8;
+      if(texts[s][p] >= 'a' && (p == 0 || texts[s][p - 1] < 'a')) record += 8;
+    }
+  }
+
+  for(s = 0; s < nseqs; s++) {
+    if((uint64_t)ftell(f) != offsets[s]) return 0;
+    len = strlen(texts[s]);
+    put_2bit32(f, len, swap);
+    put_2bit_blocks(f, texts[s], 0, swap);
+    put_2bit_blocks(f, texts[s], 1, swap);
+    put_2bit32(f, 0, swap);
+
+    for(p = 0, b = 0; p < len; p++) {
+      b = (b << 2) | (strchr("TCAG", texts[s][p] & ~0x20) ? strchr("TCAG", texts[s][p] & ~0x20) - "TCAG" : 0);
+      if(p % 4 == 3) {
+	fputc(b, f);
+	b = 0;
+      }
+    }
+    if(len % 4) {
+      fputc(b << (2 * (4 - len % 4)), f);
+    }
+  }
+
+  fclose(f);
+
+  return 1;
+}
+
+/* An allocator counting what it has handed out and not had back */
+
+void* counting_alloc(void* ctx, size_t size) {
+  (*(int*)ctx)++;
+  return malloc(size);
+}
+
+void counting_free(void* ctx, void* ptr) {
+  (*(int*)ctx)--;
+  free(ptr);
+}
+
+char big_base(uint64_t p) {
+  /* Mixed well enough to have start and stop codons */
+  p *= 0x9E3779B97F4A7C15ULL;
+  p ^= p >> 31;
+  p *= 0xBF58476D1CE4E5B9ULL;
+  return "ACGT"[p >> 62];
+}
+
+int make_big_fasta(const char* path) {
+  char fai[256];
+  char line[61];
+  FILE* f;
+  uint64_t p;
+  int i;
+
+  f = fopen(path, "w");
+  if(f == NULL) return 0;
+  fputs(">big\n", f);
+  fseeko(f, 5 + BIG_REGION_START / 60 * 61, SEEK_SET);
+  for(p = BIG_REGION_START; p < BIG_REGION_END; p += 60) {
+    for(i = 0; i < 60; i++) {
+      line[i] = big_base(p + i);
+    }
+    line[60] = '\n';
+    fwrite(line, 1, 61, f);
+  }
+  fflush(f);
+  if(ftruncate(fileno(f), 5 + BIG_LENGTH / 60 * 61) != 0) {
+    fclose(f);
+    return 0;
+  }
+  fclose(f);
+
+  sprintf(fai, "%s.fai", path);
+  f = fopen(fai, "w");
+  if(f == NULL) return 0;
+  fprintf(f, "big\t%llu\t5\t60\t61\n", BIG_LENGTH);
+  fclose(f);
+
+  return 1;
+}
+
 /*
   Test the files_manager interface
  */
@@ -36,7 +389,27 @@ int main(int argc, const char* argv[]) {
   seq_file_t* seqfile;
   const unsigned char** checksums;
   char* seq;
+  char* faidx_seq;
   int seq_len;
+  char* frames[6];
+  int frame_lens[6];
+  seq_orf_t* orfs;
+  seq_iterator_t* siterator;
+  seq_reader_t* reader;
+  tark_allocator_t counting;
+  tark_allocator_t arena_alloc;
+  tark_arena_t* arena;
+  tark_span_t spans[4];
+  seq_block_cache_t* blocks;
+  uint64_t nblocks, inflates, beg, len;
+  const char* twobit_names[2] = { "chr1", "chrUn" };
+  char* twobit_texts[2];
+  int j, norfs;
+#ifdef HAVE_ZSTD
+  const char* run;
+#endif
+  FILE* f;
+  int i;
 
   checksums = malloc(2 * sizeof(char*));
 
@@ -58,5 +431,762 @@ int main(int argc, const char* argv[]) {
   ASSERT_STR_EQUAL("ACCCTA", seq);
   ASSERT_INT_EQUAL(6, seq_len);
 
+  /* bgzip files are read directly through BGZF */
+  reader = seqfile->reader;
+  ASSERT_PTR_NOTNULL(reader);
+  ASSERT_INT_EQUAL(SEQ_READER_BGZF, reader->type);
+
+  seq = malloc(100);
+  ASSERT_INT_EQUAL(6, tark_fetch_seq_into(reader, 0, 60, 65, seq));
+  seq[6] = '\0';
+  ASSERT_STR_EQUAL("ACCCTA", seq);
+
+  /* Across a line break in the file */
+  ASSERT_INT_EQUAL(10, tark_fetch_seq_into(reader, 0, 55, 64, seq));
+  seq[10] = '\0';
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "1", 55, 64, &seq_len);
+  ASSERT_STR_EQUAL(faidx_seq, seq);
+  free(faidx_seq);
+
+  /* Past the end of the sequence */
+  ASSERT_INT_EQUAL(-1, tark_fetch_seq_into(reader, 0, 49975, 49980, seq));
+  free(seq);
+
+  /* Segments close enough together to fit in the reader's scratch
+     are read as one extent, whatever order they're asked for in */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 0, "100-109,200-209,150-159,40000-40010,120-130:1", 0);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_INT_EQUAL(1, siterator->nextents);
+  ASSERT_INT_EQUAL(100, siterator->extents[0].start);
+  ASSERT_INT_EQUAL(40010, siterator->extents[0].end);
+  ASSERT_INT_EQUAL(0, siterator->locations[2].extent);
+
+  i = reader->reads;
+  seq_len = 1000;
+  seq = tark_iterator_fetch_seq(siterator, &seq_len, NULL);
+  ASSERT_INT_EQUAL(52, seq_len);
+  ASSERT_INT_EQUAL(i + 1, reader->reads);
+
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "1", 150, 159, &seq_len);
+  ASSERT_STR_NEQUAL(faidx_seq, seq + 20, 10);
+  free(faidx_seq);
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "1", 40000, 40010, &seq_len);
+  ASSERT_STR_NEQUAL(faidx_seq, seq + 30, 11);
+  free(faidx_seq);
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "1", 120, 130, &seq_len);
+  ASSERT_STR_EQUAL(faidx_seq, seq + 41);
+  tark_free_iterator(siterator);
+
+  /* and backwards, the reverse complement of the same bases */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 0, "100-109,200-209,150-159,40000-40010,120-130:-1", 0);
+  seq_len = 1000;
+  faidx_seq = tark_iterator_fetch_seq(siterator, &seq_len, NULL);
+  tark_revcomp_seq(faidx_seq);
+  ASSERT_STR_EQUAL(seq, faidx_seq);
+  free(faidx_seq);
+  free(seq);
+  tark_free_iterator(siterator);
+
+  /* Uncompressed files should get a direct reader */
+  seqfile = files_mgr_get_seqfile(fm, checksums[0]);
+  reader = seqfile->reader;
+  ASSERT_PTR_NOTNULL(reader);
+  ASSERT_INT_EQUAL(SEQ_READER_MMAP, reader->type);
+  ASSERT_INT_EQUAL(2, seq_reader_nseq(reader));
+  ASSERT_INT_EQUAL(1, seq_reader_seq_id(reader, "A2"));
+  ASSERT_INT_EQUAL(-1, seq_reader_seq_id(reader, "A3"));
+  ASSERT_INT_EQUAL(3780, (int)seq_reader_seq_len(reader, 1));
+
+  /* The iterator should give the same bases reading directly as
+     through faidx, across line breaks in the file */
+  siterator = tark_fetch_iterator((faidx_t*)seqfile->file_ptr, "A1", "50-200,1000-1100:1", 0);
+  ASSERT_TRUE( tark_iterator_set_reader(siterator, reader) );
+  seq_len = 1000;
+  seq = tark_iterator_fetch_seq(siterator, &seq_len, NULL);
+  ASSERT_INT_EQUAL(252, seq_len);
+
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "A1", 50, 200, &seq_len);
+  ASSERT_STR_NEQUAL(faidx_seq, seq, 151);
+  free(faidx_seq);
+  faidx_seq = faidx_fetch_seq((faidx_t*)seqfile->file_ptr, "A1", 1000, 1100, &seq_len);
+  ASSERT_STR_EQUAL(faidx_seq, seq + 151);
+  free(faidx_seq);
+  free(seq);
+  tark_free_iterator(siterator);
+
+  /* Iterators made from a sequence id carry everything they need,
+     the id is the position in the .fai */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "3770-3779:1", 0);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_STR_EQUAL("A2", siterator->seq_name);
+  ASSERT_INT_EQUAL(3780, siterator->ref_length);
+  seq_len = 100;
+  seq = tark_iterator_fetch_seq(siterator, &seq_len, NULL);
+  ASSERT_STR_EQUAL("AATACGTACA", seq);
+  free(seq);
+  tark_free_iterator(siterator);
+
+  /* Locations must be within the sequence */
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "3770-3780:1", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 2, NULL, 0));
+
+  /* Spaces are allowed around the numbers, not in them, anything
+     malformed or too big for a coordinate is rejected */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, " 0 - 9 , 20-29 : -1 ", 0);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_INT_EQUAL(2, tark_iterator_locations_count(siterator));
+  ASSERT_INT_EQUAL(20, siterator->seq_length);
+  ASSERT_INT_EQUAL(-1, siterator->strand);
+  tark_free_iterator(siterator);
+
+  /* Ensembl coordinates are one based inclusive, the end moves */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-3780", 1);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_INT_EQUAL(3779, siterator->locations[0].end);
+  tark_free_iterator(siterator);
+
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "10", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "1 0-20", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "10-20,", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "10-20,,30-40", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "-10-20", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "20-10", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "10-20x", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "10-20:2", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "10-20:-1x", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-4294967296", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-99999999999999999999", 0));
+
+  /* Thousands of segments are fine, up to TARK_MAX_LOCATIONS */
+  faidx_seq = malloc((TARK_MAX_LOCATIONS + 1) * 4 + 1);
+  for(i = 0; i < TARK_MAX_LOCATIONS; i++) {
+    strcpy(faidx_seq + i * 4, "1-2,");
+  }
+  faidx_seq[TARK_MAX_LOCATIONS * 4 - 1] = '\0';
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, faidx_seq, 0);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_INT_EQUAL(TARK_MAX_LOCATIONS, tark_iterator_locations_count(siterator));
+  ASSERT_INT_EQUAL(TARK_MAX_LOCATIONS * 2, siterator->seq_length);
+  ASSERT_INT_EQUAL((TARK_MAX_LOCATIONS - 1) * 2, siterator->locations[TARK_MAX_LOCATIONS - 1].offset);
+  tark_free_iterator(siterator);
+  strcpy(faidx_seq + TARK_MAX_LOCATIONS * 4 - 1, ",1-2");
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, faidx_seq, 0));
+  free(faidx_seq);
+
+  /* Seeking, segments are 10, 5 and 20 bp long */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 0, "0-9,100-104,200-219:1", 0);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_INT_EQUAL(3, tark_iterator_locations_count(siterator));
+  ASSERT_INT_EQUAL(15, siterator->locations[2].offset);
+  ASSERT_TRUE( tark_iterator_seek(siterator, 12) );
+  ASSERT_INT_EQUAL(1, siterator->segment_ptr);
+  ASSERT_INT_EQUAL(2, siterator->segment_bp_ptr);
+  /* A boundary is the start of the next segment */
+  ASSERT_TRUE( tark_iterator_seek(siterator, 15) );
+  ASSERT_INT_EQUAL(2, siterator->segment_ptr);
+  ASSERT_INT_EQUAL(0, siterator->segment_bp_ptr);
+  ASSERT_TRUE( tark_iterator_seek(siterator, 0) );
+  ASSERT_INT_EQUAL(0, siterator->segment_ptr);
+  ASSERT_TRUE( tark_iterator_seek(siterator, 35) );
+  ASSERT_FALSE( tark_iterator_seek(siterator, 36) );
+  tark_free_iterator(siterator);
+
+  /* The reverse strand walks the segments backwards, in small windows
+     across segments and lines in the file */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "3770-3779,0-10:-1", 0);
+  ASSERT_PTR_NOTNULL(siterator);
+  faidx_seq = malloc(100);
+  faidx_seq[0] = '\0';
+  seq = malloc(100);
+  while(tark_iterator_remaining(siterator, 0) > 0) {
+    seq_len = 4;
+    tark_iterator_fetch_seq(siterator, &seq_len, seq);
+    strcat(faidx_seq, seq);
+  }
+  ASSERT_STR_EQUAL("TGCTGGTACGGTGTACGTATT", faidx_seq);
+  tark_free_iterator(siterator);
+
+  /* and puts the line breaks in the right places */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "3770-3779,0-10:-1", 0);
+  tark_iterator_set_line_length(siterator, 8);
+  seq_len = 100;
+  tark_iterator_fetch_seq(siterator, &seq_len, seq);
+  ASSERT_STR_EQUAL("TGCTGGTA\nCGGTGTAC\nGTATT", seq);
+  tark_free_iterator(siterator);
+
+  /* Windows that end on, or one byte after, the end of a line, the
+     output is the same whatever the window size */
+  for(i = 1; i < 12; i++) {
+    siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "3770-3779,0-10:-1", 0);
+    tark_iterator_set_line_length(siterator, 8);
+    tark_iterator_set_transform(siterator, SEQ_XFORM_LOWER);
+    faidx_seq[0] = '\0';
+    while(tark_iterator_remaining(siterator, 0) > 0) {
+      seq_len = i;
+      tark_iterator_fetch_seq(siterator, &seq_len, seq);
+      ASSERT_TRUE(seq_len > 0);
+      strcat(faidx_seq, seq);
+    }
+    ASSERT_STR_EQUAL("tgctggta\ncggtgtac\ngtatt", faidx_seq);
+    tark_free_iterator(siterator);
+  }
+
+  /* The fetch function is picked for the strand and line length,
+     and picked again when the line length changes */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "3770-3779,0-10:-1", 0);
+  tark_iterator_specialize(siterator);
+  ASSERT_PTR_NOTNULL(siterator->fetcher);
+  tark_iterator_set_line_length(siterator, 8);
+  ASSERT_PTR_EQUAL(NULL, siterator->fetcher);
+  seq_len = 100;
+  tark_iterator_fetch(siterator, &seq_len, seq);
+  ASSERT_STR_EQUAL("TGCTGGTA\nCGGTGTAC\nGTATT", seq);
+  ASSERT_PTR_NOTNULL(siterator->fetcher);
+  tark_free_iterator(siterator);
+
+  /* Translated, the codons carry on across segments and windows,
+     whatever the window size, and a window with only room for the
+     CR at the end of a line still moves us along */
+  for(i = 1; i < 12; i++) {
+    siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "3770-3779,0-10:-1", 0);
+    tark_iterator_set_line_length(siterator, 3);
+    faidx_seq[0] = '\0';
+    while(tark_iterator_remaining(siterator, 1) > 0) {
+      seq_len = i;
+      tark_iterator_fetch_translated_seq(siterator, &seq_len, seq);
+      ASSERT_TRUE(seq_len > 0);
+      strcat(faidx_seq, seq);
+    }
+    ASSERT_STR_EQUAL("CWY\nGVR\nI", faidx_seq);
+    tark_free_iterator(siterator);
+  }
+
+  /* A codon split between segments on the forward strand, the
+     same as translating the bases */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-10,3770-3779:1", 0);
+  seq_len = 100;
+  tark_iterator_fetch_seq(siterator, &seq_len, faidx_seq);
+  ASSERT_INT_EQUAL(7, seq_translate(faidx_seq + 50, faidx_seq, seq_len));
+  faidx_seq[57] = '\0';
+  tark_free_iterator(siterator);
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-10,3770-3779:1", 0);
+  seq_len = 100;
+  tark_iterator_fetch_translated_seq(siterator, &seq_len, seq);
+  ASSERT_STR_EQUAL(faidx_seq + 50, seq);
+  ASSERT_PTR_NOTNULL(siterator->scratch);
+  tark_free_iterator(siterator);
+
+  /* In another genetic code, an unknown one leaves the code alone */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-10,3770-3779:1", 0);
+  ASSERT_FALSE( tark_iterator_set_genetic_code(siterator, 7) );
+  ASSERT_PTR_EQUAL(NULL, siterator->code);
+  ASSERT_TRUE( tark_iterator_set_genetic_code(siterator, 2) );
+  seq_len = 100;
+  tark_iterator_fetch_seq(siterator, &seq_len, faidx_seq);
+  ASSERT_INT_EQUAL(7, seq_translate_code(faidx_seq + 50, faidx_seq, seq_len, seq_genetic_code(2)));
+  faidx_seq[57] = '\0';
+  tark_free_iterator(siterator);
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-10,3770-3779:1", 0);
+  ASSERT_TRUE( tark_iterator_set_genetic_code(siterator, 2) );
+  seq_len = 100;
+  tark_iterator_fetch_translated_seq(siterator, &seq_len, seq);
+  ASSERT_STR_EQUAL(faidx_seq + 50, seq);
+  tark_free_iterator(siterator);
+
+  /* A partial codon at the end is an X */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-7:1", 0);
+  seq_len = 100;
+  tark_iterator_fetch_translated_seq(siterator, &seq_len, seq);
+  ASSERT_INT_EQUAL(3, seq_len);
+  ASSERT_INT_EQUAL('X', seq[2]);
+  ASSERT_INT_EQUAL(0, tark_iterator_remaining(siterator, 1));
+  tark_free_iterator(siterator);
+
+  /* Everything an iterator allocates goes through its allocator,
+     the locations as they grow, the extents and the scratch buffer,
+     and is given back by tark_free_iterator */
+  i = 0;
+  counting.alloc = counting_alloc;
+  counting.free = counting_free;
+  counting.ctx = &i;
+  siterator = tark_fetch_iterator_handle_alloc((faidx_t*)seqfile->file_ptr, reader, 1, "100-109,120-129,140-149,160-169,180-189:1", 0, &counting);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_INT_EQUAL(1, siterator->nextents);
+  seq_len = 100;
+  tark_iterator_fetch_translated_seq(siterator, &seq_len, seq);
+  ASSERT_PTR_NOTNULL(siterator->scratch);
+  ASSERT_INT_EQUAL(5, i);
+  tark_free_iterator(siterator);
+  ASSERT_INT_EQUAL(0, i);
+
+  /* From an arena, nothing is freed until it's reset */
+  arena = tark_arena_create(1024);
+  arena_alloc = tark_arena_allocator(arena);
+  siterator = tark_fetch_iterator_handle_alloc((faidx_t*)seqfile->file_ptr, reader, 1, "3770-3779,0-10:-1", 0, &arena_alloc);
+  tark_iterator_specialize(siterator);
+  seq_len = 100;
+  tark_iterator_fetch(siterator, &seq_len, seq);
+  ASSERT_STR_EQUAL("TGCTGGTACGGTGTACGTATT", seq);
+  siterator->translate = 1;
+  tark_iterator_seek(siterator, 0);
+  siterator->seq_iterated = 0;
+  seq_len = 100;
+  tark_iterator_fetch_translated_seq(siterator, &seq_len, seq);
+  ASSERT_STR_EQUAL("CWYGVRI", seq);
+  tark_free_iterator(siterator);
+
+  /* The scratch buffer is bigger than a block so has its own,
+     resetting keeps one ordinary block for next time */
+  ASSERT_PTR_NOTNULL(arena->blocks->next);
+  ASSERT_TRUE(arena->blocks->next->size >= TARK_TRANSLATE_SCRATCH);
+  tark_arena_reset(arena);
+  ASSERT_PTR_NOTNULL(arena->blocks);
+  ASSERT_PTR_EQUAL(NULL, arena->blocks->next);
+  ASSERT_INT_EQUAL(0, arena->blocks->used);
+  ASSERT_INT_EQUAL(0, ((size_t)tark_arena_alloc(arena, 3)) % TARK_ARENA_ALIGN);
+  ASSERT_INT_EQUAL(TARK_ARENA_ALIGN, arena->blocks->used);
+  tark_arena_destroy(arena);
+
+  /* Bases straight out of the mapped file, no copying. Segments that
+     abut are one span, a span stops at the end of a line in the file */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "100-109,110-119,3770-3779:1", 0);
+  ASSERT_TRUE( tark_iterator_spannable(siterator, 60) );
+  ASSERT_FALSE( tark_iterator_spannable(siterator, 61) );
+  ASSERT_INT_EQUAL(2, tark_iterator_fetch_spans(siterator, spans, 4, 100));
+  ASSERT_INT_EQUAL(20, spans[0].len);
+  ASSERT_INT_EQUAL(10, spans[1].len);
+  ASSERT_INT_EQUAL(0, memcmp("AATACGTACA", spans[1].base, 10));
+  ASSERT_INT_EQUAL(0, tark_iterator_remaining(siterator, 0));
+  ASSERT_INT_EQUAL(0, tark_iterator_fetch_spans(siterator, spans, 4, 100));
+  tark_free_iterator(siterator);
+
+  /* Held to max_bp and max_spans, and carrying on from there */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "50-69:1", 0);
+  ASSERT_INT_EQUAL(1, tark_iterator_fetch_spans(siterator, spans, 4, 5));
+  ASSERT_INT_EQUAL(5, spans[0].len);
+  ASSERT_INT_EQUAL(1, tark_iterator_fetch_spans(siterator, spans, 1, 100));
+  ASSERT_INT_EQUAL(5, spans[0].len);
+  ASSERT_INT_EQUAL(10, tark_iterator_remaining(siterator, 0));
+  ASSERT_INT_EQUAL(1, tark_iterator_fetch_spans(siterator, spans, 4, 100));
+  ASSERT_INT_EQUAL(10, spans[0].len);
+  tark_free_iterator(siterator);
+
+  /* The whole sequence as spans is what a fetch copies */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, NULL, 0);
+  seq_len = 0;
+  while((i = tark_iterator_fetch_spans(siterator, spans, 4, 1000)) > 0) {
+    for(i--; i >= 0; i--) {
+      seq_len += spans[i].len;
+    }
+  }
+  ASSERT_INT_EQUAL(3780, seq_len);
+  ASSERT_INT_EQUAL(0, tark_iterator_remaining(siterator, 0));
+  tark_free_iterator(siterator);
+
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-10,3770-3779:1", 0);
+  ASSERT_INT_EQUAL(2, tark_iterator_fetch_spans(siterator, spans, 4, 100));
+  memcpy(seq, spans[0].base, spans[0].len);
+  memcpy(seq + spans[0].len, spans[1].base, spans[1].len);
+  seq[21] = '\0';
+  ASSERT_STR_EQUAL("CCGTACCAGCAAATACGTACA", seq);
+  tark_free_iterator(siterator);
+
+  /* Anything that changes the bases on the way can't be spanned */
+  siterator = tark_fetch_iterator_handle((faidx_t*)seqfile->file_ptr, reader, 1, "0-10:-1", 0);
+  ASSERT_FALSE( tark_iterator_spannable(siterator, 0) );
+  ASSERT_INT_EQUAL(-1, tark_iterator_fetch_spans(siterator, spans, 4, 100));
+  siterator->strand = 1;
+  tark_iterator_set_line_length(siterator, 60);
+  ASSERT_FALSE( tark_iterator_spannable(siterator, 0) );
+  tark_iterator_set_line_length(siterator, 0);
+  tark_iterator_set_transform(siterator, SEQ_XFORM_UPPER);
+  ASSERT_FALSE( tark_iterator_spannable(siterator, 0) );
+  tark_free_iterator(siterator);
+
+  /* All six frames from one set of bases, only whole codons */
+  for(i = 0; i < 6; i++) {
+    frames[i] = seq + i * 8;
+  }
+  tark_translate_frames("ATGGCCTAAGG", 11, NULL, faidx_seq, frames, frame_lens);
+  ASSERT_INT_EQUAL(0, memcmp("CCTTAGGCCAT", faidx_seq, 11));
+  ASSERT_INT_EQUAL(3, frame_lens[0]);
+  ASSERT_INT_EQUAL(3, frame_lens[2]);
+  ASSERT_INT_EQUAL(3, frame_lens[5]);
+  ASSERT_INT_EQUAL(0, memcmp("MA*", frames[0], 3));
+  ASSERT_INT_EQUAL(0, memcmp("WPK", frames[1], 3));
+  ASSERT_INT_EQUAL(0, memcmp("GLR", frames[2], 3));
+  ASSERT_INT_EQUAL(0, memcmp("P*A", frames[3], 3));
+  ASSERT_INT_EQUAL(0, memcmp("LRP", frames[4], 3));
+  ASSERT_INT_EQUAL(0, memcmp("LGH", frames[5], 3));
+
+  /* In the mitochondrial code AGG is a stop */
+  tark_translate_frames("ATGGCCTAAGG", 11, seq_genetic_code(2), faidx_seq, frames, frame_lens);
+  ASSERT_INT_EQUAL(0, memcmp("GL*", frames[2], 3));
+
+  tark_translate_frames("AT", 2, NULL, faidx_seq, frames, frame_lens);
+  ASSERT_INT_EQUAL(0, frame_lens[0]);
+  ASSERT_INT_EQUAL(0, frame_lens[5]);
+
+  /* ORFs on both strands, M to stop, sorted by start and counted
+     on the forward strand */
+  ASSERT_INT_EQUAL(2, tark_find_orfs("ATGAAACCCTAAGGTCACCCCAT", 23, NULL, 2, faidx_seq, frames, &orfs, NULL));
+  ASSERT_INT_EQUAL(0, orfs[0].start);
+  ASSERT_INT_EQUAL(12, orfs[0].end);
+  ASSERT_INT_EQUAL(1, orfs[0].frame);
+  ASSERT_INT_EQUAL(3, orfs[0].length);
+  ASSERT_INT_EQUAL(0, memcmp("MKP", orfs[0].protein, 3));
+  ASSERT_INT_EQUAL(14, orfs[1].start);
+  ASSERT_INT_EQUAL(23, orfs[1].end);
+  ASSERT_INT_EQUAL(-1, orfs[1].frame);
+  ASSERT_INT_EQUAL(2, orfs[1].length);
+  ASSERT_INT_EQUAL(0, memcmp("MG", orfs[1].protein, 2));
+  free(orfs);
+
+  /* Too short, or no stop before the end */
+  ASSERT_INT_EQUAL(1, tark_find_orfs("ATGAAACCCTAAGGTCACCCCAT", 23, NULL, 3, faidx_seq, frames, &orfs, NULL));
+  free(orfs);
+  ASSERT_INT_EQUAL(0, tark_find_orfs("ATGAAACCCTAAGGTCACCCCAT", 23, NULL, 4, faidx_seq, frames, &orfs, NULL));
+  ASSERT_INT_EQUAL(0, tark_find_orfs("ATGAAACCC", 9, NULL, 1, faidx_seq, frames, &orfs, NULL));
+
+  free(seq);
+  free(faidx_seq);
+
+  /* bgzip files are read a block at a time, lines and bases
+     straddling the blocks */
+  ASSERT_TRUE( make_bgzf_fasta(small, &nblocks) );
+  reader = seq_reader_open(small);
+  ASSERT_PTR_NOTNULL(reader);
+  ASSERT_INT_EQUAL(SEQ_READER_BGZF, reader->type);
+  ASSERT_INT64_EQUAL(nblocks, reader->ngzi);
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_B, seq_reader_seq_len(reader, 1));
+
+  seq = malloc(SMALL_LENGTH_A);
+  faidx_seq = malloc(SMALL_LENGTH_A);
+  for(i = 0; i < SMALL_LENGTH_A; i++) {
+    faidx_seq[i] = small_base(0, i);
+  }
+
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_A, seq_reader_fetch(reader, 0, 0, SMALL_LENGTH_A, seq));
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, SMALL_LENGTH_A));
+  ASSERT_INT64_EQUAL((SMALL_LENGTH_A + SMALL_LENGTH_A / 70 + 3) / SMALL_BLOCK + 1, reader->inflates);
+
+  /* Anywhere, in any order */
+  srand(23);
+  for(i = 0; i < 500; i++) {
+    beg = rand() % SMALL_LENGTH_A;
+    len = rand() % 10000;
+    if(beg + len > SMALL_LENGTH_A) len = SMALL_LENGTH_A - beg;
+    ASSERT_INT64_EQUAL(len, seq_reader_fetch(reader, 0, beg, len, seq));
+    ASSERT_INT_EQUAL(0, memcmp(faidx_seq + beg, seq, len));
+  }
+
+  for(i = 0; i < SMALL_LENGTH_B; i++) {
+    faidx_seq[i] = small_base(1, i);
+  }
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_B, seq_reader_fetch(reader, 1, 0, SMALL_LENGTH_B, seq));
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, SMALL_LENGTH_B));
+  ASSERT_INT64_EQUAL(-1, seq_reader_fetch(reader, 1, 1, SMALL_LENGTH_B, seq));
+
+  /* Through a block cache nothing is inflated twice */
+  blocks = seq_block_cache_create(1048576);
+  ASSERT_TRUE( seq_reader_set_block_cache(reader, blocks) );
+  for(i = 0; i < SMALL_LENGTH_A; i++) {
+    faidx_seq[i] = small_base(0, i);
+  }
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_A, seq_reader_fetch(reader, 0, 0, SMALL_LENGTH_A, seq));
+  inflates = reader->inflates;
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_A, seq_reader_fetch(reader, 0, 0, SMALL_LENGTH_A, seq));
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, SMALL_LENGTH_A));
+  ASSERT_INT64_EQUAL(inflates, reader->inflates);
+  seq_reader_close(reader);
+  ASSERT_INT_EQUAL(0, blocks->used);
+  seq_block_cache_destroy(blocks);
+
+  /* A damaged block fails its CRC, the others still read */
+  f = fopen(small, "r+b");
+  ASSERT_PTR_NOTNULL(f);
+  fseek(f, 3 * SMALL_BLOCK / 2, SEEK_SET);
+  fputc('X', f);
+  fclose(f);
+  reader = seq_reader_open(small);
+  ASSERT_PTR_NOTNULL(reader);
+  ASSERT_INT64_EQUAL(100, seq_reader_fetch(reader, 0, 0, 100, seq));
+  ASSERT_INT64_EQUAL(-1, seq_reader_fetch(reader, 0, 0, SMALL_LENGTH_A, seq));
+  seq_reader_close(reader);
+
+  /* A plain gzip file isn't a bgzip file */
+  f = fopen(small, "r+b");
+  fseek(f, 12, SEEK_SET);
+  fputc('X', f);
+  fclose(f);
+  ASSERT_PTR_EQUAL(NULL, seq_reader_open(small));
+
+  unlink(small);
+  unlink("small_t.fa.gz.fai");
+  unlink("small_t.fa.gz.gzi");
+
+#ifdef HAVE_ZSTD
+  /* Seekable zstd files are read the same way, a frame at a time */
+  ASSERT_TRUE( make_zstd_fasta(small_zst, &nblocks) );
+  ASSERT_INT_EQUAL(FM_ZSTD, files_mgr_file_type(small_zst));
+  reader = seq_reader_open(small_zst);
+  ASSERT_PTR_NOTNULL(reader);
+  ASSERT_INT_EQUAL(SEQ_READER_ZSTD, reader->type);
+  ASSERT_INT64_EQUAL(nblocks, reader->ngzi);
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_B, seq_reader_seq_len(reader, 1));
+
+  for(i = 0; i < SMALL_LENGTH_A; i++) {
+    faidx_seq[i] = small_base(0, i);
+  }
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_A, seq_reader_fetch(reader, 0, 0, SMALL_LENGTH_A, seq));
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, SMALL_LENGTH_A));
+  ASSERT_INT64_EQUAL((SMALL_LENGTH_A + SMALL_LENGTH_A / 70 + 3) / SMALL_FRAME + 1, reader->inflates);
+
+  srand(29);
+  for(i = 0; i < 500; i++) {
+    beg = rand() % SMALL_LENGTH_A;
+    len = rand() % 10000;
+    if(beg + len > SMALL_LENGTH_A) len = SMALL_LENGTH_A - beg;
+    ASSERT_INT64_EQUAL(len, seq_reader_fetch(reader, 0, beg, len, seq));
+    ASSERT_INT_EQUAL(0, memcmp(faidx_seq + beg, seq, len));
+  }
+
+  /* Backwards through scratch too */
+  run = seq_reader_run_back(reader, 0, SMALL_LENGTH_A - 1, 100, &len);
+  ASSERT_PTR_NOTNULL(run);
+  ASSERT_INT64_EQUAL(100, len);
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq + SMALL_LENGTH_A - 100, run, 100));
+
+  for(i = 0; i < SMALL_LENGTH_B; i++) {
+    faidx_seq[i] = small_base(1, i);
+  }
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_B, seq_reader_fetch(reader, 1, 0, SMALL_LENGTH_B, seq));
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, SMALL_LENGTH_B));
+
+  /* Frames go through the block cache like bgzip blocks */
+  blocks = seq_block_cache_create(1048576);
+  ASSERT_TRUE( seq_reader_set_block_cache(reader, blocks) );
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_A, seq_reader_fetch(reader, 0, 0, SMALL_LENGTH_A, seq));
+  inflates = reader->inflates;
+  ASSERT_INT64_EQUAL(SMALL_LENGTH_A, seq_reader_fetch(reader, 0, 0, SMALL_LENGTH_A, seq));
+  ASSERT_INT64_EQUAL(inflates, reader->inflates);
+  seq_reader_close(reader);
+  seq_block_cache_destroy(blocks);
+
+  /* Through the files manager as its own type */
+  checksums[0] = files_mgr_add_seqfile(fm, small_zst, FM_ZSTD);
+  ASSERT_PTR_NOTNULL(checksums[0]);
+  seqfile = files_mgr_get_seqfile(fm, checksums[0]);
+  ASSERT_PTR_NOTNULL(seqfile->reader);
+  ASSERT_PTR_EQUAL(seqfile->reader, seqfile->file_ptr);
+  ASSERT_PTR_EQUAL(NULL, files_mgr_faidx(seqfile));
+  files_mgr_close_file(fm, seqfile);
+
+  /* Without its seek table it can't be seeked in */
+  f = fopen(small_zst, "r+b");
+  ASSERT_PTR_NOTNULL(f);
+  fseek(f, -4, SEEK_END);
+  fputc('X', f);
+  fclose(f);
+  ASSERT_PTR_EQUAL(NULL, seq_reader_open(small_zst));
+
+  unlink(small_zst);
+  unlink("small_t.fa.zst.fai");
+#endif
+
+  free(seq);
+  free(faidx_seq);
+
+  /* .2bit files carry their own index and are unpacked with the
+     N and lower case blocks laid over the bases */
+  twobit_texts[0] = malloc(TWOBIT_LENGTH_A + 1);
+  for(i = 0; i < TWOBIT_LENGTH_A; i++) {
+    twobit_texts[0][i] = "TCAG"[small_base(0, i) & 3];
+    if(i < 1000 || (i >= 5003 && i < 5017) || i >= TWOBIT_LENGTH_A - 7) {
+      twobit_texts[0][i] = 'N';
+    }
+    if((i >= 990 && i < 1500) || (i / 997) % 3 == 1) {
+      twobit_texts[0][i] |= 0x20;
+    }
+  }
+  twobit_texts[0][TWOBIT_LENGTH_A] = '\0';
+  twobit_texts[1] = "ACGTNacgtnA";
+
+  for(j = 0; j < 2; j++) {
+    /* Native then the other endianness with 64 bit offsets */
+    ASSERT_TRUE( make_2bit(twobit, twobit_names, (const char**)twobit_texts, 2, j, j) );
+    reader = seq_reader_open(twobit);
+    ASSERT_PTR_NOTNULL(reader);
+    ASSERT_INT_EQUAL(SEQ_READER_2BIT, reader->type);
+    ASSERT_INT_EQUAL(2, seq_reader_nseq(reader));
+    ASSERT_INT_EQUAL(1, seq_reader_seq_id(reader, "chrUn"));
+    ASSERT_INT64_EQUAL(TWOBIT_LENGTH_A, seq_reader_seq_len(reader, 0));
+    ASSERT_INT64_EQUAL(11, seq_reader_seq_len(reader, 1));
+    ASSERT_FALSE( seq_reader_set_block_cache(reader, (seq_block_cache_t*)reader) );
+
+    seq = malloc(TWOBIT_LENGTH_A);
+    ASSERT_INT64_EQUAL(TWOBIT_LENGTH_A, seq_reader_fetch(reader, 0, 0, TWOBIT_LENGTH_A, seq));
+    ASSERT_INT_EQUAL(0, memcmp(twobit_texts[0], seq, TWOBIT_LENGTH_A));
+    ASSERT_INT64_EQUAL(11, seq_reader_fetch(reader, 1, 0, 11, seq));
+    ASSERT_INT_EQUAL(0, memcmp("ACGTNacgtnA", seq, 11));
+
+    srand(31);
+    for(i = 0; i < 500; i++) {
+      beg = rand() % TWOBIT_LENGTH_A;
+      len = rand() % 3000;
+      if(beg + len > TWOBIT_LENGTH_A) len = TWOBIT_LENGTH_A - beg;
+      ASSERT_INT64_EQUAL(len, seq_reader_fetch(reader, 0, beg, len, seq));
+      ASSERT_INT_EQUAL(0, memcmp(twobit_texts[0] + beg, seq, len));
+    }
+
+    /* and through the iterator, reverse complemented */
+    siterator = tark_fetch_iterator_handle(NULL, reader, 0, "990-1009:-1", 0);
+    ASSERT_PTR_NOTNULL(siterator);
+    faidx_seq = malloc(20);
+    memcpy(faidx_seq, twobit_texts[0] + 990, 20);
+    tark_revcomp_seq_len(faidx_seq, 20);
+    seq_len = 20;
+    tark_iterator_fetch(siterator, &seq_len, seq);
+    ASSERT_INT_EQUAL(20, seq_len);
+    ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, 20));
+    tark_free_iterator(siterator);
+    free(faidx_seq);
+
+    seq_reader_close(reader);
+    free(seq);
+  }
+
+  /* As a seqfile type of its own, needing no .fai */
+  ASSERT_INT_EQUAL(FM_2BIT, files_mgr_file_type(twobit));
+  checksums[0] = files_mgr_add_seqfile(fm, twobit, FM_2BIT);
+  ASSERT_PTR_NOTNULL(checksums[0]);
+  seqfile = files_mgr_get_seqfile(fm, checksums[0]);
+  ASSERT_PTR_EQUAL(seqfile->reader, seqfile->file_ptr);
+  ASSERT_INT_EQUAL(SEQ_READER_2BIT, seqfile->reader->type);
+  files_mgr_close_file(fm, seqfile);
+
+  /* Cut short its records are past the end */
+  ASSERT_INT_EQUAL(0, truncate(twobit, 200));
+  ASSERT_PTR_EQUAL(NULL, seq_reader_open(twobit));
+  unlink(twobit);
+  free(twobit_texts[0]);
+
+  /* Positions past 4Gbp, streamed through the iterator */
+  ASSERT_TRUE( make_big_fasta(big) );
+  reader = seq_reader_open(big);
+  ASSERT_PTR_NOTNULL(reader);
+  ASSERT_INT64_EQUAL(BIG_LENGTH, seq_reader_seq_len(reader, 0));
+
+  siterator = tark_fetch_iterator_handle(NULL, reader, 0, NULL, 0);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_INT64_EQUAL(BIG_LENGTH - 1, siterator->locations[0].end);
+  ASSERT_INT64_EQUAL(BIG_LENGTH, tark_iterator_remaining(siterator, 0));
+  ASSERT_INT64_EQUAL(BIG_LENGTH / 3, tark_iterator_remaining(siterator, 1));
+  ASSERT_TRUE( tark_iterator_seek(siterator, BIG_LENGTH) );
+  ASSERT_FALSE( tark_iterator_seek(siterator, BIG_LENGTH + 1) );
+  tark_free_iterator(siterator);
+
+  /* Coordinates that don't fit in 64 bits, or are past the end */
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle(NULL, reader, 0, "4499999990-4500000000", 0));
+  ASSERT_PTR_EQUAL(NULL, tark_fetch_iterator_handle(NULL, reader, 0, "0-18446744073709551616", 0));
+
+  /* 500kbp either side of the 4Gbp mark, in odd sized windows on
+     both strands, the same as the bases we wrote */
+  seq = malloc(BIG_REGION_END - BIG_REGION_START + 1);
+  faidx_seq = malloc(BIG_REGION_END - BIG_REGION_START + 1);
+  siterator = tark_fetch_iterator_handle(NULL, reader, 0, "4294867296-4295367295:1", 0);
+  ASSERT_PTR_NOTNULL(siterator);
+  ASSERT_INT64_EQUAL(500000, tark_iterator_remaining(siterator, 0));
+  seq_len = 0;
+  while(tark_iterator_remaining(siterator, 0) > 0) {
+    i = 4099;
+    tark_iterator_fetch(siterator, &i, seq + seq_len);
+    seq_len += i;
+  }
+  ASSERT_INT_EQUAL(500000, seq_len);
+  for(i = 0; i < seq_len; i++) {
+    faidx_seq[i] = big_base(4294867296ULL + i);
+  }
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, seq_len));
+  tark_free_iterator(siterator);
+
+  siterator = tark_fetch_iterator_handle(NULL, reader, 0, "4294867296-4295367295:-1", 0);
+  seq_len = 0;
+  while(tark_iterator_remaining(siterator, 0) > 0) {
+    i = 997;
+    tark_iterator_fetch(siterator, &i, seq + seq_len);
+    seq_len += i;
+  }
+  tark_revcomp_seq_len(faidx_seq, 500000);
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, 500000));
+  tark_free_iterator(siterator);
+
+  /* Segments either side of the mark, seeking in to the second */
+  siterator = tark_fetch_iterator_handle(NULL, reader, 0, "4294967000-4294967099,4294967290-4294967309", 0);
+  ASSERT_INT64_EQUAL(4294967290ULL, siterator->locations[1].start);
+  ASSERT_INT64_EQUAL(100, siterator->locations[1].offset);
+  ASSERT_TRUE( tark_iterator_seek(siterator, 110) );
+  ASSERT_INT_EQUAL(1, siterator->segment_ptr);
+  ASSERT_INT64_EQUAL(10, siterator->segment_bp_ptr);
+  tark_free_iterator(siterator);
+
+  /* A codon that straddles the mark, translated */
+  siterator = tark_fetch_iterator_handle(NULL, reader, 0, "4294967293-4294967298:1", 0);
+  tark_iterator_set_line_length(siterator, 60);
+  seq_len = 100;
+  tark_iterator_fetch_translated_seq(siterator, &seq_len, seq);
+  ASSERT_INT_EQUAL(2, seq_len);
+  for(i = 0; i < 6; i++) {
+    faidx_seq[i] = big_base(4294967293ULL + i);
+  }
+  ASSERT_INT_EQUAL(2, seq_translate(faidx_seq + 6, faidx_seq, 6));
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq + 6, seq, 2));
+  tark_free_iterator(siterator);
+
+  ASSERT_INT64_EQUAL(6, tark_fetch_seq_into(reader, 0, 4294967293ULL, 4294967298ULL, seq));
+  ASSERT_INT_EQUAL(0, memcmp(faidx_seq, seq, 6));
+
+  /* ORFs either side of the mark, at their 64 bit positions a
+     start codon on the forward strand, or its reverse complement */
+  siterator = tark_fetch_iterator_handle(NULL, reader, 0, "4294966296-4294968295:1", 0);
+  tark_iterator_set_line_length(siterator, 0);
+  seq_len = 2000;
+  tark_iterator_fetch_seq(siterator, &seq_len, seq);
+  ASSERT_INT_EQUAL(2000, seq_len);
+  for(i = 0; i < 6; i++) {
+    frames[i] = faidx_seq + seq_len + i * 700;
+  }
+  /* Enough of them to grow the array through the allocator */
+  j = 0;
+  counting.ctx = &j;
+  norfs = tark_find_orfs(seq, seq_len, NULL, 10, faidx_seq, frames, &orfs, &counting);
+  ASSERT_TRUE(norfs > 16);
+  ASSERT_INT_EQUAL(1, j);
+  beg = siterator->locations[0].start;
+  len = 0;
+  for(i = 0; i < norfs; i++) {
+    if(beg + orfs[i].start > 4294967296ULL) len++;
+    if(orfs[i].frame > 0) {
+      ASSERT_INT_EQUAL('A', big_base(beg + orfs[i].start));
+      ASSERT_INT_EQUAL('T', big_base(beg + orfs[i].start + 1));
+      ASSERT_INT_EQUAL('G', big_base(beg + orfs[i].start + 2));
+    } else {
+      ASSERT_INT_EQUAL('C', big_base(beg + orfs[i].end - 3));
+      ASSERT_INT_EQUAL('A', big_base(beg + orfs[i].end - 2));
+      ASSERT_INT_EQUAL('T', big_base(beg + orfs[i].end - 1));
+    }
+  }
+  ASSERT_TRUE(len > 0);
+  tark_free(&counting, orfs);
+  ASSERT_INT_EQUAL(0, j);
+  tark_free_iterator(siterator);
+
+  seq_reader_close(reader);
+  unlink(big);
+  unlink("big_t.fa.fai");
+  free(seq);
+  free(faidx_seq);
+
   return 0;
 }
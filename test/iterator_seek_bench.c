@@ -0,0 +1,141 @@
+/*
+
+ Benchmark seeking an iterator over a long list of segments, the
+ pattern the reverse strand fetch uses where every output window
+ seeks back from the end of the iterator.
+
+ Compares tark_iterator_seek against the linear scan of the
+ segments it replaced.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "htslib_fetcher.h"
+
+#define WINDOW 61
+#define ROUNDS 5
+
+/* The original seek, walking the segments from the start */
+
+int linear_seek(seq_iterator_t* siterator, uint64_t bp) {
+  uint64_t bp_count = 0;
+  unsigned int i;
+
+  if(bp > siterator->seq_length) {
+    return 0;
+  }
+
+  for(i = 0; i < siterator->nlocations; i++) {
+    if((bp_count + siterator->locations[i].length) <= bp) {
+      bp_count += siterator->locations[i].length;
+      continue;
+    }
+    break;
+  }
+
+  if(i == siterator->nlocations) {
+    i--;
+    bp_count -= siterator->locations[i].length;
+  }
+
+  siterator->segment_ptr = i;
+  siterator->segment_bp_ptr = bp - bp_count;
+
+  return 1;
+}
+
+/* Make an iterator with nsegments exons, 150bp each with 1000bp of
+   intron between them. No file is needed, only the locations. */
+
+seq_iterator_t* make_iterator(int nsegments) {
+  seq_iterator_t* siterator;
+  char* locs;
+  char* p;
+  int i;
+
+  locs = malloc(nsegments * 24 + 8);
+  p = locs;
+  for(i = 0; i < nsegments; i++) {
+    p += sprintf(p, "%s%d-%d", i ? "," : "", i * 1150, i * 1150 + 149);
+  }
+  strcpy(p, ":-1");
+
+  siterator = calloc(1, sizeof(seq_iterator_t));
+  siterator->seq_id = -1;
+  siterator->ref_length = nsegments * 1150;
+  if(!_tark_iterator_parse_locations(siterator, locs, 0)) {
+    fprintf(stderr, "Failed to parse %d locations\n", nsegments);
+    exit(1);
+  }
+
+  free(locs);
+  return siterator;
+}
+
+/* Seek to every window of the iterator, from the end back to
+   the start, as a reverse strand fetch does. Returns a checksum
+   of the positions so the two methods can be compared. */
+
+unsigned long run(seq_iterator_t* siterator, int (*seek)(seq_iterator_t*, uint64_t), double* secs) {
+  unsigned long sum = 0;
+  uint64_t bp;
+  clock_t begin;
+  int r;
+
+  begin = clock();
+  for(r = 0; r < ROUNDS; r++) {
+    for(bp = siterator->seq_length; bp >= WINDOW; bp -= WINDOW) {
+      seek(siterator, bp - WINDOW);
+      sum += siterator->segment_ptr * 1000 + siterator->segment_bp_ptr;
+    }
+  }
+  *secs = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+  return sum;
+}
+
+int main(int argc, const char* argv[]) {
+  int sizes[] = { 10, 100, 1000, 5000, 20000 };
+  seq_iterator_t* siterator;
+  unsigned long linear_sum, bsearch_sum;
+  double linear_secs, bsearch_secs;
+  int i;
+
+  printf("%10s %10s %12s %12s %8s\n", "segments", "seeks", "linear(s)", "bsearch(s)", "speedup");
+
+  for(i = 0; i < sizeof(sizes) / sizeof(int); i++) {
+    siterator = make_iterator(sizes[i]);
+
+    linear_sum = run(siterator, linear_seek, &linear_secs);
+    bsearch_sum = run(siterator, tark_iterator_seek, &bsearch_secs);
+
+    if(linear_sum != bsearch_sum) {
+      fprintf(stderr, "Seek results differ for %d segments\n", sizes[i]);
+      return 1;
+    }
+
+    printf("%10d %10u %12.4f %12.4f %7.1fx\n", sizes[i],
+	   ROUNDS * (unsigned int)(siterator->seq_length / WINDOW),
+	   linear_secs, bsearch_secs,
+	   bsearch_secs > 0 ? linear_secs / bsearch_secs : 0.0);
+
+    tark_free_iterator(siterator);
+  }
+
+  return 0;
+}
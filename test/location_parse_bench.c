@@ -0,0 +1,166 @@
+/*
+
+ Benchmark parsing location strings with many segments, as in
+ requests for every exon of a gene or a set of probes.
+
+ Compares _tark_iterator_parse_locations against the parser it
+ replaced, which copied the string, stripped the spaces and then
+ read it backwards with atoi.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "htslib_fetcher.h"
+
+#define PARSE_TIME 0.2 /* Seconds to spend on each size */
+
+/* The original parser */
+
+int legacy_parse_locations(seq_iterator_t* siterator, const char *locs, int ensembl_coords) {
+  int c, i, l, k, location_end, beg, end, nseqs;
+  unsigned int offset;
+  char* s;
+
+  l = strlen(locs);
+  s = (char*)malloc(l+1);
+  location_end = -1;
+  nseqs = 1;
+  for (i = k = 0; i < l; ++i) {
+    if ( isspace(locs[i]) ) { continue; }
+    if (locs[i] == ':') { location_end = i; break; }
+    if (locs[i] == ',') { nseqs++; }
+    s[k++] = locs[i];
+  }
+  s[k] = 0; l = k;
+
+  siterator->locations = malloc( sizeof(seq_location_t) * nseqs );
+
+  if(location_end >= 0) {
+    siterator->strand = atoi(locs + location_end + 1);
+  }
+
+  c = nseqs - 1;
+  for(k--; k>=0; k--) {
+    if(s[k] == '-') {
+      end = atoi(s + k + 1);
+      if (end > 0 && ensembl_coords) --end;
+      s[k] = 0;
+    } else if(s[k] == ',' || k == 0) {
+      if( k == 0 ) k--;
+      beg = atoi(s + k + 1);
+      s[k] = 0;
+
+      if( end < beg ||
+	  siterator->ref_length <= end ) {
+	free(s);
+	return 0;
+      }
+
+      siterator->locations[c].start = beg;
+      siterator->locations[c].end = end;
+      siterator->locations[c].length = end - beg + 1;
+
+      siterator->seq_length += siterator->locations[c].length;
+      c--;
+    }
+  }
+
+  free(s);
+
+  siterator->nlocations = nseqs;
+  for(i = 0, offset = 0; i < nseqs; i++) {
+    siterator->locations[i].offset = offset;
+    offset += siterator->locations[i].length;
+  }
+
+  return 1;
+}
+
+/* nsegments exons, 150bp each with 1000bp of intron between them,
+   in a chromosome sized sequence so the numbers are realistic */
+
+char* make_locations(int nsegments) {
+  char* locs;
+  char* p;
+  int i;
+
+  locs = malloc(nsegments * 24 + 8);
+  p = locs;
+  for(i = 0; i < nsegments; i++) {
+    p += sprintf(p, "%s%d-%d", i ? "," : "", 100000000 + i * 1150, 100000000 + i * 1150 + 149);
+  }
+  strcpy(p, ":-1");
+
+  return locs;
+}
+
+/* Parse locs over and over for PARSE_TIME seconds, returns the
+   microseconds per parse and the total length parsed in to
+   seq_length so the two parsers can be compared */
+
+double run(const char* locs, int (*parse)(seq_iterator_t*, const char*, int), uint64_t* seq_length) {
+  seq_iterator_t siterator;
+  clock_t begin, elapsed;
+  long n = 0;
+
+  begin = clock();
+  do {
+    memset(&siterator, 0, sizeof(seq_iterator_t));
+    siterator.ref_length = 250000000;
+    if(!parse(&siterator, locs, 0)) {
+      fprintf(stderr, "Failed to parse\n");
+      exit(1);
+    }
+    free(siterator.locations);
+    n++;
+    elapsed = clock() - begin;
+  } while(elapsed < PARSE_TIME * CLOCKS_PER_SEC);
+
+  *seq_length = siterator.seq_length;
+  return (double)elapsed / CLOCKS_PER_SEC / n * 1e6;
+}
+
+int main(int argc, const char* argv[]) {
+  int sizes[] = { 1, 10, 100, 1000, 10000, 50000 };
+  uint64_t legacy_length, parse_length;
+  double legacy_us, parse_us;
+  char* locs;
+  int i;
+
+  printf("%10s %12s %12s %12s %8s\n", "segments", "bytes", "legacy(us)", "parse(us)", "speedup");
+
+  for(i = 0; i < sizeof(sizes) / sizeof(int); i++) {
+    locs = make_locations(sizes[i]);
+
+    legacy_us = run(locs, legacy_parse_locations, &legacy_length);
+    parse_us = run(locs, _tark_iterator_parse_locations, &parse_length);
+
+    if(legacy_length != parse_length) {
+      fprintf(stderr, "Parsed lengths differ for %d segments\n", sizes[i]);
+      return 1;
+    }
+
+    printf("%10d %12d %12.2f %12.2f %7.1fx\n", sizes[i], (int)strlen(locs),
+	   legacy_us, parse_us, parse_us > 0 ? legacy_us / parse_us : 0.0);
+
+    free(locs);
+  }
+
+  return 0;
+}
@@ -0,0 +1,193 @@
+/*
+
+ Benchmark reverse complementing 100Mbp, the original byte at a
+ time tark_revcomp_seq against the sequence kernels, and making a
+ minus strand FASTA window in three passes (copy, memcpy_with_cr,
+ reverse) against the single pass tark_copy_transform.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "htslib_fetcher.h"
+#include "seq_kernels.h"
+
+#define SEQ_SIZE 100000000
+#define ROUNDS 3
+#define LINE_LENGTH 60
+
+/* The original tark_revcomp_seq, strlen then a lookup through
+   trnconv in to "TGCAN" for every base */
+
+static const char* legacy_revcom = "TGCAN";
+static int legacy_trnconv[256];
+
+char* legacy_revcomp_seq(char *seq) {
+  char tmp;
+  int i, k, l, l2;
+
+  l = strlen(seq);
+  l2 = l/2;
+
+  k = l - 1;
+  for(i = 0; i < l2; i++) {
+    if(seq[k] == '\n') { k--; }
+    if(seq[i] == '\n') { i++; }
+    tmp = legacy_revcom[ legacy_trnconv[(int)seq[k]] ];
+    seq[k] = legacy_revcom[ legacy_trnconv[(int)seq[i]] ];
+    seq[i] = tmp;
+
+    k--;
+  }
+
+  if(l % 2 != 0) {
+    seq[i] = legacy_revcom[ legacy_trnconv[(int)seq[i]] ];
+  }
+
+  return seq;
+}
+
+double time_inplace(const char* name, char* seq, void (*fn)(char*)) {
+  clock_t begin;
+  double secs;
+  int r;
+
+  begin = clock();
+  for(r = 0; r < ROUNDS; r++) {
+    fn(seq);
+  }
+  secs = (double)(clock() - begin) / CLOCKS_PER_SEC / ROUNDS;
+
+  printf("%-28s %8.4fs %8.1f Mbp/s\n", name, secs, SEQ_SIZE / secs / 1e6);
+  return secs;
+}
+
+void run_legacy(char* seq) {
+  legacy_revcomp_seq(seq);
+}
+
+void run_kernel(char* seq) {
+  tark_revcomp_seq_len(seq, SEQ_SIZE);
+}
+
+void run_scalar(char* seq) {
+  _seq_revcomp_inplace_scalar(seq, SEQ_SIZE);
+}
+
+int main(int argc, const char* argv[]) {
+  const char* bases = "ACGTACGTACGTacgtNnRY";
+  char* seq;
+  char* dest;
+  char* fetched;
+  clock_t begin;
+  double legacy, kernel, secs;
+  int i, cr, bytes_to_cr, level;
+
+  for(i = 0; i < 256; i++) {
+    legacy_trnconv[i] = 4;
+  }
+  legacy_trnconv['A'] = legacy_trnconv['a'] = 0;
+  legacy_trnconv['C'] = legacy_trnconv['c'] = 1;
+  legacy_trnconv['G'] = legacy_trnconv['g'] = 2;
+  legacy_trnconv['T'] = legacy_trnconv['t'] = 3;
+
+  seq = malloc(SEQ_SIZE + 1);
+  dest = malloc(SEQ_SIZE + 1);
+  if(seq == NULL || dest == NULL) {
+    fprintf(stderr, "Can't allocate %d bytes\n", SEQ_SIZE);
+    return 1;
+  }
+
+  srand(42);
+  for(i = 0; i < SEQ_SIZE; i++) {
+    seq[i] = bases[rand() % 20];
+  }
+  seq[SEQ_SIZE] = '\0';
+
+  printf("Reverse complementing %dbp, kernels: %s\n", SEQ_SIZE, seq_kernels_impl());
+
+  legacy = time_inplace("tark_revcomp_seq (original)", seq, run_legacy);
+  time_inplace("scalar, in place", seq, run_scalar);
+  kernel = time_inplace("tark_revcomp_seq_len", seq, run_kernel);
+
+  begin = clock();
+  for(i = 0; i < ROUNDS; i++) {
+    seq_revcomp(dest, seq, SEQ_SIZE);
+  }
+  secs = (double)(clock() - begin) / CLOCKS_PER_SEC / ROUNDS;
+  printf("%-28s %8.4fs %8.1f Mbp/s\n", "seq_revcomp, out of place", secs, SEQ_SIZE / secs / 1e6);
+
+  printf("Speedup over the original: %.1fx\n", legacy / kernel);
+
+  /* FASTA, 60bp lines, the output needs room for the CR */
+  free(dest);
+  dest = malloc(SEQ_SIZE + SEQ_SIZE / LINE_LENGTH + 1);
+  fetched = malloc(SEQ_SIZE + 1);
+
+  begin = clock();
+  for(i = 0; i < ROUNDS; i++) {
+    memcpy(dest, seq, SEQ_SIZE);
+  }
+  secs = (double)(clock() - begin) / CLOCKS_PER_SEC / ROUNDS;
+  printf("%-28s %8.4fs %8.1f Mbp/s\n", "memcpy, for reference", secs, SEQ_SIZE / secs / 1e6);
+
+  begin = clock();
+  for(i = 0; i < ROUNDS; i++) {
+    bytes_to_cr = LINE_LENGTH;
+    memcpy(fetched, seq, SEQ_SIZE);
+    cr = memcpy_with_cr(dest, fetched, SEQ_SIZE, LINE_LENGTH, &bytes_to_cr);
+    dest[SEQ_SIZE + cr] = '\0';
+    legacy_revcomp_seq(dest);
+  }
+  legacy = (double)(clock() - begin) / CLOCKS_PER_SEC / ROUNDS;
+  printf("%-28s %8.4fs %8.1f Mbp/s\n", "minus strand FASTA, 3 pass", legacy, SEQ_SIZE / legacy / 1e6);
+
+  begin = clock();
+  for(i = 0; i < ROUNDS; i++) {
+    bytes_to_cr = LINE_LENGTH;
+    tark_copy_transform(dest, seq, SEQ_SIZE, SEQ_XFORM_REVCOMP, LINE_LENGTH, &bytes_to_cr);
+  }
+  kernel = (double)(clock() - begin) / CLOCKS_PER_SEC / ROUNDS;
+  printf("%-28s %8.4fs %8.1f Mbp/s\n", "minus strand FASTA, fused", kernel, SEQ_SIZE / kernel / 1e6);
+
+  printf("Speedup over three passes: %.1fx\n", legacy / kernel);
+
+  /* The same build with each level of kernels the CPU runs */
+  for(level = SEQ_KERNELS_SCALAR; seq_kernels_use(level); level++) {
+    begin = clock();
+    for(i = 0; i < ROUNDS; i++) {
+      seq_revcomp(dest, seq, SEQ_SIZE);
+    }
+    secs = (double)(clock() - begin) / CLOCKS_PER_SEC / ROUNDS;
+
+    begin = clock();
+    for(i = 0; i < ROUNDS; i++) {
+      bytes_to_cr = LINE_LENGTH;
+      tark_copy_transform(dest, seq, SEQ_SIZE, SEQ_XFORM_REVCOMP, LINE_LENGTH, &bytes_to_cr);
+    }
+    kernel = (double)(clock() - begin) / CLOCKS_PER_SEC / ROUNDS;
+
+    printf("%-10s seq_revcomp %8.1f Mbp/s, fused FASTA %8.1f Mbp/s\n", seq_kernels_impl(),
+	   SEQ_SIZE / secs / 1e6, SEQ_SIZE / kernel / 1e6);
+  }
+
+  free(fetched);
+
+  free(seq);
+  free(dest);
+  return 0;
+}
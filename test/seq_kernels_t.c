@@ -0,0 +1,211 @@
+/*
+
+ Wrapper between mod_faidx and htslib to fetch one or
+ more sequences and either return that or translate
+ to a protein sequence.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "seq_kernels.h"
+#include "htslib_fetcher.h"
+
+#include "test_harness.h"
+
+/*
+  Test the sequence kernels
+ */
+
+int main(int argc, const char* argv[]) {
+  char seq[1024];
+  char simd[1024];
+  char scalar[1024];
+  unsigned char packed[256];
+  const char* code;
+  int i, len, level, id;
+  int transforms[] = { 0, SEQ_XFORM_UPPER, SEQ_XFORM_LOWER,
+		       SEQ_XFORM_REVCOMP, SEQ_XFORM_REVCOMP | SEQ_XFORM_UPPER,
+		       SEQ_XFORM_REVCOMP | SEQ_XFORM_LOWER, SEQ_XFORM_HARDMASK,
+		       SEQ_XFORM_REVCOMP | SEQ_XFORM_HARDMASK,
+		       SEQ_XFORM_REVCOMP | SEQ_XFORM_HARDMASK | SEQ_XFORM_LOWER };
+
+  /* The best the CPU runs is picked without being asked */
+  printf("Sequence kernels: %s\n", seq_kernels_impl());
+  ASSERT_INT_EQUAL(seq_kernels_detect(), seq_kernels_init());
+  ASSERT_TRUE( seq_kernels_use(SEQ_KERNELS_SCALAR) );
+  ASSERT_STR_EQUAL("scalar", seq_kernels_impl());
+  ASSERT_FALSE( seq_kernels_use(SEQ_KERNELS_AVX512 + 1) );
+
+  /* The NCBI genetic codes by their transl_table id, 7 and 8
+     were retired so have no table */
+  ASSERT_PTR_EQUAL(seq_codon_table, seq_genetic_code(SEQ_GENETIC_CODE_STANDARD));
+  ASSERT_STR_EQUAL("Standard", seq_genetic_code_name(1));
+  ASSERT_STR_EQUAL("Vertebrate Mitochondrial", seq_genetic_code_name(2));
+  ASSERT_PTR_NOTNULL(seq_genetic_code(11));
+  ASSERT_PTR_NOTNULL(seq_genetic_code(33));
+  ASSERT_PTR_EQUAL(NULL, seq_genetic_code(0));
+  ASSERT_PTR_EQUAL(NULL, seq_genetic_code(7));
+  ASSERT_PTR_EQUAL(NULL, seq_genetic_code(8));
+  ASSERT_PTR_EQUAL(NULL, seq_genetic_code(-1));
+  ASSERT_PTR_EQUAL(NULL, seq_genetic_code(1000));
+  ASSERT_PTR_EQUAL(NULL, seq_genetic_code_name(7));
+
+  /* Everything below is checked with each level this CPU runs */
+  for(level = seq_kernels_detect(); level >= SEQ_KERNELS_SCALAR; level--) {
+    ASSERT_TRUE( seq_kernels_use(level) );
+    printf("Checking kernels: %s\n", seq_kernels_impl());
+
+    /* IUPAC codes are complemented, case is kept, anything
+       else is left alone */
+    strcpy(seq, "ACGTUacgtuRYKMBVDHSWNrykmbvdhswn-*.X");
+    tark_revcomp_seq(seq);
+    ASSERT_STR_EQUAL("X.*-nwsdhbvkmryNWSDHBVKMRYaacgtAACGT", seq);
+
+    /* Explicit lengths, odd and even, nothing past len is touched */
+    strcpy(seq, "ACCGTTA");
+    tark_revcomp_seq_len(seq, 3);
+    ASSERT_STR_EQUAL("GGTGTTA", seq);
+    tark_revcomp_seq_len(seq, 4);
+    ASSERT_STR_EQUAL("CACCTTA", seq);
+    tark_revcomp_seq_len(seq, 0);
+    ASSERT_STR_EQUAL("CACCTTA", seq);
+
+    /* The vector versions must agree with the scalar ones on every
+       byte value, at every length around the block sizes */
+    srand(42);
+    for(len = 0; len < 300; len++) {
+      for(i = 0; i < len; i++) {
+	seq[i] = (char)(rand() & 0xFF);
+      }
+
+      seq_revcomp(simd, seq, len);
+      _seq_revcomp_scalar(scalar, seq, len);
+      ASSERT_INT_EQUAL(0, memcmp(simd, scalar, len));
+
+      /* and in place, which is the same as out of place */
+      memcpy(simd, seq, len);
+      seq_revcomp_inplace(simd, len);
+      ASSERT_INT_EQUAL(0, memcmp(simd, scalar, len));
+
+      memcpy(simd, seq, len);
+      _seq_revcomp_inplace_scalar(simd, len);
+      ASSERT_INT_EQUAL(0, memcmp(simd, scalar, len));
+    }
+
+    /* Transforms in one pass, reverse complementing and folding case */
+    strcpy(seq, "ACGTNacgtn-");
+    seq_transform(simd, seq, 11, SEQ_XFORM_REVCOMP | SEQ_XFORM_UPPER);
+    simd[11] = '\0';
+    ASSERT_STR_EQUAL("-NACGTNACGT", simd);
+    seq_transform(simd, seq, 11, SEQ_XFORM_LOWER);
+    ASSERT_STR_EQUAL("acgtnacgtn-", simd);
+
+    /* Hard masking turns the soft masked, lower case, bases to N */
+    seq_transform(simd, seq, 11, SEQ_XFORM_HARDMASK);
+    ASSERT_STR_EQUAL("ACGTNNNNNN-", simd);
+    seq_transform(simd, seq, 11, SEQ_XFORM_REVCOMP | SEQ_XFORM_HARDMASK);
+    ASSERT_STR_EQUAL("-NNNNNNACGT", simd);
+
+    for(len = 0; len < 300; len++) {
+      for(i = 0; i < len; i++) {
+	seq[i] = (char)(rand() & 0xFF);
+      }
+
+      for(i = 0; i < sizeof(transforms) / sizeof(int); i++) {
+	seq_transform(simd, seq, len, transforms[i]);
+	_seq_transform_scalar(scalar, seq, len, transforms[i]);
+	ASSERT_INT_EQUAL(0, memcmp(simd, scalar, len));
+      }
+    }
+
+    /* Every codon of the standard code, in ACGT order, lower case
+       and U translate the same, anything ambiguous is an X */
+    strcpy(seq, "AAAAACAAGAATACAACCACGACTAGAAGCAGGAGTATAATCATGATT"
+	        "CAACACCAGCATCCACCCCCGCCTCGACGCCGGCGTCTACTCCTGCTT"
+	        "GAAGACGAGGATGCAGCCGCGGCTGGAGGCGGGGGTGTAGTCGTGGTT"
+	        "TAATACTAGTATTCATCCTCGTCTTGATGCTGGTGTTTATTCTTGTTT"
+	        "augNAAANAANAGRTN");
+    len = seq_translate(simd, seq, strlen(seq));
+    simd[len] = '\0';
+    ASSERT_STR_EQUAL("KNKNTTTTRSRSIIMIQHQHPPPPRRRRLLLLEDEDAAAAGGGGVVVV*Y*YSSSS*CWCLFLFMXXXX", simd);
+
+    /* The same in the vertebrate mitochondrial code, AGA and AGG
+       are stops, ATA is M and TGA is W */
+    len = seq_translate_code(simd, seq, strlen(seq), seq_genetic_code(2));
+    simd[len] = '\0';
+    ASSERT_STR_EQUAL("KNKNTTTT*S*SMIMIQHQHPPPPRRRRLLLLEDEDAAAAGGGGVVVV*Y*YSSSSWCWCLFLFMXXXX", simd);
+
+    /* Bacterial is the standard code, the ciliates read TAA and TAG as Q */
+    ASSERT_INT_EQUAL(0, memcmp(seq_codon_table, seq_genetic_code(11), 128));
+    len = seq_translate_code(simd, "TAATAGTGA", 9, seq_genetic_code(6));
+    simd[len] = '\0';
+    ASSERT_STR_EQUAL("QQ*", simd);
+
+    /* The vector version against the scalar one, mostly bases with
+       some noise, at every length around the block size */
+    for(len = 0; len < 300; len++) {
+      for(i = 0; i < len; i++) {
+	seq[i] = (rand() % 10) ? "ACGTacgtU"[rand() % 9] : (char)(rand() & 0xFF);
+      }
+
+      ASSERT_INT_EQUAL(len / 3, seq_translate(simd, seq, len));
+      _seq_translate_scalar(scalar, seq, len, seq_codon_table);
+      ASSERT_INT_EQUAL(0, memcmp(simd, scalar, len / 3));
+
+      /* and with every other genetic code */
+      for(id = 0; id < 64; id++) {
+	code = seq_genetic_code(id);
+	if(code == NULL) continue;
+
+	seq_translate_code(simd, seq, len, code);
+	_seq_translate_scalar(scalar, seq, len, code);
+	ASSERT_INT_EQUAL(0, memcmp(simd, scalar, len / 3));
+      }
+    }
+
+    /* .2bit packing, T C A G from the top bits down */
+    packed[0] = 0x1B;
+    packed[1] = 0xE4;
+    seq_unpack_2bit(simd, packed, 0, 8);
+    simd[8] = '\0';
+    ASSERT_STR_EQUAL("TCAGGACT", simd);
+    seq_unpack_2bit(simd, packed, 3, 2);
+    simd[2] = '\0';
+    ASSERT_STR_EQUAL("GG", simd);
+
+    /* From any base, for any length, against unpacking base by base */
+    for(i = 0; i < 256; i++) {
+      packed[i] = rand() & 0xFF;
+    }
+    for(id = 0; id < 8; id++) {
+      for(len = 0; len < 200; len++) {
+	memset(simd, 0, len + 1);
+	seq_unpack_2bit(simd, packed, id, len);
+	for(i = 0; i < len; i++) {
+	  scalar[i] = "TCAG"[(packed[(id + i) / 4] >> (6 - 2 * ((id + i) % 4))) & 3];
+	}
+	ASSERT_INT_EQUAL(0, memcmp(simd, scalar, len));
+	ASSERT_INT_EQUAL(0, simd[len]);
+      }
+    }
+
+    /* Complementing twice is a no-op, except U which becomes T */
+    for(i = 0; i < 256; i++) {
+      if(i == 'U' || i == 'u') continue;
+      ASSERT_INT_EQUAL(i, seq_complement[seq_complement[i]]);
+    }
+  }
+
+  return 0;
+}
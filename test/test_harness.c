@@ -41,6 +41,17 @@ void assert_int_nequal(const int expected, const int actual, int lineno)
     exit(1);
 }
 
+void assert_int64_equal(const int64_t expected, const int64_t actual, int lineno)
+{
+    if (expected == actual) return;
+
+    fprintf(stderr, "Line %d: expected <%lld>, but saw <%lld>\n", lineno,
+	    (long long)expected, (long long)actual);
+    fflush(stderr);
+
+    exit(1);
+}
+
 void assert_size_equal(size_t expected, size_t actual, int lineno)
 {
     if (expected == actual) return;
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #ifndef DATAFILE_PATH
 #define DATAFILE_PATH ../
@@ -36,6 +37,7 @@
 
 void assert_int_equal(const int expected, const int actual, int lineno);
 void assert_int_nequal(const int expected, const int actual, int lineno);
+void assert_int64_equal(const int64_t expected, const int64_t actual, int lineno);
 void assert_str_equal(const char *expected, const char *actual, int lineno);
 void assert_str_nequal(const char *expected, const char *actual,
                        size_t n, int lineno);
@@ -50,6 +52,7 @@ void assert_size_equal(size_t expected, size_t actual, int lineno);
 
 #define ASSERT_INT_EQUAL(a, b)        assert_int_equal(a, b, __LINE__)
 #define ASSERT_INT_NEQUAL(a, b)       assert_int_nequal(a, b, __LINE__)
+#define ASSERT_INT64_EQUAL(a, b)      assert_int64_equal(a, b, __LINE__)
 #define ASSERT_STR_EQUAL(a, b)        assert_str_equal(a, b, __LINE__)
 #define ASSERT_STR_NEQUAL(a, b, c)    assert_str_nequal(a, b, c, __LINE__)
 #define ASSERT_PTR_NOTNULL(a)         assert_ptr_notnull(a, __LINE__)
@@ -0,0 +1,127 @@
+/*
+
+ Benchmark translating 100Mbp, the original codons[5][5] string
+ table with three trnconv lookups per codon against the packed
+ codon kernels.
+
+ Copyright [2016-2017] EMBL-European Bioinformatics Institute
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "seq_kernels.h"
+
+#define SEQ_SIZE 100000002
+#define ROUNDS 3
+
+/* The original lookup chain */
+
+const char* legacy_codons[5][5] = {
+  { "KNKNX", "TTTTX", "RSRSX", "IIMIX", "XXXXX" },
+  { "QHQHX", "PPPPX", "RRRRX", "LLLLX", "XXXXX" },
+  { "EDEDX", "AAAAX", "GGGGX", "VVVVX", "XXXXX" },
+  { "*Y*YX", "SSSSX", "*CWCX", "LFLFX", "XXXXX" },
+  { "XXXXX", "XXXXX", "XXXXX", "XXXXX", "XXXXX" }
+};
+static int legacy_trnconv[256];
+
+void legacy_translate(char* dest, const char* seq, int len) {
+  int i, k = 0;
+
+  for(i = 2; i < len; i += 3) {
+    dest[k] = legacy_codons[legacy_trnconv[(int)seq[i-2]]]
+                          [legacy_trnconv[(int)seq[i-1]]]
+                          [legacy_trnconv[(int)seq[i]]];
+    k++;
+  }
+}
+
+void run_legacy(char* dest, const char* seq) {
+  legacy_translate(dest, seq, SEQ_SIZE);
+}
+
+void run_scalar(char* dest, const char* seq) {
+  _seq_translate_scalar(dest, seq, SEQ_SIZE, seq_codon_table);
+}
+
+void run_kernel(char* dest, const char* seq) {
+  seq_translate(dest, seq, SEQ_SIZE);
+}
+
+double time_translate(const char* name, char* dest, const char* seq, void (*fn)(char*, const char*)) {
+  clock_t begin;
+  double secs;
+  int r;
+
+  begin = clock();
+  for(r = 0; r < ROUNDS; r++) {
+    fn(dest, seq);
+  }
+  secs = (double)(clock() - begin) / CLOCKS_PER_SEC / ROUNDS;
+
+  printf("%-28s %8.4fs %8.1f Mbp/s\n", name, secs, SEQ_SIZE / secs / 1e6);
+  return secs;
+}
+
+int main(int argc, const char* argv[]) {
+  const char* bases = "ACGTACGTACGTACGTACGN";
+  char* seq;
+  char* legacy_aa;
+  char* kernel_aa;
+  double legacy, kernel;
+  int i;
+
+  for(i = 0; i < 256; i++) {
+    legacy_trnconv[i] = 4;
+  }
+  legacy_trnconv['A'] = legacy_trnconv['a'] = 0;
+  legacy_trnconv['C'] = legacy_trnconv['c'] = 1;
+  legacy_trnconv['G'] = legacy_trnconv['g'] = 2;
+  legacy_trnconv['T'] = legacy_trnconv['t'] = 3;
+  legacy_trnconv['U'] = legacy_trnconv['u'] = 3;
+
+  seq = malloc(SEQ_SIZE + 1);
+  legacy_aa = malloc(SEQ_SIZE / 3 + 1);
+  kernel_aa = malloc(SEQ_SIZE / 3 + 1);
+  if(seq == NULL || legacy_aa == NULL || kernel_aa == NULL) {
+    fprintf(stderr, "Can't allocate %d bytes\n", SEQ_SIZE);
+    return 1;
+  }
+
+  srand(42);
+  for(i = 0; i < SEQ_SIZE; i++) {
+    seq[i] = bases[rand() % 20];
+  }
+  seq[SEQ_SIZE] = '\0';
+
+  printf("Translating %dbp, kernels: %s\n", SEQ_SIZE, seq_kernels_impl());
+
+  legacy = time_translate("codons[5][5] (original)", legacy_aa, seq, run_legacy);
+  time_translate("packed codons, scalar", kernel_aa, seq, run_scalar);
+  kernel = time_translate("seq_translate", kernel_aa, seq, run_kernel);
+
+  if(memcmp(legacy_aa, kernel_aa, SEQ_SIZE / 3)) {
+    fprintf(stderr, "Translations differ\n");
+    return 1;
+  }
+
+  printf("Speedup over the original: %.1fx\n", legacy / kernel);
+
+  free(seq);
+  free(legacy_aa);
+  free(kernel_aa);
+  return 0;
+}